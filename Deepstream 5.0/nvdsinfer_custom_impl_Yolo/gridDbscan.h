@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GRID_DBSCAN_H__
+#define __GRID_DBSCAN_H__
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "nvdsinfer_custom_impl.h"
+
+/*
+ * DBSCAN over the boxes of each class, with 1 - IoU as the distance, for dense
+ * scenes where one object draws many overlapping proposals. nvinfer's own DBSCAN
+ * compares every pair; here the neighbours of a box come from a uniform grid. Every
+ * box is listed in each cell its extent covers and a query reads the cells of its
+ * own extent, so only boxes that overlap it are compared. Since eps < 1, the
+ * neighbours must overlap anyway. The cell side is the median box side, so a box
+ * covers a handful of cells and a query costs about the number of boxes near it.
+ * Each cluster becomes one box.
+ */
+struct GridDbscanParams
+{
+    float eps{0.7f};       // neighbours overlap by IoU >= 1 - eps, 0 < eps < 1
+    int minPts{3};         // boxes in the neighbourhood, the box itself included, of a core box
+    float minScore{0.0f};  // clusters with a smaller sum of confidences are dropped
+};
+
+static inline float objectIou(const NvDsInferParseObjectInfo& a, const NvDsInferParseObjectInfo& b)
+{
+    const float w = std::min(a.left + a.width, b.left + b.width) - std::max(a.left, b.left);
+    const float h = std::min(a.top + a.height, b.top + b.height) - std::max(a.top, b.top);
+    if (w <= 0.0f || h <= 0.0f) return 0.0f;
+    const float inter = w * h;
+    return inter / (a.width * a.height + b.width * b.height - inter);
+}
+
+/* Clusters boxes[ids] of one class into out. */
+static inline void gridDbscanClass(
+    const std::vector<NvDsInferParseObjectInfo>& boxes, const std::vector<int>& ids,
+    const GridDbscanParams& params, std::vector<NvDsInferParseObjectInfo>& out)
+{
+    const int n = ids.size();
+    const float minIou = 1.0f - params.eps;
+
+    float x0 = boxes[ids[0]].left, y0 = boxes[ids[0]].top, x1 = x0, y1 = y0;
+    std::vector<float> sides(n);
+    for (int i = 0; i < n; ++i) {
+        const NvDsInferParseObjectInfo& b = boxes[ids[i]];
+        x0 = std::min(x0, b.left);
+        y0 = std::min(y0, b.top);
+        x1 = std::max(x1, b.left + b.width);
+        y1 = std::max(y1, b.top + b.height);
+        sides[i] = 0.5f * (b.width + b.height);
+    }
+    std::nth_element(sides.begin(), sides.begin() + n / 2, sides.end());
+    float cell = std::max(sides[n / 2], 1.0f);
+    // a few huge boxes over a sparse frame would make the grid larger than the input
+    while ((x1 - x0) / cell * ((y1 - y0) / cell) > 4.0f * n + 64.0f) cell *= 2.0f;
+    const int cols = (int)((x1 - x0) / cell) + 1;
+    const int rows = (int)((y1 - y0) / cell) + 1;
+    auto cellRange = [&](const NvDsInferParseObjectInfo& b, int& cx0, int& cy0, int& cx1, int& cy1) {
+        cx0 = std::min(cols - 1, (int)((b.left - x0) / cell));
+        cy0 = std::min(rows - 1, (int)((b.top - y0) / cell));
+        cx1 = std::min(cols - 1, (int)((b.left + b.width - x0) / cell));
+        cy1 = std::min(rows - 1, (int)((b.top + b.height - y0) / cell));
+    };
+
+    // cell lists in one array: cell c holds members[start[c], start[c + 1])
+    std::vector<int> start(cols * rows + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(boxes[ids[i]], cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx) ++start[cy * cols + cx + 1];
+    }
+    for (int c = 0; c < cols * rows; ++c) start[c + 1] += start[c];
+    std::vector<int> members(start.back());
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (int i = 0; i < n; ++i) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(boxes[ids[i]], cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx) members[fill[cy * cols + cx]++] = i;
+    }
+
+    // a box shares several cells with a neighbour, seen[] keeps it from being tested twice
+    std::vector<int> seen(n, -1);
+    auto neighbours = [&](int i, std::vector<int>& result) {
+        result.clear();
+        const NvDsInferParseObjectInfo& b = boxes[ids[i]];
+        int cx0, cy0, cx1, cy1;
+        cellRange(b, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                const int c = cy * cols + cx;
+                for (int m = start[c]; m < start[c + 1]; ++m) {
+                    const int j = members[m];
+                    if (seen[j] == i) continue;
+                    seen[j] = i;
+                    if (j == i || objectIou(b, boxes[ids[j]]) >= minIou) result.push_back(j);
+                }
+            }
+        }
+    };
+
+    static const int kUNVISITED = -2, kNOISE = -1;
+    std::vector<int> label(n, kUNVISITED);
+    std::vector<int> found, queue;
+    int clusters = 0;
+    for (int i = 0; i < n; ++i) {
+        if (label[i] != kUNVISITED) continue;
+        neighbours(i, found);
+        if ((int)found.size() < params.minPts) {
+            label[i] = kNOISE;
+            continue;
+        }
+        const int cluster = clusters++;
+        label[i] = cluster;
+        queue = found;
+        for (size_t q = 0; q < queue.size(); ++q) {
+            const int j = queue[q];
+            if (label[j] == kNOISE) label[j] = cluster;  // border box
+            if (label[j] != kUNVISITED) continue;
+            label[j] = cluster;
+            neighbours(j, found);
+            if ((int)found.size() >= params.minPts) queue.insert(queue.end(), found.begin(), found.end());
+        }
+    }
+
+    // confidence weighted corners, the best confidence of the cluster
+    struct Sum
+    {
+        float weight, left, top, right, bottom, best;
+    };
+    std::vector<Sum> sums(clusters, Sum{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f});
+    for (int i = 0; i < n; ++i) {
+        if (label[i] < 0) continue;
+        const NvDsInferParseObjectInfo& b = boxes[ids[i]];
+        Sum& s = sums[label[i]];
+        const float w = b.detectionConfidence;
+        s.weight += w;
+        s.left += w * b.left;
+        s.top += w * b.top;
+        s.right += w * (b.left + b.width);
+        s.bottom += w * (b.top + b.height);
+        s.best = std::max(s.best, w);
+    }
+    for (const Sum& s : sums) {
+        if (s.weight <= 0.0f || s.weight < params.minScore) continue;
+        NvDsInferParseObjectInfo o;
+        o.classId = boxes[ids[0]].classId;
+        o.left = s.left / s.weight;
+        o.top = s.top / s.weight;
+        o.width = s.right / s.weight - o.left;
+        o.height = s.bottom / s.weight - o.top;
+        o.detectionConfidence = s.best;
+        out.push_back(o);
+    }
+}
+
+/* One box per cluster of each class; noise boxes are dropped. */
+static inline std::vector<NvDsInferParseObjectInfo> gridDbscan(
+    const std::vector<NvDsInferParseObjectInfo>& boxes, const GridDbscanParams& params)
+{
+    std::vector<NvDsInferParseObjectInfo> out;
+    std::vector<int> order(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+        [&](int a, int b) { return boxes[a].classId < boxes[b].classId; });
+    std::vector<int> ids;
+    for (size_t b = 0; b < order.size();) {
+        size_t e = b;
+        ids.clear();
+        while (e < order.size() && boxes[order[e]].classId == boxes[order[b]].classId) ids.push_back(order[e++]);
+        gridDbscanClass(boxes, ids, params, out);
+        b = e;
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cuda.h>
+#include <cuda_runtime.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "yoloV3Output.h"
+
+inline __device__ float sigmoidGPU(const float& x) { return 1.0f / (1.0f + __expf(-x)); }
+
+/* One thread per (cell, box). Cells under the objectness threshold return before
+ * reading their class scores; the rest take a slot with an atomic on the count and
+ * write one YoloV3Candidate, see yoloLayerV3Host() for the same thing on the host. */
+__global__ void gpuYoloLayerV3(const float* input, float* output, const uint gridSize,
+                               const uint numOutputClasses, const uint numBBoxes,
+                               const float objThresh)
+{
+    uint x_id = blockIdx.x * blockDim.x + threadIdx.x;
+    uint y_id = blockIdx.y * blockDim.y + threadIdx.y;
+    uint z_id = blockIdx.z * blockDim.z + threadIdx.z;
+
+    if (x_id == 0 && y_id == 0 && z_id == 0)
+    {
+        output[1] = gridSize;
+        output[2] = numBBoxes;
+    }
+    if ((x_id >= gridSize) || (y_id >= gridSize) || (z_id >= numBBoxes))
+    {
+        return;
+    }
+
+    const int numGridCells = gridSize * gridSize;
+    const int bbindex = y_id * gridSize + x_id;
+    const float* cur = input + z_id * (5 + numOutputClasses) * numGridCells;
+
+    const float objectness = sigmoidGPU(cur[4 * numGridCells + bbindex]);
+    if (objectness < objThresh) return;
+
+    float maxProb = 0.0f;
+    int maxIndex = -1;
+    for (uint i = 0; i < numOutputClasses; ++i)
+    {
+        const float prob = sigmoidGPU(cur[(5 + i) * numGridCells + bbindex]);
+        if (prob > maxProb)
+        {
+            maxProb = prob;
+            maxIndex = i;
+        }
+    }
+
+    // the count stays a float like the rest of the buffer, exact far beyond the slots
+    const int slot = (int)atomicAdd(output, 1.0f);
+    if (slot >= (int)kYOLOV3_MAX_CANDIDATES) return;
+
+    YoloV3Candidate* c = reinterpret_cast<YoloV3Candidate*>(output + kYOLOV3_HEADER_SIZE) + slot;
+    c->x = x_id + sigmoidGPU(cur[bbindex]);
+    c->y = y_id + sigmoidGPU(cur[numGridCells + bbindex]);
+    c->w = __expf(cur[2 * numGridCells + bbindex]);
+    c->h = __expf(cur[3 * numGridCells + bbindex]);
+    c->conf = objectness * maxProb;
+    c->classId = maxIndex;
+    c->box = z_id;
+    c->reserved = 0.0f;
+}
+
+cudaError_t cudaYoloLayerV3(const void* input, void* output, const uint& batchSize,
+                            const uint& gridSize, const uint& numOutputClasses,
+                            const uint& numBBoxes, uint64_t outputSize,
+                            const float& objThresh, cudaStream_t stream)
+{
+    dim3 threads_per_block(16, 16, 4);
+    dim3 number_of_blocks((gridSize / threads_per_block.x) + 1,
+                          (gridSize / threads_per_block.y) + 1,
+                          (numBBoxes / threads_per_block.z) + 1);
+    const uint64_t inputSize = (uint64_t)gridSize * gridSize * numBBoxes * (5 + numOutputClasses);
+    for (unsigned int batch = 0; batch < batchSize; ++batch)
+    {
+        // only the header needs clearing, records past the count are never read
+        float* out = reinterpret_cast<float*>(output) + (batch * outputSize);
+        cudaMemsetAsync(out, 0, kYOLOV3_HEADER_SIZE * sizeof(float), stream);
+        gpuYoloLayerV3<<<number_of_blocks, threads_per_block, 0, stream>>>(
+            reinterpret_cast<const float*>(input) + (batch * inputSize), out,
+            gridSize, numOutputClasses, numBBoxes, objThresh);
+    }
+    return cudaGetLastError();
+}
@@ -28,12 +28,20 @@
 #include <iostream>
 #include <unordered_map>
 #include "nvdsinfer_custom_impl.h"
+#include "gridDbscan.h"
 #include "trt_utils.h"
+#include "yoloV3Output.h"
+#include "yolo_def.h"
 
 static const int NUM_CLASSES_YOLO = 80;
 #define NMS_THRESH 0.5
 #define CONF_THRESH 0.4
 #define BATCH_SIZE 1
+// NvDsInferParseCustomYoloV5Dbscan: boxes with IoU >= 1 - DBSCAN_EPS are neighbours,
+// DBSCAN_MIN_PTS of them make a core box, clusters below DBSCAN_MIN_SCORE summed confidence are dropped
+#define DBSCAN_EPS 0.7
+#define DBSCAN_MIN_PTS 3
+#define DBSCAN_MIN_SCORE 0.0
 
 extern "C" bool NvDsInferParseCustomYoloV5(
     std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
@@ -41,12 +49,24 @@ extern "C" bool NvDsInferParseCustomYoloV5(
     NvDsInferParseDetectionParams const &detectionParams,
     std::vector<NvDsInferParseObjectInfo> &objectList);
 
+extern "C" bool NvDsInferParseCustomYoloV5Dbscan(
+    std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+    NvDsInferNetworkInfo const &networkInfo,
+    NvDsInferParseDetectionParams const &detectionParams,
+    std::vector<NvDsInferParseObjectInfo> &objectList);
+
 extern "C" bool NvDsInferParseCustomYoloV4(
     std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
     NvDsInferNetworkInfo const &networkInfo,
     NvDsInferParseDetectionParams const &detectionParams,
     std::vector<NvDsInferParseObjectInfo> &objectList);
 
+extern "C" bool NvDsInferParseCustomScaledYoloV4(
+    std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+    NvDsInferNetworkInfo const &networkInfo,
+    NvDsInferParseDetectionParams const &detectionParams,
+    std::vector<NvDsInferParseObjectInfo> &objectList);
+
 extern "C" bool NvDsInferParseCustomYoloV3(
     std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
     NvDsInferNetworkInfo const& networkInfo,
@@ -78,13 +98,8 @@ extern "C" bool NvDsInferParseCustomYoloTLT(
     std::vector<NvDsInferParseObjectInfo>& objectList);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static constexpr int LOCATIONS = 4;
-struct alignas(float) Detection{
-        //center_x center_y w h
-        float bbox[LOCATIONS];
-        float conf;  // bbox_conf * cls_conf
-        float class_id;
-    };
+typedef Yolo::Detection Detection;
+typedef Yolo::PackedDetection PackedDetection;
 
 float iou(float lbox[4], float rbox[4]) {
     float interBox[] = {
@@ -101,29 +116,37 @@ float iou(float lbox[4], float rbox[4]) {
     return interBoxS/(lbox[2]*lbox[3] + rbox[2]*rbox[3] -interBoxS);
 }
 
-bool cmp(Detection& a, Detection& b) {
+float iou(const PackedDetection& l, const PackedDetection& r) {
+    float lbox[Yolo::LOCATIONS], rbox[Yolo::LOCATIONS];
+    for (int i = 0; i < Yolo::LOCATIONS; ++i) {
+        lbox[i] = Yolo::halfToFloat(l.bbox[i]);
+        rbox[i] = Yolo::halfToFloat(r.bbox[i]);
+    }
+    return iou(lbox, rbox);
+}
+
+// conf is never negative, so its half bits sort like the value
+bool cmp(const PackedDetection& a, const PackedDetection& b) {
     return a.conf > b.conf;
 }
 
+// output: [count, PackedDetection x MAX_OUTPUT_BBOX_COUNT] as YoloLayer_TRT writes it
 void nms(std::vector<Detection>& res, float *output, float conf_thresh, float nms_thresh = 0.5) {
-    int det_size = sizeof(Detection) / sizeof(float);
-    std::map<float, std::vector<Detection>> m;
-    for (int i = 0; i < output[0] && i < 1000; i++) {
-        if (output[1 + det_size * i + 4] <= conf_thresh) continue;
-        Detection det;
-        memcpy(&det, &output[1 + det_size * i], det_size * sizeof(float));
-        if (m.count(det.class_id) == 0) m.emplace(det.class_id, std::vector<Detection>());
-        m[det.class_id].push_back(det);
+    const PackedDetection* records = reinterpret_cast<const PackedDetection*>(output + 1);
+    const uint16_t conf_bits = Yolo::floatToHalf(conf_thresh);
+    std::map<int, std::vector<PackedDetection>> m;
+    for (int i = 0; i < output[0] && i < Yolo::MAX_OUTPUT_BBOX_COUNT; i++) {
+        if (records[i].conf <= conf_bits) continue;
+        m[records[i].class_id].push_back(records[i]);
     }
     for (auto it = m.begin(); it != m.end(); it++) {
-        //std::cout << it->second[0].class_id << " --- " << std::endl;
         auto& dets = it->second;
         std::sort(dets.begin(), dets.end(), cmp);
         for (size_t m = 0; m < dets.size(); ++m) {
             auto& item = dets[m];
-            res.push_back(item);
+            res.push_back(Yolo::unpackDetection(item));
             for (size_t n = m + 1; n < dets.size(); ++n) {
-                if (iou(item.bbox, dets[n].bbox) > nms_thresh) {
+                if (iou(item, dets[n]) > nms_thresh) {
                     dets.erase(dets.begin()+n);
                     --n;
                 }
@@ -131,6 +154,28 @@ void nms(std::vector<Detection>& res, float *output, float conf_thresh, float nm
         }
     }
 }
+
+// output as for nms(); every box above conf_thresh goes into the clustering, see gridDbscan.h
+void dbscan(std::vector<NvDsInferParseObjectInfo>& res, float *output, float conf_thresh, const GridDbscanParams& params) {
+    const PackedDetection* records = reinterpret_cast<const PackedDetection*>(output + 1);
+    const uint16_t conf_bits = Yolo::floatToHalf(conf_thresh);
+    std::vector<NvDsInferParseObjectInfo> boxes;
+    for (int i = 0; i < output[0] && i < Yolo::MAX_OUTPUT_BBOX_COUNT; i++) {
+        if (records[i].conf <= conf_bits) continue;
+        Detection d = Yolo::unpackDetection(records[i]);
+        NvDsInferParseObjectInfo b;
+        b.classId = d.class_id;
+        b.left = d.bbox[0] - d.bbox[2] * 0.5f;
+        b.top = d.bbox[1] - d.bbox[3] * 0.5f;
+        b.width = d.bbox[2];
+        b.height = d.bbox[3];
+        b.detectionConfidence = d.conf;
+        boxes.push_back(b);
+    }
+    if (boxes.empty()) return;
+    std::vector<NvDsInferParseObjectInfo> clusters = gridDbscan(boxes, params);
+    res.insert(res.end(), clusters.begin(), clusters.end());
+}
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /* This is a sample bounding box parsing function for the sample YoloV5m detector model */
@@ -138,7 +183,8 @@ static bool NvDsInferParseYoloV5(
     std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
     NvDsInferNetworkInfo const& networkInfo,
     NvDsInferParseDetectionParams const& detectionParams,
-    std::vector<NvDsInferParseObjectInfo>& objectList)
+    std::vector<NvDsInferParseObjectInfo>& objectList,
+    bool clustered = false)
 {
     if (NUM_CLASSES_YOLO != detectionParams.numClassesConfigured)
     {
@@ -149,44 +195,23 @@ static bool NvDsInferParseYoloV5(
 
     std::vector<Detection> res;
 
-    nms(res, (float*)(outputLayersInfo[0].buffer), CONF_THRESH, NMS_THRESH);
-    //std::cout<<"Nms done sucessfully----"<<std::endl;
-    
-    for(auto& r : res) {
-	    NvDsInferParseObjectInfo oinfo;        
-        
-	    oinfo.classId = r.class_id;
-	    oinfo.left    = static_cast<unsigned int>(r.bbox[0]-r.bbox[2]*0.5f);
-	    oinfo.top     = static_cast<unsigned int>(r.bbox[1]-r.bbox[3]*0.5f);
-	    oinfo.width   = static_cast<unsigned int>(r.bbox[2]);
-	    oinfo.height  = static_cast<unsigned int>(r.bbox[3]);
-	    oinfo.detectionConfidence = r.conf;
-        //std::cout << static_cast<unsigned int>(r.bbox[0]) << "," << static_cast<unsigned int>(r.bbox[1]) << "," << static_cast<unsigned int>(r.bbox[2]) << "," 
-        //          << static_cast<unsigned int>(r.bbox[3]) << "," << static_cast<unsigned int>(r.class_id) << "," << static_cast<unsigned int>(r.conf) << std::endl;
-	    objectList.push_back(oinfo);        
+    float* output = (float*)(outputLayersInfo[0].buffer);
+    // engines serialized with YoloLayer_TRT version 1 still output float records
+    std::vector<float> packed;
+    if (outputLayersInfo[0].inferDims.d[0] == Yolo::LEGACY_OUTPUT_SIZE) {
+        packed.resize(Yolo::OUTPUT_SIZE);
+        Yolo::packLegacyOutput(output, packed.data());
+        output = packed.data();
     }
-    
-    return true;
-}
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-/* This is a sample bounding box parsing function for the sample YoloV4 detector model */
-static bool NvDsInferParseYoloV4(
-    std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
-    NvDsInferNetworkInfo const& networkInfo,
-    NvDsInferParseDetectionParams const& detectionParams,
-    std::vector<NvDsInferParseObjectInfo>& objectList)
-{
-    if (NUM_CLASSES_YOLO != detectionParams.numClassesConfigured)
-    {
-        std::cerr << "WARNING: Num classes mismatch. Configured:"
-                  << detectionParams.numClassesConfigured
-                  << ", detected by network: " << NUM_CLASSES_YOLO << std::endl;
+    if (clustered) {
+        GridDbscanParams params;
+        params.eps = DBSCAN_EPS;
+        params.minPts = DBSCAN_MIN_PTS;
+        params.minScore = DBSCAN_MIN_SCORE;
+        dbscan(objectList, output, CONF_THRESH, params);
+        return true;
     }
-
-    std::vector<Detection> res;
-
-    nms(res, (float*)(outputLayersInfo[0].buffer), CONF_THRESH, NMS_THRESH);
+    nms(res, output, CONF_THRESH, NMS_THRESH);
     //std::cout<<"Nms done sucessfully----"<<std::endl;
     
     for(auto& r : res) {
@@ -299,57 +324,27 @@ decodeYoloV2Tensor(
     return binfo;
 }
 
-static std::vector<NvDsInferParseObjectInfo>
+/* Compact output of the YoloLayerV3 plugin, see yoloV3Output.h: the plugin already kept
+ * the cells over its objectness threshold and applied the logistic / exp, so this only
+ * scales the candidates by their anchors. */
+static void
 decodeYoloV3Tensor(
     const float* detections, const std::vector<int> &mask, const std::vector<float> &anchors,
-    const uint gridSizeW, const uint gridSizeH, const uint stride, const uint numBBoxes,
-    const uint numOutputClasses, const uint& netW,
-    const uint& netH)
+    const uint stride, const uint& netW, const uint& netH,
+    std::vector<NvDsInferParseObjectInfo>& binfo)
 {
-    std::vector<NvDsInferParseObjectInfo> binfo;
-    for (uint y = 0; y < gridSizeH; ++y) {
-        for (uint x = 0; x < gridSizeW; ++x) {
-            for (uint b = 0; b < numBBoxes; ++b)
-            {
-                const float pw = anchors[mask[b] * 2];
-                const float ph = anchors[mask[b] * 2 + 1];
-
-                const int numGridCells = gridSizeH * gridSizeW;
-                const int bbindex = y * gridSizeW + x;
-                const float bx
-                    = x + detections[bbindex + numGridCells * (b * (5 + numOutputClasses) + 0)];
-                const float by
-                    = y + detections[bbindex + numGridCells * (b * (5 + numOutputClasses) + 1)];
-                const float bw
-                    = pw * detections[bbindex + numGridCells * (b * (5 + numOutputClasses) + 2)];
-                const float bh
-                    = ph * detections[bbindex + numGridCells * (b * (5 + numOutputClasses) + 3)];
-
-                const float objectness
-                    = detections[bbindex + numGridCells * (b * (5 + numOutputClasses) + 4)];
-
-                float maxProb = 0.0f;
-                int maxIndex = -1;
-
-                for (uint i = 0; i < numOutputClasses; ++i)
-                {
-                    float prob
-                        = (detections[bbindex
-                                      + numGridCells * (b * (5 + numOutputClasses) + (5 + i))]);
-
-                    if (prob > maxProb)
-                    {
-                        maxProb = prob;
-                        maxIndex = i;
-                    }
-                }
-                maxProb = objectness * maxProb;
+    const uint count = std::min((uint)detections[0], kYOLOV3_MAX_CANDIDATES);
+    const YoloV3Candidate* candidates
+        = reinterpret_cast<const YoloV3Candidate*>(detections + kYOLOV3_HEADER_SIZE);
+    for (uint i = 0; i < count; ++i)
+    {
+        const YoloV3Candidate& c = candidates[i];
+        const uint b = c.box;
+        const float pw = anchors[mask[b] * 2];
+        const float ph = anchors[mask[b] * 2 + 1];
 
-                addBBoxProposal(bx, by, bw, bh, stride, netW, netH, maxIndex, maxProb, binfo);
-            }
-        }
+        addBBoxProposal(c.x, c.y, pw * c.w, ph * c.h, stride, netW, netH, c.classId, c.conf, binfo);
     }
-    return binfo;
 }
 
 static inline std::vector<const NvDsInferLayerInfo*>
@@ -366,6 +361,79 @@ SortLayers(const std::vector<NvDsInferLayerInfo> & outputLayersInfo)
     return outLayers;
 }
 
+/* Raw YOLOv4 heads: the conv outputs before any activation, [numBBoxes * (5 + classes), H, W].
+ * The width/height equation is chosen at compile time so the per cell loop has no branches:
+ * darknet's exp for yolov4 / yolov4-tiny, (2 * logistic)^2 for the new_coords heads of
+ * scaled YOLOv4. x and y are the grid sensitive logistic * scale_x_y - (scale_x_y - 1) / 2. */
+template <bool kNewCoords>
+static inline float decodeYoloV4WH(float t);
+
+template <>
+inline float decodeYoloV4WH<false>(float t)
+{
+    return exp(t);
+}
+
+template <>
+inline float decodeYoloV4WH<true>(float t)
+{
+    const float s = 2.0f / (1.0f + exp(-t));
+    return s * s;
+}
+
+static inline float sigmoid(float t) { return 1.0f / (1.0f + exp(-t)); }
+
+template <bool kNewCoords>
+static void
+decodeYoloV4Tensor(
+    const float* detections, const std::vector<int> &mask, const std::vector<float> &anchors,
+    const float scaleXY, const uint gridSizeW, const uint gridSizeH, const uint stride,
+    const uint numOutputClasses, const float minObjectness, const uint& netW, const uint& netH,
+    std::vector<NvDsInferParseObjectInfo>& binfo)
+{
+    const int numGridCells = gridSizeH * gridSizeW;
+    // confidence is objectness * class probability, so a cell whose objectness is below
+    // the lowest class threshold can be dropped on its logit, before any exp
+    const float minLogit = minObjectness > 0.0f
+        ? log(minObjectness / (1.0f - minObjectness)) - 1e-3f : -INFINITY;
+    const float offsetXY = 0.5f * (scaleXY - 1.0f);
+    for (uint b = 0; b < mask.size(); ++b)
+    {
+        const float pw = anchors[mask[b] * 2];
+        const float ph = anchors[mask[b] * 2 + 1];
+        const float* cur = detections + (size_t)b * (5 + numOutputClasses) * numGridCells;
+        for (int bbindex = 0; bbindex < numGridCells; ++bbindex)
+        {
+            const float objLogit = cur[4 * numGridCells + bbindex];
+            if (objLogit < minLogit) continue;
+
+            // logistic is monotonic, the arg max can run on the logits
+            int maxIndex = 0;
+            float maxLogit = cur[5 * numGridCells + bbindex];
+            for (uint i = 1; i < numOutputClasses; ++i)
+            {
+                const float v = cur[(5 + i) * numGridCells + bbindex];
+                if (v > maxLogit)
+                {
+                    maxLogit = v;
+                    maxIndex = i;
+                }
+            }
+            const float maxProb = sigmoid(objLogit) * sigmoid(maxLogit);
+            if (maxProb < minObjectness) continue;
+
+            const uint x = bbindex % gridSizeW;
+            const uint y = bbindex / gridSizeW;
+            const float bx = x + sigmoid(cur[bbindex]) * scaleXY - offsetXY;
+            const float by = y + sigmoid(cur[numGridCells + bbindex]) * scaleXY - offsetXY;
+            const float bw = pw * decodeYoloV4WH<kNewCoords>(cur[2 * numGridCells + bbindex]);
+            const float bh = ph * decodeYoloV4WH<kNewCoords>(cur[3 * numGridCells + bbindex]);
+
+            addBBoxProposal(bx, by, bw, bh, stride, netW, netH, maxIndex, maxProb, binfo);
+        }
+    }
+}
+
 static bool NvDsInferParseYoloV3(
     std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
     NvDsInferNetworkInfo const& networkInfo,
@@ -376,11 +444,8 @@ static bool NvDsInferParseYoloV3(
 {
     const uint kNUM_BBOXES = 3;
 
-    const std::vector<const NvDsInferLayerInfo*> sortedLayers =
-        SortLayers (outputLayersInfo);
-
-    if (sortedLayers.size() != masks.size()) {
-        std::cerr << "ERROR: yoloV3 output layer.size: " << sortedLayers.size()
+    if (outputLayersInfo.size() != masks.size()) {
+        std::cerr << "ERROR: yoloV3 output layer.size: " << outputLayersInfo.size()
                   << " does not match mask.size: " << masks.size() << std::endl;
         return false;
     }
@@ -392,24 +457,114 @@ static bool NvDsInferParseYoloV3(
                   << ", detected by network: " << NUM_CLASSES_YOLO << std::endl;
     }
 
+    // Engines built by this library output [kYOLOV3_OUTPUT_SIZE, 1, 1] per head. Raw
+    // 255 x Grid x Grid conv heads, from networks exported without the plugin, are
+    // compacted here by the host reference so both take the same decode.
+    std::vector<std::vector<float>> compacted;
+    compacted.reserve(outputLayersInfo.size());
+    std::vector<const float*> heads;
+    for (auto const &layer : outputLayersInfo) {
+        assert(layer.inferDims.numDims == 3);
+        if ((uint64_t)layer.inferDims.d[0] == kYOLOV3_OUTPUT_SIZE) {
+            heads.push_back((const float*)(layer.buffer));
+            continue;
+        }
+        assert(layer.inferDims.d[1] == layer.inferDims.d[2]);
+        assert(layer.inferDims.d[0] == (int)(kNUM_BBOXES * (5 + NUM_CLASSES_YOLO)));
+        compacted.emplace_back(kYOLOV3_OUTPUT_SIZE);
+        yoloLayerV3Host((const float*)(layer.buffer), compacted.back().data(),
+                        layer.inferDims.d[1], NUM_CLASSES_YOLO, kNUM_BBOXES,
+                        kYOLOV3_OBJECTNESS_THRESH);
+        heads.push_back(compacted.back().data());
+    }
+    // masks go from the smallest grid up, as SortLayers() orders full grid layers
+    std::sort(heads.begin(), heads.end(),
+        [](const float* a, const float* b) { return a[1] < b[1]; });
+
     std::vector<NvDsInferParseObjectInfo> objects;
 
     for (uint idx = 0; idx < masks.size(); ++idx) {
-        const NvDsInferLayerInfo &layer = *sortedLayers[idx]; // 255 x Grid x Grid
+        const float* head = heads[idx];
+        assert((uint)head[2] == masks[idx].size());
+        if (head[0] > kYOLOV3_MAX_CANDIDATES) {
+            std::cerr << "WARNING: yoloV3 head of grid " << head[1] << " has " << head[0]
+                      << " candidates, only " << kYOLOV3_MAX_CANDIDATES << " are kept" << std::endl;
+        }
+        const uint gridSize = head[1];
+        const uint stride = DIVUP(networkInfo.width, gridSize);
+        assert(stride == DIVUP(networkInfo.height, gridSize));
+
+        decodeYoloV3Tensor(head, masks[idx], anchors, stride,
+                           networkInfo.width, networkInfo.height, objects);
+    }
+
+
+    objectList = objects;
+
+    return true;
+}
+
+/* One entry per head, in SortLayers() order: smallest grid (largest stride) first */
+struct YoloV4HeadParams
+{
+    std::vector<int> mask;
+    float scaleXY;
+};
+
+template <bool kNewCoords>
+static bool NvDsInferParseYoloV4(
+    std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
+    NvDsInferNetworkInfo const& networkInfo,
+    NvDsInferParseDetectionParams const& detectionParams,
+    std::vector<NvDsInferParseObjectInfo>& objectList,
+    const std::vector<float> &anchors,
+    const std::vector<YoloV4HeadParams> &heads)
+{
+    const std::vector<const NvDsInferLayerInfo*> sortedLayers =
+        SortLayers (outputLayersInfo);
+
+    if (sortedLayers.size() != heads.size()) {
+        std::cerr << "ERROR: yoloV4 output layer.size: " << sortedLayers.size()
+                  << " does not match heads.size: " << heads.size() << std::endl;
+        return false;
+    }
+
+    float minObjectness = 1.0f;
+    for (float t : detectionParams.perClassPreclusterThreshold) {
+        minObjectness = std::min(minObjectness, t);
+    }
+    if (detectionParams.perClassPreclusterThreshold.empty()) minObjectness = 0.0f;
+
+    std::vector<NvDsInferParseObjectInfo> objects;
+    for (uint idx = 0; idx < heads.size(); ++idx) {
+        const NvDsInferLayerInfo &layer = *sortedLayers[idx]; // 3 * (5 + classes) x Grid x Grid
+        const YoloV4HeadParams &head = heads[idx];
 
         assert(layer.inferDims.numDims == 3);
+        const uint numBBoxes = head.mask.size();
+        if (layer.inferDims.d[0] % numBBoxes != 0 || layer.inferDims.d[0] / numBBoxes <= 5) {
+            std::cerr << "ERROR: yoloV4 output layer " << layer.layerName << " has "
+                      << layer.inferDims.d[0] << " channels, not a multiple of 5 + classes for "
+                      << numBBoxes << " anchors" << std::endl;
+            return false;
+        }
+        const uint numClasses = layer.inferDims.d[0] / numBBoxes - 5;
+        if (numClasses != detectionParams.numClassesConfigured && idx == 0)
+        {
+            std::cerr << "WARNING: Num classes mismatch. Configured:"
+                      << detectionParams.numClassesConfigured
+                      << ", detected by network: " << numClasses << std::endl;
+        }
         const uint gridSizeH = layer.inferDims.d[1];
         const uint gridSizeW = layer.inferDims.d[2];
         const uint stride = DIVUP(networkInfo.width, gridSizeW);
         assert(stride == DIVUP(networkInfo.height, gridSizeH));
 
-        std::vector<NvDsInferParseObjectInfo> outObjs =
-            decodeYoloV3Tensor((const float*)(layer.buffer), masks[idx], anchors, gridSizeW, gridSizeH, stride, kNUM_BBOXES,
-                       NUM_CLASSES_YOLO, networkInfo.width, networkInfo.height);
-        objects.insert(objects.end(), outObjs.begin(), outObjs.end());
+        decodeYoloV4Tensor<kNewCoords>((const float*)(layer.buffer), head.mask, anchors, head.scaleXY,
+            gridSizeW, gridSizeH, stride, numClasses, minObjectness,
+            networkInfo.width, networkInfo.height, objects);
     }
 
-
     objectList = objects;
 
     return true;
@@ -468,14 +623,52 @@ extern "C" bool NvDsInferParseCustomYoloV5(
         outputLayersInfo, networkInfo, detectionParams, objectList);
 }
 
+/* Same output as NvDsInferParseCustomYoloV5, with each DBSCAN cluster of boxes merged
+ * into one in place of NMS. For crowded scenes; set parse-bbox-func-name to it. */
+extern "C" bool NvDsInferParseCustomYoloV5Dbscan(
+    std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+    NvDsInferNetworkInfo const &networkInfo,
+    NvDsInferParseDetectionParams const &detectionParams,
+    std::vector<NvDsInferParseObjectInfo> &objectList)
+{
+    return NvDsInferParseYoloV5(
+        outputLayersInfo, networkInfo, detectionParams, objectList, true);
+}
+
 extern "C" bool NvDsInferParseCustomYoloV4(
     std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
     NvDsInferNetworkInfo const &networkInfo,
     NvDsInferParseDetectionParams const &detectionParams,
     std::vector<NvDsInferParseObjectInfo> &objectList)
 {
-    return NvDsInferParseYoloV4 (
-        outputLayersInfo, networkInfo, detectionParams, objectList);
+    // yolov4.cfg: the stride 32 head uses the largest anchors and the smallest scale_x_y
+    static const std::vector<float> kANCHORS = {
+        12, 16, 19, 36, 40, 28, 36, 75, 76, 55, 72, 146, 142, 110, 192, 243, 459, 401};
+    static const std::vector<YoloV4HeadParams> kHEADS = {
+        {{6, 7, 8}, 1.05f},
+        {{3, 4, 5}, 1.1f},
+        {{0, 1, 2}, 1.2f}};
+    return NvDsInferParseYoloV4<false> (
+        outputLayersInfo, networkInfo, detectionParams, objectList,
+        kANCHORS, kHEADS);
+}
+
+extern "C" bool NvDsInferParseCustomScaledYoloV4(
+    std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+    NvDsInferNetworkInfo const &networkInfo,
+    NvDsInferParseDetectionParams const &detectionParams,
+    std::vector<NvDsInferParseObjectInfo> &objectList)
+{
+    // yolov4-csp.cfg (new_coords=1), heads exported before their logistic activation
+    static const std::vector<float> kANCHORS = {
+        12, 16, 19, 36, 40, 28, 36, 75, 76, 55, 72, 146, 142, 110, 192, 243, 459, 401};
+    static const std::vector<YoloV4HeadParams> kHEADS = {
+        {{6, 7, 8}, 2.0f},
+        {{3, 4, 5}, 2.0f},
+        {{0, 1, 2}, 2.0f}};
+    return NvDsInferParseYoloV4<true> (
+        outputLayersInfo, networkInfo, detectionParams, objectList,
+        kANCHORS, kHEADS);
 }
 
 extern "C" bool NvDsInferParseCustomYoloV3(
@@ -588,7 +781,9 @@ extern "C" bool NvDsInferParseCustomYoloTLT(
 
 /* Check that the custom function has been defined correctly */
 CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomYoloV5);
+CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomYoloV5Dbscan);
 CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomYoloV4);
+CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomScaledYoloV4);
 CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomYoloV3);
 CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomYoloV3Tiny);
 CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseCustomYoloV2);
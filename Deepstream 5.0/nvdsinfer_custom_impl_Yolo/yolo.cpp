@@ -22,6 +22,7 @@
 
 #include "yolo.h"
 #include "yoloPlugins.h"
+#include "darknet_cfg.h"
 
 #include <fstream>
 #include <iomanip>
@@ -167,15 +168,15 @@ NvDsInferStatus Yolo::buildYoloNetwork(
             TensorInfo& curYoloTensor = m_OutputTensors.at(outputTensorCount);
             curYoloTensor.gridSize = prevTensorDims.d[1];
             curYoloTensor.stride = m_InputW / curYoloTensor.gridSize;
-            m_OutputTensors.at(outputTensorCount).volume = curYoloTensor.gridSize
-                * curYoloTensor.gridSize
-                * (curYoloTensor.numBBoxes * (5 + curYoloTensor.numClasses));
+            // the plugin thresholds on the device and outputs count + candidates
+            m_OutputTensors.at(outputTensorCount).volume = kYOLOV3_OUTPUT_SIZE;
             std::string layerName = "yolo_" + std::to_string(i);
             curYoloTensor.blobName = layerName;
             nvinfer1::IPluginV2* yoloPlugin
                 = new YoloLayerV3(m_OutputTensors.at(outputTensorCount).numBBoxes,
                                   m_OutputTensors.at(outputTensorCount).numClasses,
-                                  m_OutputTensors.at(outputTensorCount).gridSize);
+                                  m_OutputTensors.at(outputTensorCount).gridSize,
+                                  kYOLOV3_OBJECTNESS_THRESH);
             assert(yoloPlugin != nullptr);
             nvinfer1::IPluginV2Layer* yolo =
                 network.addPluginV2(&previous, 1, *yoloPlugin);
@@ -351,38 +352,10 @@ NvDsInferStatus Yolo::buildYoloNetwork(
 std::vector<std::map<std::string, std::string>>
 Yolo::parseConfigFile (const std::string cfgFilePath)
 {
+    // shared with the CPU backend's buildDarknet()
     assert(fileExists(cfgFilePath));
-    std::ifstream file(cfgFilePath);
-    assert(file.good());
-    std::string line;
-    std::vector<std::map<std::string, std::string>> blocks;
-    std::map<std::string, std::string> block;
-
-    while (getline(file, line))
-    {
-        if (line.size() == 0) continue;
-        if (line.front() == '#') continue;
-        line = trim(line);
-        if (line.front() == '[')
-        {
-            if (block.size() > 0)
-            {
-                blocks.push_back(block);
-                block.clear();
-            }
-            std::string key = "type";
-            std::string value = trim(line.substr(1, line.size() - 2));
-            block.insert(std::pair<std::string, std::string>(key, value));
-        }
-        else
-        {
-            int cpos = line.find('=');
-            std::string key = trim(line.substr(0, cpos));
-            std::string value = trim(line.substr(cpos + 1));
-            block.insert(std::pair<std::string, std::string>(key, value));
-        }
-    }
-    blocks.push_back(block);
+    std::vector<std::map<std::string, std::string>> blocks = Darknet::parseConfigFile(cfgFilePath);
+    assert(!blocks.empty());
     return blocks;
 }
 
@@ -415,23 +388,7 @@ void Yolo::parseConfigBlocks()
                           .c_str());
 
             TensorInfo outputTensor;
-            std::string anchorString = block.at("anchors");
-            while (!anchorString.empty())
-            {
-                int npos = anchorString.find_first_of(',');
-                if (npos != -1)
-                {
-                    float anchor = std::stof(trim(anchorString.substr(0, npos)));
-                    outputTensor.anchors.push_back(anchor);
-                    anchorString.erase(0, npos + 1);
-                }
-                else
-                {
-                    float anchor = std::stof(trim(anchorString));
-                    outputTensor.anchors.push_back(anchor);
-                    break;
-                }
-            }
+            outputTensor.anchors = Darknet::parseFloats(block.at("anchors"));
 
             if ((m_NetworkType == "yolov3") || (m_NetworkType == "yolov3-tiny"))
             {
@@ -439,22 +396,9 @@ void Yolo::parseConfigBlocks()
                        && std::string("Missing 'mask' param in " + block.at("type") + " layer")
                               .c_str());
 
-                std::string maskString = block.at("mask");
-                while (!maskString.empty())
+                for (int mask : Darknet::parseInts(block.at("mask")))
                 {
-                    int npos = maskString.find_first_of(',');
-                    if (npos != -1)
-                    {
-                        uint mask = std::stoul(trim(maskString.substr(0, npos)));
-                        outputTensor.masks.push_back(mask);
-                        maskString.erase(0, npos + 1);
-                    }
-                    else
-                    {
-                        uint mask = std::stoul(trim(maskString));
-                        outputTensor.masks.push_back(mask);
-                        break;
-                    }
+                    outputTensor.masks.push_back(mask);
                 }
             }
 
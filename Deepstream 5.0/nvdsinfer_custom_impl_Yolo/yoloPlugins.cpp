@@ -46,7 +46,8 @@ void read(const char*& buffer, T& val)
 cudaError_t cudaYoloLayerV3 (
     const void* input, void* output, const uint& batchSize,
     const uint& gridSize, const uint& numOutputClasses,
-    const uint& numBBoxes, uint64_t outputSize, cudaStream_t stream);
+    const uint& numBBoxes, uint64_t outputSize,
+    const float& objThresh, cudaStream_t stream);
 
 YoloLayerV3::YoloLayerV3 (const void* data, size_t length)
 {
@@ -54,19 +55,22 @@ YoloLayerV3::YoloLayerV3 (const void* data, size_t length)
     read(d, m_NumBoxes);
     read(d, m_NumClasses);
     read(d, m_GridSize);
+    read(d, m_ObjThresh);
     read(d, m_OutputSize);
 };
 
 YoloLayerV3::YoloLayerV3 (
-    const uint& numBoxes, const uint& numClasses, const uint& gridSize) :
+    const uint& numBoxes, const uint& numClasses, const uint& gridSize,
+    const float& objThresh) :
     m_NumBoxes(numBoxes),
     m_NumClasses(numClasses),
-    m_GridSize(gridSize)
+    m_GridSize(gridSize),
+    m_ObjThresh(objThresh)
 {
     assert(m_NumBoxes > 0);
     assert(m_NumClasses > 0);
     assert(m_GridSize > 0);
-    m_OutputSize = m_GridSize * m_GridSize * (m_NumBoxes * (4 + 1 + m_NumClasses));
+    m_OutputSize = kYOLOV3_OUTPUT_SIZE;
 };
 
 nvinfer1::Dims
@@ -75,7 +79,7 @@ YoloLayerV3::getOutputDimensions(
 {
     assert(index == 0);
     assert(nbInputDims == 1);
-    return inputs[0];
+    return nvinfer1::Dims3{static_cast<int>(kYOLOV3_OUTPUT_SIZE), 1, 1};
 }
 
 bool YoloLayerV3::supportsFormat (
@@ -101,13 +105,14 @@ int YoloLayerV3::enqueue(
 {
     CHECK(cudaYoloLayerV3(
               inputs[0], outputs[0], batchSize, m_GridSize, m_NumClasses, m_NumBoxes,
-              m_OutputSize, stream));
+              m_OutputSize, m_ObjThresh, stream));
     return 0;
 }
 
 size_t YoloLayerV3::getSerializationSize() const noexcept
 {
-    return sizeof(m_NumBoxes) + sizeof(m_NumClasses) + sizeof(m_GridSize) + sizeof(m_OutputSize);
+    return sizeof(m_NumBoxes) + sizeof(m_NumClasses) + sizeof(m_GridSize) + sizeof(m_ObjThresh)
+        + sizeof(m_OutputSize);
 }
 
 void YoloLayerV3::serialize(void* buffer) const noexcept
@@ -116,12 +121,13 @@ void YoloLayerV3::serialize(void* buffer) const noexcept
     write(d, m_NumBoxes);
     write(d, m_NumClasses);
     write(d, m_GridSize);
+    write(d, m_ObjThresh);
     write(d, m_OutputSize);
 }
 
 nvinfer1::IPluginV2* YoloLayerV3::clone() const noexcept
 {
-    return new YoloLayerV3 (m_NumBoxes, m_NumClasses, m_GridSize);
+    return new YoloLayerV3 (m_NumBoxes, m_NumClasses, m_GridSize, m_ObjThresh);
 }
 
 REGISTER_TENSORRT_PLUGIN(YoloLayerV3PluginCreator);
@@ -30,6 +30,7 @@
 #include <memory>
 
 #include "NvInferPlugin.h"
+#include "yoloV3Output.h"
 
 #define CHECK(status)                                                                              \
     {                                                                                              \
@@ -43,7 +44,9 @@
 
 namespace
 {
-const char* YOLOV3LAYER_PLUGIN_VERSION {"1"};
+// 2: compact thresholded output, see yoloV3Output.h. Engines with version 1 layers
+// fail to deserialize and are rebuilt.
+const char* YOLOV3LAYER_PLUGIN_VERSION {"2"};
 const char* YOLOV3LAYER_PLUGIN_NAME {"YoloLayerV3_TRT"};
 } // namespace
 
@@ -51,7 +54,9 @@ class YoloLayerV3 : public nvinfer1::IPluginV2
 {
 public:
     YoloLayerV3 (const void* data, size_t length);
-    YoloLayerV3 (const uint& numBoxes, const uint& numClasses, const uint& gridSize);
+    YoloLayerV3 (
+        const uint& numBoxes, const uint& numClasses, const uint& gridSize,
+        const float& objThresh);
     const char* getPluginType () const noexcept override { return YOLOV3LAYER_PLUGIN_NAME; }
     const char* getPluginVersion () const noexcept override { return YOLOV3LAYER_PLUGIN_VERSION; }
     int getNbOutputs () const noexcept override { return 1; }
@@ -90,6 +95,7 @@ private:
     uint m_NumBoxes {0};
     uint m_NumClasses {0};
     uint m_GridSize {0};
+    float m_ObjThresh {0.0f};
     uint64_t m_OutputSize {0};
     std::string m_Namespace {""};
 };
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __YOLO_V3_OUTPUT_H__
+#define __YOLO_V3_OUTPUT_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Compact output of the YoloLayerV3 plugin. Instead of the transformed grid, which is
+ * as large as the head, the plugin thresholds objectness on the device and writes
+ *
+ *   [count, gridSize, numBBoxes, 0, YoloV3Candidate x kYOLOV3_MAX_CANDIDATES]
+ *
+ * all as floats, so nvinfer copies a few KB per head to the host instead of the grid.
+ * count can exceed kYOLOV3_MAX_CANDIDATES when the threshold lets too many cells
+ * through; only the first kYOLOV3_MAX_CANDIDATES records are written then.
+ */
+static constexpr uint32_t kYOLOV3_HEADER_SIZE = 4;
+static constexpr uint32_t kYOLOV3_MAX_CANDIDATES = 1024;
+
+struct alignas(float) YoloV3Candidate
+{
+    float x;        // box centre in grid cells, cell index + logistic
+    float y;
+    float w;        // exp(t): multiple of the anchor of this box
+    float h;
+    float conf;     // objectness * class probability
+    float classId;
+    float box;      // index into the head's anchor mask
+    float reserved;
+};
+
+static constexpr uint32_t kYOLOV3_CANDIDATE_SIZE = sizeof(YoloV3Candidate) / sizeof(float);
+static constexpr uint64_t kYOLOV3_OUTPUT_SIZE
+    = kYOLOV3_HEADER_SIZE + (uint64_t)kYOLOV3_MAX_CANDIDATES * kYOLOV3_CANDIDATE_SIZE;
+
+/* Objectness the plugin keeps cells from. It only has to stay below the lowest
+ * pre-cluster threshold of the nvinfer config, the parser applies those. */
+static constexpr float kYOLOV3_OBJECTNESS_THRESH = 0.1f;
+
+/*
+ * Host reference of the plugin for one image: same records as the CUDA kernel in
+ * kernels.cu, in grid order instead of atomic order. The parser also runs it on
+ * full grid outputs of engines without the compacting plugin.
+ * input: numBBoxes * (5 + numClasses) x gridSize x gridSize raw head.
+ */
+inline void yoloLayerV3Host(
+    const float* input, float* output, uint32_t gridSize, uint32_t numClasses,
+    uint32_t numBBoxes, float objThresh)
+{
+    const uint32_t numGridCells = gridSize * gridSize;
+    uint32_t count = 0;
+    YoloV3Candidate* candidates = reinterpret_cast<YoloV3Candidate*>(output + kYOLOV3_HEADER_SIZE);
+    for (uint32_t b = 0; b < numBBoxes; ++b)
+    {
+        const float* cur = input + (uint64_t)b * (5 + numClasses) * numGridCells;
+        for (uint32_t cell = 0; cell < numGridCells; ++cell)
+        {
+            const float objectness = 1.0f / (1.0f + expf(-cur[4 * numGridCells + cell]));
+            if (objectness < objThresh) continue;
+
+            float maxProb = 0.0f;
+            int maxIndex = -1;
+            for (uint32_t i = 0; i < numClasses; ++i)
+            {
+                const float prob = 1.0f / (1.0f + expf(-cur[(5 + i) * numGridCells + cell]));
+                if (prob > maxProb)
+                {
+                    maxProb = prob;
+                    maxIndex = i;
+                }
+            }
+
+            if (count < kYOLOV3_MAX_CANDIDATES)
+            {
+                YoloV3Candidate& c = candidates[count];
+                c.x = cell % gridSize + 1.0f / (1.0f + expf(-cur[cell]));
+                c.y = cell / gridSize + 1.0f / (1.0f + expf(-cur[numGridCells + cell]));
+                c.w = expf(cur[2 * numGridCells + cell]);
+                c.h = expf(cur[3 * numGridCells + cell]);
+                c.conf = objectness * maxProb;
+                c.classId = maxIndex;
+                c.box = b;
+                c.reserved = 0.0f;
+            }
+            ++count;
+        }
+    }
+    output[0] = count;
+    output[1] = gridSize;
+    output[2] = numBBoxes;
+    output[3] = 0.0f;
+}
+
+#endif // __YOLO_V3_OUTPUT_H__
@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks of the YoloLayerV3 compaction, run by "make test" against the built library:
+ * yoloLayerV3Host() on synthetic heads with known logits, the parser's fallback for raw
+ * heads, and, when a GPU is present, the CUDA kernel against the host reference. Also
+ * the raw head decode of NvDsInferParseCustomYoloV4 and NvDsInferParseCustomScaledYoloV4.
+ */
+
+#include <cuda_runtime.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "nvdsinfer_custom_impl.h"
+#include "yoloV3Output.h"
+
+cudaError_t cudaYoloLayerV3 (
+    const void* input, void* output, const uint& batchSize,
+    const uint& gridSize, const uint& numOutputClasses,
+    const uint& numBBoxes, uint64_t outputSize,
+    const float& objThresh, cudaStream_t stream);
+
+extern "C" bool NvDsInferParseCustomYoloV3Tiny(
+    std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
+    NvDsInferNetworkInfo const& networkInfo,
+    NvDsInferParseDetectionParams const& detectionParams,
+    std::vector<NvDsInferParseObjectInfo>& objectList);
+
+extern "C" bool NvDsInferParseCustomYoloV4(
+    std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
+    NvDsInferNetworkInfo const& networkInfo,
+    NvDsInferParseDetectionParams const& detectionParams,
+    std::vector<NvDsInferParseObjectInfo>& objectList);
+
+extern "C" bool NvDsInferParseCustomScaledYoloV4(
+    std::vector<NvDsInferLayerInfo> const& outputLayersInfo,
+    NvDsInferNetworkInfo const& networkInfo,
+    NvDsInferParseDetectionParams const& detectionParams,
+    std::vector<NvDsInferParseObjectInfo>& objectList);
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static bool near(float a, float b, float tol = 1e-4f)
+{
+    return std::fabs(a - b) <= tol * std::max(1.0f, std::fabs(b));
+}
+
+static float logit(float p) { return std::log(p / (1.0f - p)); }
+
+/* numBBoxes * (5 + numClasses) x gridSize x gridSize head with every objectness logit
+ * far below the threshold and the other logits 0 */
+struct Head
+{
+    uint gridSize, numClasses, numBBoxes;
+    std::vector<float> data;
+
+    Head(uint g, uint c, uint b)
+        : gridSize(g), numClasses(c), numBBoxes(b), data((uint64_t)b * (5 + c) * g * g, 0.0f)
+    {
+        for (uint box = 0; box < b; ++box)
+            for (uint cell = 0; cell < g * g; ++cell) at(box, 4, cell) = -10.0f;
+    }
+    float& at(uint box, uint channel, uint cell)
+    {
+        return data[((uint64_t)box * (5 + numClasses) + channel) * gridSize * gridSize + cell];
+    }
+    /* one cell over the threshold: centre offsets, log of the anchor multiples, a class */
+    void set(uint box, uint x, uint y, float tx, float ty, float w, float h, float objectness,
+             uint classId, float classProb)
+    {
+        const uint cell = y * gridSize + x;
+        at(box, 0, cell) = tx;
+        at(box, 1, cell) = ty;
+        at(box, 2, cell) = std::log(w);
+        at(box, 3, cell) = std::log(h);
+        at(box, 4, cell) = logit(objectness);
+        for (uint i = 0; i < numClasses; ++i) at(box, 5 + i, cell) = -10.0f;
+        at(box, 5 + classId, cell) = logit(classProb);
+    }
+};
+
+static const YoloV3Candidate* candidatesOf(const std::vector<float>& output)
+{
+    return reinterpret_cast<const YoloV3Candidate*>(output.data() + kYOLOV3_HEADER_SIZE);
+}
+
+static void testHostReference()
+{
+    Head head(5, 4, 3);
+    head.set(0, 1, 2, 0.0f, 0.0f, 2.0f, 0.5f, 0.5f, 1, 0.8f);
+    head.set(2, 4, 0, logit(0.25f), logit(0.75f), 1.0f, 3.0f, 0.9f, 3, 0.6f);
+    // either side of the threshold
+    head.set(1, 0, 0, 0.0f, 0.0f, 1.0f, 1.0f, 0.11f, 0, 0.9f);
+    head.set(1, 3, 3, 0.0f, 0.0f, 1.0f, 1.0f, 0.09f, 2, 0.9f);
+
+    std::vector<float> output(kYOLOV3_OUTPUT_SIZE, -1.0f);
+    yoloLayerV3Host(head.data.data(), output.data(), head.gridSize, head.numClasses,
+                    head.numBBoxes, kYOLOV3_OBJECTNESS_THRESH);
+    check(output[0] == 3, "host: count of cells over the objectness threshold");
+    check(output[1] == 5 && output[2] == 3 && output[3] == 0, "host: header");
+
+    // grid order: box, then row, then column
+    const YoloV3Candidate* c = candidatesOf(output);
+    const float expected[3][7] = {
+        {1.5f, 2.5f, 2.0f, 0.5f, 0.5f * 0.8f, 1, 0},
+        {0.5f, 0.5f, 1.0f, 1.0f, 0.11f * 0.9f, 0, 1},
+        {4.25f, 0.75f, 1.0f, 3.0f, 0.9f * 0.6f, 3, 2}};
+    for (int i = 0; i < 3; ++i)
+    {
+        const float got[7] = {c[i].x, c[i].y, c[i].w, c[i].h, c[i].conf, c[i].classId, c[i].box};
+        for (int k = 0; k < 7; ++k)
+            check(near(got[k], expected[i][k]),
+                  "host: candidate " + std::to_string(i) + " field " + std::to_string(k));
+        check(c[i].reserved == 0.0f, "host: reserved field");
+    }
+    check(output[kYOLOV3_HEADER_SIZE + 3 * kYOLOV3_CANDIDATE_SIZE] == -1.0f,
+          "host: nothing written past the count");
+}
+
+static void testHostOverflow()
+{
+    // 3 * 19 * 19 = 1083 cells, all kept: the count says so, the records stop at the slots
+    Head head(19, 2, 3);
+    for (uint box = 0; box < 3; ++box)
+        for (uint cell = 0; cell < 19 * 19; ++cell) head.at(box, 4, cell) = 0.0f;
+    std::vector<float> output(kYOLOV3_OUTPUT_SIZE + kYOLOV3_CANDIDATE_SIZE, -1.0f);
+    yoloLayerV3Host(head.data.data(), output.data(), 19, 2, 3, kYOLOV3_OBJECTNESS_THRESH);
+    check(output[0] == 3 * 19 * 19, "overflow: count includes the cells without a slot");
+    check(candidatesOf(output)[kYOLOV3_MAX_CANDIDATES - 1].box == 2,
+          "overflow: last slot written");
+    check(output[kYOLOV3_OUTPUT_SIZE] == -1.0f, "overflow: nothing written past the slots");
+}
+
+static NvDsInferLayerInfo layerOf(std::vector<float>& buffer, uint channels, uint gridSize)
+{
+    NvDsInferLayerInfo layer{};
+    layer.dataType = FLOAT;
+    layer.layerName = "yolo";
+    layer.buffer = buffer.data();
+    layer.inferDims.numDims = 3;
+    layer.inferDims.d[0] = channels;
+    layer.inferDims.d[1] = gridSize;
+    layer.inferDims.d[2] = gridSize;
+    layer.inferDims.numElements = channels * gridSize * gridSize;
+    return layer;
+}
+
+typedef bool (*ParseFn)(std::vector<NvDsInferLayerInfo> const&, NvDsInferNetworkInfo const&,
+                        NvDsInferParseDetectionParams const&, std::vector<NvDsInferParseObjectInfo>&);
+
+/* 80 classes at 416 x 416 with a pre-cluster threshold of 0.3, the boxes by left, top */
+static std::vector<NvDsInferParseObjectInfo> parse(ParseFn fn, std::vector<NvDsInferLayerInfo>& layers)
+{
+    NvDsInferNetworkInfo networkInfo{416, 416, 3};
+    NvDsInferParseDetectionParams params;
+    params.numClassesConfigured = 80;
+    params.perClassPreclusterThreshold.assign(80, 0.3f);
+    std::vector<NvDsInferParseObjectInfo> objects;
+    check(fn(layers, networkInfo, params, objects), "parser: returns true");
+    std::sort(objects.begin(), objects.end(),
+        [](const NvDsInferParseObjectInfo& a, const NvDsInferParseObjectInfo& b) {
+            return std::tie(a.left, a.top) < std::tie(b.left, b.top);
+        });
+    return objects;
+}
+
+static std::vector<NvDsInferParseObjectInfo> parseTiny(std::vector<NvDsInferLayerInfo>& layers)
+{
+    return parse(NvDsInferParseCustomYoloV3Tiny, layers);
+}
+
+static void testParserRawHeads()
+{
+    // yolov3-tiny at 416: 13 x 13 at stride 32 with mask {3, 4, 5}, 26 x 26 at stride 16
+    // with mask {1, 2, 3}; anchors 10,14, 23,27, 37,58, 81,82, 135,169, 344,319
+    Head coarse(13, 80, 3), fine(26, 80, 3);
+    coarse.set(1, 6, 6, 0.0f, 0.0f, 1.0f, 1.0f, 0.5f, 7, 0.9f);   // anchor 135 x 169
+    fine.set(0, 3, 4, 0.0f, 0.0f, 2.0f, 1.0f, 0.8f, 42, 0.95f);  // anchor 23 x 27
+
+    // raw heads, the fine one first: the parser orders them by grid
+    std::vector<NvDsInferLayerInfo> raw = {
+        layerOf(fine.data, 255, 26), layerOf(coarse.data, 255, 13)};
+    std::vector<NvDsInferParseObjectInfo> objects = parseTiny(raw);
+    check(objects.size() == 2, "parser: one box per kept cell");
+    if (objects.size() == 2)
+    {
+        const NvDsInferParseObjectInfo& f = objects[0];
+        check(f.classId == 42 && near(f.detectionConfidence, 0.8f * 0.95f), "parser: fine class");
+        check(near(f.left, 56.0f - 23.0f) && near(f.top, 72.0f - 13.5f)
+              && near(f.width, 46.0f) && near(f.height, 27.0f), "parser: fine box");
+        const NvDsInferParseObjectInfo& c = objects[1];
+        check(c.classId == 7 && near(c.detectionConfidence, 0.5f * 0.9f), "parser: coarse class");
+        check(near(c.left, 208.0f - 67.5f) && near(c.top, 208.0f - 84.5f)
+              && near(c.width, 135.0f) && near(c.height, 169.0f), "parser: coarse box");
+    }
+
+    // plugin output for one head, raw for the other: the same boxes
+    std::vector<float> compact(kYOLOV3_OUTPUT_SIZE);
+    yoloLayerV3Host(coarse.data.data(), compact.data(), 13, 80, 3, kYOLOV3_OBJECTNESS_THRESH);
+    std::vector<NvDsInferLayerInfo> mixed = {
+        layerOf(compact, kYOLOV3_OUTPUT_SIZE, 1), layerOf(fine.data, 255, 26)};
+    std::vector<NvDsInferParseObjectInfo> same = parseTiny(mixed);
+    check(same.size() == objects.size(), "parser: plugin and raw heads give as many boxes");
+    for (size_t i = 0; i < std::min(same.size(), objects.size()); ++i)
+        check(same[i].classId == objects[i].classId && same[i].left == objects[i].left
+              && same[i].top == objects[i].top && same[i].width == objects[i].width
+              && same[i].height == objects[i].height
+              && same[i].detectionConfidence == objects[i].detectionConfidence,
+              "parser: plugin and raw heads give the same box " + std::to_string(i));
+}
+
+/* yolov4 at 416: 13 x 13 at stride 32 with mask {6, 7, 8} and scale_x_y 1.05, 26 x 26 at
+ * stride 16 with {3, 4, 5} and 1.1, 52 x 52 at stride 8 with {0, 1, 2} and 1.2; anchors
+ * 12,16, 19,36, 40,28, 36,75, 76,55, 72,146, 142,110, 192,243, 459,401 */
+struct YoloV4Heads
+{
+    Head coarse{13, 80, 3}, mid{26, 80, 3}, fine{52, 80, 3};
+
+    std::vector<NvDsInferParseObjectInfo> parse(ParseFn fn)
+    {
+        // the fine head first: the parser orders them by grid
+        std::vector<NvDsInferLayerInfo> layers = {
+            layerOf(fine.data, 255, 52), layerOf(coarse.data, 255, 13), layerOf(mid.data, 255, 26)};
+        return ::parse(fn, layers);
+    }
+};
+
+static void testParserYoloV4()
+{
+    // x, y: grid cell + logistic * scale_x_y - (scale_x_y - 1) / 2, w, h: anchor * exp
+    YoloV4Heads heads;
+    heads.coarse.set(1, 6, 6, logit(0.75f), 0.0f, 0.5f, 1.0f, 0.6f, 7, 0.9f);  // anchor 192 x 243
+    heads.fine.set(2, 10, 20, 0.0f, logit(0.25f), 1.0f, 2.0f, 0.7f, 5, 0.8f);  // anchor 40 x 28
+    std::vector<NvDsInferParseObjectInfo> objects = heads.parse(NvDsInferParseCustomYoloV4);
+    check(objects.size() == 2, "yolov4: one box per kept cell");
+    if (objects.size() == 2)
+    {
+        // (10 + 0.5 * 1.2 - 0.1) * 8 = 84, (20 + 0.25 * 1.2 - 0.1) * 8 = 161.6
+        const NvDsInferParseObjectInfo& f = objects[0];
+        check(f.classId == 5 && near(f.detectionConfidence, 0.7f * 0.8f), "yolov4: fine class");
+        check(near(f.left, 84.0f - 20.0f) && near(f.top, 161.6f - 28.0f)
+              && near(f.width, 40.0f) && near(f.height, 56.0f), "yolov4: fine box");
+        // (6 + 0.75 * 1.05 - 0.025) * 32 = 216.4, (6 + 0.5 * 1.05 - 0.025) * 32 = 208
+        const NvDsInferParseObjectInfo& c = objects[1];
+        check(c.classId == 7 && near(c.detectionConfidence, 0.6f * 0.9f), "yolov4: coarse class");
+        check(near(c.left, 216.4f - 48.0f) && near(c.top, 208.0f - 121.5f)
+              && near(c.width, 96.0f) && near(c.height, 243.0f), "yolov4: coarse box");
+    }
+}
+
+static void testParserScaledYoloV4()
+{
+    // new_coords: scale_x_y 2 on every head, w, h: anchor * (2 * logistic)^2
+    YoloV4Heads heads;
+    heads.mid.set(0, 3, 4, logit(0.75f), 0.0f, 1.0f, 1.0f, 0.5f, 11, 0.9f);  // anchor 36 x 75
+    heads.mid.at(0, 2, 4 * 26 + 3) = logit(std::sqrt(2.0f) / 2.0f);        // 2 x the anchor
+    heads.mid.at(0, 3, 4 * 26 + 3) = logit(0.25f);                         // a quarter of it
+    std::vector<NvDsInferParseObjectInfo> objects = heads.parse(NvDsInferParseCustomScaledYoloV4);
+    check(objects.size() == 1, "scaled yolov4: one box per kept cell");
+    if (objects.size() == 1)
+    {
+        // (3 + 0.75 * 2 - 0.5) * 16 = 64, (4 + 0.5 * 2 - 0.5) * 16 = 72
+        const NvDsInferParseObjectInfo& m = objects[0];
+        check(m.classId == 11 && near(m.detectionConfidence, 0.5f * 0.9f), "scaled yolov4: class");
+        check(near(m.left, 64.0f - 36.0f) && near(m.top, 72.0f - 9.375f)
+              && near(m.width, 72.0f) && near(m.height, 18.75f), "scaled yolov4: box");
+    }
+}
+
+/* Cells are skipped on the objectness logit before any exp; that must not drop a cell the
+ * exact objectness * class probability test keeps, nor keep one it drops. */
+static void testParserYoloV4Threshold()
+{
+    const float kCertain = 30.0f;  // class logit whose logistic is 1 in float
+    for (int scaled = 0; scaled < 2; ++scaled)
+    {
+        YoloV4Heads heads;
+        heads.mid.set(0, 2, 2, 0.0f, 0.0f, 1.0f, 1.0f, 0.3005f, 1, 0.5f);  // just over 0.3
+        heads.mid.at(0, 5 + 1, 2 * 26 + 2) = kCertain;
+        heads.mid.set(0, 8, 8, 0.0f, 0.0f, 1.0f, 1.0f, 0.2995f, 2, 0.5f);  // just under
+        heads.mid.at(0, 5 + 2, 8 * 26 + 8) = kCertain;
+        // past the objectness logit, under the threshold once times the class probability
+        heads.mid.set(0, 14, 14, 0.0f, 0.0f, 1.0f, 1.0f, 0.35f, 3, 0.8f);
+        const std::string name = scaled ? "scaled yolov4 threshold: " : "yolov4 threshold: ";
+        std::vector<NvDsInferParseObjectInfo> objects =
+            heads.parse(scaled ? NvDsInferParseCustomScaledYoloV4 : NvDsInferParseCustomYoloV4);
+        check(objects.size() == 1, name + "only the cell over 0.3 is kept");
+        if (objects.size() == 1)
+            check(objects[0].classId == 1 && near(objects[0].detectionConfidence, 0.3005f),
+                  name + "its class and confidence");
+    }
+}
+
+/* The kernel writes in atomic order, so records are compared after sorting by box and cell */
+static void testKernel()
+{
+    int devices = 0;
+    if (cudaGetDeviceCount(&devices) != cudaSuccess || devices == 0)
+    {
+        std::cout << "no CUDA device, kernel check skipped" << std::endl;
+        return;
+    }
+    const uint g = 26, c = 80, b = 3, batch = 2;
+    std::vector<float> input((uint64_t)batch * b * (5 + c) * g * g);
+    uint32_t state = 1;
+    for (float& v : input)
+    {
+        state = state * 1664525u + 1013904223u;
+        // uniform in [-8, 0): about a quarter of the cells pass, all of them get a slot
+        v = (state >> 8) * (8.0f / (1 << 24)) - 8.0f;
+    }
+    float *dInput = nullptr, *dOutput = nullptr;
+    cudaMalloc(&dInput, input.size() * sizeof(float));
+    cudaMalloc(&dOutput, batch * kYOLOV3_OUTPUT_SIZE * sizeof(float));
+    cudaMemcpy(dInput, input.data(), input.size() * sizeof(float), cudaMemcpyHostToDevice);
+    check(cudaYoloLayerV3(dInput, dOutput, batch, g, c, b, kYOLOV3_OUTPUT_SIZE,
+                          kYOLOV3_OBJECTNESS_THRESH, 0) == cudaSuccess, "kernel: launch");
+    std::vector<float> device(batch * kYOLOV3_OUTPUT_SIZE);
+    cudaMemcpy(device.data(), dOutput, device.size() * sizeof(float), cudaMemcpyDeviceToHost);
+    cudaFree(dInput);
+    cudaFree(dOutput);
+
+    auto order = [](const YoloV3Candidate& l, const YoloV3Candidate& r) {
+        return std::make_tuple(l.box, l.y, l.x) < std::make_tuple(r.box, r.y, r.x);
+    };
+    for (uint n = 0; n < batch; ++n)
+    {
+        std::vector<float> host(kYOLOV3_OUTPUT_SIZE);
+        yoloLayerV3Host(input.data() + (uint64_t)n * b * (5 + c) * g * g, host.data(), g, c, b,
+                        kYOLOV3_OBJECTNESS_THRESH);
+        const float* out = device.data() + n * kYOLOV3_OUTPUT_SIZE;
+        check(std::equal(out, out + kYOLOV3_HEADER_SIZE, host.data()), "kernel: header");
+        const uint count = std::min((uint)host[0], kYOLOV3_MAX_CANDIDATES);
+        if (host[0] > kYOLOV3_MAX_CANDIDATES || out[0] != host[0]) continue;
+        std::vector<YoloV3Candidate> d(count), h(count);
+        std::copy_n(reinterpret_cast<const YoloV3Candidate*>(out + kYOLOV3_HEADER_SIZE), count, d.begin());
+        std::copy_n(candidatesOf(host), count, h.begin());
+        std::sort(d.begin(), d.end(), order);
+        std::sort(h.begin(), h.end(), order);
+        for (uint i = 0; i < count; ++i)
+            check(d[i].box == h[i].box && d[i].classId == h[i].classId && near(d[i].x, h[i].x)
+                  && near(d[i].y, h[i].y) && near(d[i].w, h[i].w, 1e-3f)
+                  && near(d[i].h, h[i].h, 1e-3f) && near(d[i].conf, h[i].conf, 1e-3f),
+                  "kernel: candidate " + std::to_string(i) + " of image " + std::to_string(n));
+    }
+}
+
+int main()
+{
+    testHostReference();
+    testHostOverflow();
+    testParserRawHeads();
+    testParserYoloV4();
+    testParserScaledYoloV4();
+    testParserYoloV4Threshold();
+    testKernel();
+    if (failures)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "yoloV3Output checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,323 @@
+#ifndef YOLOV5_ASYNC_DETECT_H_
+#define YOLOV5_ASYNC_DETECT_H_
+
+// Awaitable detection for services with many requests in flight. A coroutine writes
+// auto boxes = co_await session.detect(frame); and is resumed on an Executor thread
+// once its batch has run, so thousands of requests share a few threads instead of
+// blocking one each in doInference. Needs C++20 coroutines; in older language modes,
+// which the rest of the tree builds with, this header declares nothing.
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <cassert>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "yolo_def.h"
+
+// Threads that resume the coroutines posted to them, oldest first. The destructor
+// runs what is still queued, then joins.
+class Executor
+{
+public:
+    explicit Executor(int threads) {
+        assert(threads >= 1);
+        for (int i = 0; i < threads; ++i) mThreads.emplace_back(&Executor::run, this);
+    }
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mReady.notify_all();
+        for (std::thread& t : mThreads) t.join();
+    }
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.push_back(handle);
+        }
+        mReady.notify_one();
+    }
+
+    // co_await executor.schedule(); continues on one of its threads
+    auto schedule() {
+        struct Awaiter
+        {
+            Executor& executor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    int size() const { return (int)mThreads.size(); }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mReady.wait(lock, [&] { return mStop || !mQueue.empty(); });
+            if (mQueue.empty()) break;
+            std::coroutine_handle<> handle = mQueue.front();
+            mQueue.pop_front();
+            lock.unlock();
+            handle.resume();
+            lock.lock();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mReady;
+    std::deque<std::coroutine_handle<>> mQueue;
+    bool mStop{false};
+    std::vector<std::thread> mThreads;
+};
+
+namespace AsyncDetail
+{
+    template <typename T>
+    struct TaskResult
+    {
+        T value{};
+        std::exception_ptr error;
+        void return_value(T v) { value = std::move(v); }
+        T result() {
+            if (error) std::rethrow_exception(error);
+            return std::move(value);
+        }
+    };
+
+    template <>
+    struct TaskResult<void>
+    {
+        std::exception_ptr error;
+        void return_void() {}
+        void result() {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+}
+
+// Coroutine that starts when it is awaited and resumes its awaiter when it returns.
+// Exceptions reach the awaiter.
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : AsyncDetail::TaskResult<T>
+    {
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Final
+            {
+                bool await_ready() const noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    std::coroutine_handle<> next = handle.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+            return Final{};
+        }
+        void unhandled_exception() { this->error = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (mHandle) mHandle.destroy();
+            mHandle = std::exchange(other.mHandle, nullptr);
+        }
+        return *this;
+    }
+    ~Task() {
+        if (mHandle) mHandle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        mHandle.promise().continuation = awaiter;
+        return mHandle;
+    }
+    T await_resume() { return mHandle.promise().result(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : mHandle(handle) {}
+
+    std::coroutine_handle<promise_type> mHandle;
+};
+
+namespace AsyncDetail
+{
+    // Frame that runs to the end on its own and frees itself
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    inline Detached detach(Task<void> task) { co_await task; }
+}
+
+// Starts task on the calling thread and lets it run to completion on its own, e.g.
+// one per incoming request. An exception escaping it terminates.
+inline void spawn(Task<void> task) { AsyncDetail::detach(std::move(task)); }
+
+// One detect() call: the frame goes in, the boxes come out
+template <typename Frame>
+struct DetectRequest
+{
+    const Frame* frame{nullptr};
+    std::vector<Yolo::Detection> result;
+    std::exception_ptr error;      // set instead of result, rethrown to the awaiter
+    std::coroutine_handle<> waiter;
+};
+
+// Queues detect() calls and hands them to launch() in batches of up to maxBatch,
+// from a poller thread, with at most maxInFlight batches launched and not yet done.
+// Whatever arrives while the batches in flight run forms the next one, so the batch
+// grows with the load without a timer. When launch() reports a batch done, its
+// coroutines are resumed on the executor, never on the poller or a CUDA thread.
+template <typename Frame>
+class DetectSession
+{
+public:
+    typedef DetectRequest<Frame> Request;
+    // Runs a batch: fills in each request's result, then calls done. On the CPU backend
+    // that is before it returns. A TensorRT launch enqueues the copies and the
+    // inference on a stream and calls done from a host function behind them
+    // (cudaLaunchHostFunc), so the poller goes on to the next batch meanwhile. An
+    // exception thrown by launch() before it calls done fails the batch.
+    typedef std::function<void(std::vector<Request*>& batch, std::function<void()> done)> LaunchFn;
+
+    DetectSession(Executor& executor, LaunchFn launch, int maxBatch = 1, int maxInFlight = 1)
+        : mExecutor(executor), mLaunch(std::move(launch)), mMaxBatch(maxBatch), mMaxInFlight(maxInFlight) {
+        assert(maxBatch >= 1 && maxInFlight >= 1);
+        mPoller = std::thread(&DetectSession::poll, this);
+    }
+    // Waits for every queued and launched request.
+    ~DetectSession() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mReady.notify_all();
+        mPoller.join();
+        std::unique_lock<std::mutex> lock(mMutex);
+        mReady.wait(lock, [&] { return mInFlight == 0; });
+    }
+    DetectSession(const DetectSession&) = delete;
+    DetectSession& operator=(const DetectSession&) = delete;
+
+    // co_await session.detect(frame) gives the std::vector<Yolo::Detection> of frame,
+    // which must stay alive until then. The request lives in the awaiting frame.
+    auto detect(const Frame& frame) {
+        struct Awaiter
+        {
+            DetectSession& session;
+            Request request;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                request.waiter = handle;
+                session.submit(&request);
+            }
+            std::vector<Yolo::Detection> await_resume() {
+                if (request.error) std::rethrow_exception(request.error);
+                return std::move(request.result);
+            }
+        };
+        Awaiter awaiter{*this, Request()};
+        awaiter.request.frame = &frame;
+        return awaiter;
+    }
+
+    uint64_t requests() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mRequests;
+    }
+    uint64_t batches() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mBatches;
+    }
+
+private:
+    void submit(Request* request) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.push_back(request);
+        }
+        mReady.notify_all();
+    }
+
+    void poll() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mReady.wait(lock, [&] { return (mStop && mPending.empty()) || (!mPending.empty() && mInFlight < mMaxInFlight); });
+            if (mPending.empty()) break;
+            auto batch = std::make_shared<std::vector<Request*>>();
+            while ((int)batch->size() < mMaxBatch && !mPending.empty()) {
+                batch->push_back(mPending.front());
+                mPending.pop_front();
+            }
+            ++mInFlight;
+            ++mBatches;
+            mRequests += batch->size();
+            lock.unlock();
+            try {
+                mLaunch(*batch, [this, batch] { complete(*batch); });
+            } catch (...) {
+                for (Request* request : *batch) request->error = std::current_exception();
+                complete(*batch);
+            }
+            lock.lock();
+        }
+    }
+
+    void complete(std::vector<Request*>& batch) {
+        // a resumed coroutine may free its request, so nothing touches them after this
+        for (Request* request : batch) mExecutor.post(request->waiter);
+        // notified under the lock, the destructor may return as soon as it sees the count
+        std::lock_guard<std::mutex> lock(mMutex);
+        --mInFlight;
+        mReady.notify_all();
+    }
+
+    Executor& mExecutor;
+    LaunchFn mLaunch;
+    int mMaxBatch;
+    int mMaxInFlight;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mReady;
+    std::deque<Request*> mPending;
+    int mInFlight{0};
+    bool mStop{false};
+    uint64_t mRequests{0}, mBatches{0};
+    std::thread mPoller;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+import json
+import sys
+
+# Compares two yolo_bench --json results by benchmark key and flags the ones whose
+# median ns/op grew by more than the threshold. Exits with 1 on any regression, so
+# it can gate a build; benchmarks only in one of the files are listed, not failed.
+# usage: python bench_compare.py baseline.json current.json [threshold, 0.10 = 10%]
+if len(sys.argv) not in (3, 4):
+    print('usage: python bench_compare.py baseline.json current.json [threshold]')
+    sys.exit(2)
+threshold = float(sys.argv[3]) if len(sys.argv) == 4 else 0.10
+
+def load(path):
+    with open(path) as f:
+        return {b['key']: b for b in json.load(f)['benchmarks']}
+
+baseline = load(sys.argv[1])
+current = load(sys.argv[2])
+
+regressions = 0
+print('{:<56} {:>14} {:>14} {:>8}'.format('benchmark', 'baseline ns', 'current ns', 'change'))
+for key, cur in current.items():
+    base = baseline.get(key)
+    if base is None:
+        print('{:<56} {:>14} {:>14.1f} {:>8}'.format(key, '-', cur['ns_per_op'], 'new'))
+        continue
+    change = cur['ns_per_op'] / base['ns_per_op'] - 1.0
+    flag = ''
+    # the fastest repetition must have slowed down too, so one noisy run does not fail
+    if change > threshold and cur['ns_per_op_min'] > base['ns_per_op_min'] * (1.0 + threshold):
+        flag = '  REGRESSION'
+        regressions += 1
+    print('{:<56} {:>14.1f} {:>14.1f} {:>+7.1f}%{}'.format(
+        key, base['ns_per_op'], cur['ns_per_op'], change * 100.0, flag))
+for key in baseline:
+    if key not in current:
+        print('{:<56} {:>14.1f} {:>14} {:>8}'.format(key, baseline[key]['ns_per_op'], '-', 'missing'))
+
+print('{} regression(s) over {:.0f}%'.format(regressions, threshold * 100.0))
+sys.exit(1 if regressions else 0)
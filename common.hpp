@@ -1,6 +1,7 @@
 #ifndef YOLOV5_COMMON_H_
 #define YOLOV5_COMMON_H_
 
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <sstream>
@@ -24,44 +25,93 @@
 
 using namespace nvinfer1;
 
-cv::Mat preprocess_img(cv::Mat& img) {
+cv::Mat preprocess_img(cv::Mat& img, int input_w, int input_h) {
     int w, h, x, y;
-    float r_w = Yolo::INPUT_W / (img.cols*1.0);
-    float r_h = Yolo::INPUT_H / (img.rows*1.0);
+    float r_w = input_w / (img.cols*1.0);
+    float r_h = input_h / (img.rows*1.0);
     if (r_h > r_w) {
-        w = Yolo::INPUT_W;
+        w = input_w;
         h = r_w * img.rows;
         x = 0;
-        y = (Yolo::INPUT_H - h) / 2;
+        y = (input_h - h) / 2;
     } else {
         w = r_h* img.cols;
-        h = Yolo::INPUT_H;
-        x = (Yolo::INPUT_W - w) / 2;
+        h = input_h;
+        x = (input_w - w) / 2;
         y = 0;
     }
     cv::Mat re(h, w, CV_8UC3);
     cv::resize(img, re, re.size(), 0, 0, cv::INTER_CUBIC);
-    cv::Mat out(Yolo::INPUT_H, Yolo::INPUT_W, CV_8UC3, cv::Scalar(128, 128, 128));
+    cv::Mat out(input_h, input_w, CV_8UC3, cv::Scalar(128, 128, 128));
     re.copyTo(out(cv::Rect(x, y, re.cols, re.rows)));
     return out;
 }
 
-cv::Rect get_rect(cv::Mat& img, float bbox[4]) {
+cv::Mat preprocess_img(cv::Mat& img) {
+    return preprocess_img(img, Yolo::INPUT_W, Yolo::INPUT_H);
+}
+
+// Smallest multiple of 32 rectangle holding img scaled so its long side is max_side,
+// i.e. a letterbox with less than 32 pixels of padding.
+void letterbox_size(const cv::Mat& img, int max_side, int& input_w, int& input_h) {
+    float r = max_side / (std::max(img.cols, img.rows) * 1.0f);
+    input_w = ((int)std::ceil(img.cols * r) + 31) / 32 * 32;
+    input_h = ((int)std::ceil(img.rows * r) + 31) / 32 * 32;
+}
+
+// Pixels of img inside an input_w x input_h letterbox, as preprocess_img() scales it
+long long letterbox_content(const cv::Mat& img, int input_w, int input_h) {
+    float r_w = input_w / (img.cols * 1.0);
+    float r_h = input_h / (img.rows * 1.0);
+    if (r_h > r_w) return (long long)input_w * (int)(r_w * img.rows);
+    return (long long)(int)(r_h * img.cols) * input_h;
+}
+
+// Input shapes with a long side of max_side for the aspect ratios offline image sets
+// mix: square, 4:3, 3:2 and 16:9, landscape and portrait. Each is the letterbox_size()
+// of its ratio, so an image of one of them is padded by less than 32 pixels.
+std::vector<cv::Size> bucket_shapes(int max_side) {
+    std::vector<cv::Size> shapes;
+    const float aspects[] = {1.0f, 4.0f / 3.0f, 3.0f / 2.0f, 16.0f / 9.0f};
+    for (float aspect : aspects) {
+        int side = ((int)std::ceil(max_side / aspect) + 31) / 32 * 32;
+        shapes.push_back(cv::Size(max_side, side));
+        if (side != max_side) shapes.push_back(cv::Size(side, max_side));
+    }
+    return shapes;
+}
+
+// Of shapes, the one img keeps the most pixels in when letterboxed, and of those the
+// smallest: the least padding without scaling img down further.
+cv::Size bucket_shape(const cv::Mat& img, const std::vector<cv::Size>& shapes) {
+    cv::Size best;
+    long long best_content = -1;
+    for (const cv::Size& shape : shapes) {
+        long long content = letterbox_content(img, shape.width, shape.height);
+        if (content > best_content || (content == best_content && shape.area() < best.area())) {
+            best = shape;
+            best_content = content;
+        }
+    }
+    return best;
+}
+
+cv::Rect get_rect(cv::Mat& img, float bbox[4], int input_w, int input_h) {
     int l, r, t, b;
-    float r_w = Yolo::INPUT_W / (img.cols * 1.0);
-    float r_h = Yolo::INPUT_H / (img.rows * 1.0);
+    float r_w = input_w / (img.cols * 1.0);
+    float r_h = input_h / (img.rows * 1.0);
     if (r_h > r_w) {
         l = bbox[0] - bbox[2]/2.f;
         r = bbox[0] + bbox[2]/2.f;
-        t = bbox[1] - bbox[3]/2.f - (Yolo::INPUT_H - r_w * img.rows) / 2;
-        b = bbox[1] + bbox[3]/2.f - (Yolo::INPUT_H - r_w * img.rows) / 2;
+        t = bbox[1] - bbox[3]/2.f - (input_h - r_w * img.rows) / 2;
+        b = bbox[1] + bbox[3]/2.f - (input_h - r_w * img.rows) / 2;
         l = l / r_w;
         r = r / r_w;
         t = t / r_w;
         b = b / r_w;
     } else {
-        l = bbox[0] - bbox[2]/2.f - (Yolo::INPUT_W - r_h * img.cols) / 2;
-        r = bbox[0] + bbox[2]/2.f - (Yolo::INPUT_W - r_h * img.cols) / 2;
+        l = bbox[0] - bbox[2]/2.f - (input_w - r_h * img.cols) / 2;
+        r = bbox[0] + bbox[2]/2.f - (input_w - r_h * img.cols) / 2;
         t = bbox[1] - bbox[3]/2.f;
         b = bbox[1] + bbox[3]/2.f;
         l = l / r_h;
@@ -72,6 +122,84 @@ cv::Rect get_rect(cv::Mat& img, float bbox[4]) {
     return cv::Rect(l, t, r-l, b-t);
 }
 
+// Region of interest of a source: the polygon, in frame pixels, whose detections are
+// kept. Frames are cropped to its bounding rectangle before the letterbox, so the
+// region gets all of the network input instead of its share of the frame.
+struct Roi {
+    std::string prefix;  // frames whose file name starts with it, "*" for any
+    std::vector<cv::Point2f> polygon;
+};
+
+// One ROI per line: a file name prefix and at least 3 "x,y" vertices, e.g.
+//   cam3_ 120,400 1800,380 1900,1080 40,1080
+// '#' starts a comment. Returns false if a line does not parse.
+bool load_rois(const std::string& file, std::vector<Roi>& rois) {
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        Roi roi;
+        if (!(ss >> roi.prefix)) continue;
+        std::string vertex;
+        while (ss >> vertex) {
+            float x, y;
+            if (sscanf(vertex.c_str(), "%f,%f", &x, &y) != 2) return false;
+            roi.polygon.push_back(cv::Point2f(x, y));
+        }
+        if (roi.polygon.size() < 3) return false;
+        rois.push_back(roi);
+    }
+    return true;
+}
+
+// Longest prefix match, nullptr if no ROI applies to the frame.
+const Roi* find_roi(const std::vector<Roi>& rois, const std::string& file_name) {
+    const Roi* best = nullptr;
+    size_t best_len = 0;
+    for (const Roi& roi : rois) {
+        size_t len = roi.prefix == "*" ? 0 : roi.prefix.size();
+        if (len && file_name.compare(0, len, roi.prefix) != 0) continue;
+        if (!best || len > best_len) {
+            best = &roi;
+            best_len = len;
+        }
+    }
+    return best;
+}
+
+// Bounding rectangle of the polygon clipped to the frame: the crop that is letterboxed.
+cv::Rect roi_rect(const cv::Mat& img, const Roi* roi) {
+    cv::Rect frame(0, 0, img.cols, img.rows);
+    if (!roi) return frame;
+    cv::Rect r = cv::boundingRect(roi->polygon) & frame;
+    return r.area() > 0 ? r : frame;
+}
+
+// The polygon in network input pixels, through the same letterbox preprocess_img
+// applies to the crop, so nms() can test the decoded box centres against it.
+std::vector<cv::Point2f> roi_to_input(const Roi* roi, const cv::Rect& crop, int input_w, int input_h) {
+    std::vector<cv::Point2f> out;
+    if (!roi) return out;
+    float r_w = input_w / (crop.width * 1.0);
+    float r_h = input_h / (crop.height * 1.0);
+    float r = std::min(r_w, r_h);
+    int x = 0, y = 0;
+    if (r_h > r_w) {
+        y = (input_h - (int)(r_w * crop.height)) / 2;
+    } else {
+        x = (input_w - (int)(r_h * crop.width)) / 2;
+    }
+    for (const cv::Point2f& p : roi->polygon) {
+        out.push_back(cv::Point2f((p.x - crop.x) * r + x, (p.y - crop.y) * r + y));
+    }
+    return out;
+}
+
+cv::Rect get_rect(cv::Mat& img, float bbox[4]) {
+    return get_rect(img, bbox, Yolo::INPUT_W, Yolo::INPUT_H);
+}
+
 float iou(float lbox[4], float rbox[4]) {
     float interBox[] = {
         std::max(lbox[0] - lbox[2]/2.f , rbox[0] - rbox[2]/2.f), //left
@@ -87,29 +215,49 @@ float iou(float lbox[4], float rbox[4]) {
     return interBoxS/(lbox[2]*lbox[3] + rbox[2]*rbox[3] -interBoxS);
 }
 
-bool cmp(const Yolo::Detection& a, const Yolo::Detection& b) {
+// Scalar on every ISA, NEON included: nms() only compares the boxes of one class
+// that are left after decode, one pair at a time.
+float iou(const Yolo::PackedDetection& l, const Yolo::PackedDetection& r) {
+    float lbox[Yolo::LOCATIONS], rbox[Yolo::LOCATIONS];
+    for (int i = 0; i < Yolo::LOCATIONS; ++i) {
+        lbox[i] = Yolo::halfToFloat(l.bbox[i]);
+        rbox[i] = Yolo::halfToFloat(r.bbox[i]);
+    }
+    return iou(lbox, rbox);
+}
+
+// conf is never negative, so its half bits sort like the value
+bool cmp(const Yolo::PackedDetection& a, const Yolo::PackedDetection& b) {
     return a.conf > b.conf;
 }
 
-void nms(std::vector<Yolo::Detection>& res, float *output, float conf_thresh, float nms_thresh = 0.5) {
-    int det_size = sizeof(Yolo::Detection) / sizeof(float);
-    std::map<float, std::vector<Yolo::Detection>> m;
+// output: one image of the "prob" blob, [count, PackedDetection x MAX_OUTPUT_BBOX_COUNT].
+// The candidates stay packed through the sort and suppression; only the kept boxes
+// are unpacked into res. Legacy float blobs go through Yolo::packLegacyOutput first.
+// roi, in network input pixels (see roi_to_input), drops the records whose centre is
+// outside it before they take part in NMS.
+void nms(std::vector<Yolo::Detection>& res, float *output, float conf_thresh, float nms_thresh = 0.5,
+         const std::vector<cv::Point2f>* roi = nullptr) {
+    const Yolo::PackedDetection* records = reinterpret_cast<const Yolo::PackedDetection*>(output + 1);
+    const uint16_t conf_bits = Yolo::floatToHalf(conf_thresh);
+    std::map<int, std::vector<Yolo::PackedDetection>> m;
     for (int i = 0; i < output[0] && i < Yolo::MAX_OUTPUT_BBOX_COUNT; i++) {
-        if (output[1 + det_size * i + 4] <= conf_thresh) continue;
-        Yolo::Detection det;
-        memcpy(&det, &output[1 + det_size * i], det_size * sizeof(float));
-        if (m.count(det.class_id) == 0) m.emplace(det.class_id, std::vector<Yolo::Detection>());
-        m[det.class_id].push_back(det);
+        if (records[i].conf <= conf_bits) continue;
+        if (roi && !roi->empty()) {
+            cv::Point2f centre(Yolo::halfToFloat(records[i].bbox[0]), Yolo::halfToFloat(records[i].bbox[1]));
+            if (cv::pointPolygonTest(*roi, centre, false) < 0) continue;
+        }
+        m[records[i].class_id].push_back(records[i]);
     }
     for (auto it = m.begin(); it != m.end(); it++) {
-        //std::cout << it->second[0].class_id << " --- " << std::endl;
+        //std::cout << it->first << " --- " << std::endl;
         auto& dets = it->second;
         std::sort(dets.begin(), dets.end(), cmp);
         for (size_t m = 0; m < dets.size(); ++m) {
             auto& item = dets[m];
-            res.push_back(item);
+            res.push_back(Yolo::unpackDetection(item));
             for (size_t n = m + 1; n < dets.size(); ++n) {
-                if (iou(item.bbox, dets[n].bbox) > nms_thresh) {
+                if (iou(item, dets[n]) > nms_thresh) {
                     dets.erase(dets.begin()+n);
                     --n;
                 }
@@ -210,6 +358,26 @@ ILayer* convBlock(INetworkDefinition *network, std::map<std::string, Weights>& w
     return hs;
 }
 
+// Lets the engine take raw BGR pixel values in [0, 255] instead of RGB in [0, 1]:
+// scales the Focus conv kernel by 1/255 and swaps the R and B channel of each of
+// the 4 slices, so the uint8 -> float conversion is the only preprocessing left.
+void foldInputNormalization(std::map<std::string, Weights>& weightMap, std::string lname, int inch, int ksize) {
+    Weights& wt = weightMap[lname + ".conv.weight"];
+    float* w = reinterpret_cast<float*>(const_cast<void*>(wt.values));
+    const int kk = ksize * ksize;
+    const int slices = inch * 4;
+    const int outch = wt.count / (slices * kk);
+    std::vector<float> k(slices * kk);
+    for (int oc = 0; oc < outch; oc++) {
+        float* cur = w + oc * slices * kk;
+        for (int ic = 0; ic < slices; ic++) {
+            int rgb = ic / inch * inch + (inch - 1 - ic % inch);
+            for (int t = 0; t < kk; t++) k[ic * kk + t] = cur[rgb * kk + t] / 255.f;
+        }
+        memcpy(cur, k.data(), k.size() * sizeof(float));
+    }
+}
+
 ILayer* focus(INetworkDefinition *network, std::map<std::string, Weights>& weightMap, ITensor& input, int inch, int outch, int ksize, std::string lname) {
     ISliceLayer *s1 = network->addSlice(input, Dims3{0, 0, 0}, Dims3{inch, Yolo::INPUT_H / 2, Yolo::INPUT_W / 2}, Dims3{1, 2, 2});
     ISliceLayer *s2 = network->addSlice(input, Dims3{0, 1, 0}, Dims3{inch, Yolo::INPUT_H / 2, Yolo::INPUT_W / 2}, Dims3{1, 2, 2});
@@ -0,0 +1,727 @@
+#include "cpu_backend.h"
+#include "cpu_darknet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace Cpu
+{
+    // conv kernels are unfolded in bands of output pixels so the im2col buffer stays cache sized
+    static const size_t COL_BUDGET = 1 << 18;  // floats
+    static const size_t ARENA_ALIGN = 16;      // floats
+    static const int INPUT_STRIDE = 32;        // the deepest head downsamples 5 times
+
+    static int colBand(int K, int N) {
+        int band = (int)std::max<size_t>(64, COL_BUDGET / K);
+        return std::min(band, N);
+    }
+
+    int Graph::input() {
+        return add(OpType::kINPUT, "data", {}, 3);
+    }
+
+    int Graph::add(OpType type, const std::string& name, const std::vector<int>& inputs, int c, int ksize,
+                   int stride) {
+        Node node;
+        node.name = name;
+        node.type = type;
+        node.inputs = inputs;
+        node.c = c;
+        node.ksize = ksize;
+        node.stride = stride;
+        nodes.push_back(node);
+        return (int)nodes.size() - 1;
+    }
+
+    int Graph::conv(int input, const ConvDesc& desc) {
+        convs.push_back(desc);
+        convs.back().inch = nodes[input].c;
+        int id = add(OpType::kCONV, desc.name, {input}, desc.outch);
+        nodes[id].conv = (int)convs.size() - 1;
+        return id;
+    }
+
+    Plan makePlan(const Graph& graph, int inputH, int inputW) {
+        if (inputH <= 0 || inputW <= 0 || inputH % INPUT_STRIDE || inputW % INPUT_STRIDE) {
+            std::cerr << "Input size " << inputW << "x" << inputH << " is not a multiple of " << INPUT_STRIDE << std::endl;
+            abort();
+        }
+        Plan plan;
+        plan.inputH = inputH;
+        plan.inputW = inputW;
+        plan.shapes.resize(graph.nodes.size());
+        plan.offsets.resize(graph.nodes.size());
+        plan.cost.resize(graph.nodes.size());
+        for (size_t i = 0; i < graph.nodes.size(); ++i) {
+            const Node& node = graph.nodes[i];
+            Shape s{node.c, 0, 0};
+            const Shape* in = node.inputs.empty() ? nullptr : &plan.shapes[node.inputs[0]];
+            switch (node.type) {
+                case OpType::kINPUT:
+                    s.h = inputH;
+                    s.w = inputW;
+                    break;
+                case OpType::kFOCUS:
+                    s.h = in->h / 2;
+                    s.w = in->w / 2;
+                    break;
+                case OpType::kCONV: {
+                    const ConvDesc& d = graph.convs[node.conv];
+                    s.h = (in->h + 2 * d.pad - d.ksize) / d.stride + 1;
+                    s.w = (in->w + 2 * d.pad - d.ksize) / d.stride + 1;
+                    if (d.ksize > 1 || d.stride > 1) {
+                        int K = d.inch * d.ksize * d.ksize;
+                        plan.colSize = std::max(plan.colSize, (size_t)K * colBand(K, s.h * s.w));
+                    }
+                    break;
+                }
+                case OpType::kUPSAMPLE:
+                    s.h = in->h * 2;
+                    s.w = in->w * 2;
+                    break;
+                case OpType::kMAXPOOL:
+                    s.h = (in->h + node.stride - 1) / node.stride;
+                    s.w = (in->w + node.stride - 1) / node.stride;
+                    break;
+                case OpType::kREORG:
+                    assert(in->h % node.stride == 0 && in->w % node.stride == 0);
+                    s.h = in->h / node.stride;
+                    s.w = in->w / node.stride;
+                    break;
+                case OpType::kCONCAT:
+                case OpType::kADD:
+                    s.h = in->h;
+                    s.w = in->w;
+                    for (int j : node.inputs) {
+                        assert(plan.shapes[j].h == s.h && plan.shapes[j].w == s.w);
+                    }
+                    break;
+            }
+            plan.shapes[i] = s;
+            if (node.type == OpType::kCONV) {
+                const ConvDesc& d = graph.convs[node.conv];
+                plan.cost[i] = (double)s.volume() * d.inch * d.ksize * d.ksize;
+            } else {
+                plan.cost[i] = (double)s.volume() * std::max(node.ksize, 1);
+            }
+            plan.offsets[i] = plan.arenaSize;
+            plan.arenaSize += (s.volume() + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+        }
+        return plan;
+    }
+
+    const char* opTypeName(OpType type) {
+        switch (type) {
+            case OpType::kINPUT: return "input";
+            case OpType::kFOCUS: return "focus";
+            case OpType::kCONV: return "conv";
+            case OpType::kMAXPOOL: return "maxpool";
+            case OpType::kUPSAMPLE: return "upsample";
+            case OpType::kCONCAT: return "concat";
+            case OpType::kADD: return "add";
+            case OpType::kREORG: return "reorg";
+        }
+        return "?";
+    }
+
+    CostReport costReport(const Graph& graph, int inputH, int inputW, Precision precision) {
+        const Plan plan = makePlan(graph, inputH, inputW);
+        CostReport r;
+        r.inputH = inputH;
+        r.inputW = inputW;
+        r.precision = precision;
+        r.layers.resize(graph.nodes.size());
+
+        // outputs freed after each node ran, by their last reader; heads live to the end
+        const size_t n = graph.nodes.size();
+        std::vector<size_t> lastUse(n);
+        for (size_t i = 0; i < n; ++i) {
+            lastUse[i] = i;
+            for (int j : graph.nodes[i].inputs) lastUse[j] = i;
+        }
+        for (int out : graph.outputs) lastUse[out] = n;
+        std::vector<std::vector<int>> freed(n + 1);
+        for (size_t i = 0; i < n; ++i) freed[lastUse[i]].push_back((int)i);
+
+        size_t live = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const Node& node = graph.nodes[i];
+            LayerCost& l = r.layers[i];
+            l.shape = plan.shapes[i];
+            l.activationBytes = l.shape.volume() * sizeof(float);
+            if (node.type == OpType::kCONV) {
+                const ConvDesc& d = graph.convs[node.conv];
+                const size_t weights = (size_t)d.outch * d.inch * d.ksize * d.ksize;
+                l.macs = (double)l.shape.volume() * d.inch * d.ksize * d.ksize;
+                l.params = weights + d.outch;
+                l.paramBytes = PackedMatrix::sizeFor(weights, precision) + d.outch * sizeof(float);
+            }
+            r.macs += l.macs;
+            r.params += l.params;
+            r.paramBytes += l.paramBytes;
+            r.activationBytes += l.activationBytes;
+
+            // the output is written while the inputs are still read
+            live += l.activationBytes;
+            r.peakLiveBytes = std::max(r.peakLiveBytes, live);
+            for (int j : freed[i]) live -= r.layers[j].activationBytes;
+        }
+        return r;
+    }
+
+    std::string formatCostReport(const Graph& graph, const CostReport& r) {
+        std::ostringstream out;
+        char line[256];
+        snprintf(line, sizeof(line), "%-4s %-24s %-8s %16s %10s %10s %10s %7s\n", "id", "layer", "op", "output",
+                 "MMACs", "params", "param KB", "act KB");
+        out << line;
+        for (size_t i = 0; i < graph.nodes.size(); ++i) {
+            const Node& node = graph.nodes[i];
+            const LayerCost& l = r.layers[i];
+            char shape[32];
+            snprintf(shape, sizeof(shape), "%dx%dx%d", l.shape.c, l.shape.h, l.shape.w);
+            snprintf(line, sizeof(line), "%-4d %-24s %-8s %16s %10.1f %10zu %10.1f %7zu\n", (int)i,
+                     node.name.c_str(), opTypeName(node.type), shape, l.macs / 1e6, l.params, l.paramBytes / 1024.0,
+                     l.activationBytes >> 10);
+            out << line;
+        }
+        out << formatCostTotals(r) << "\n";
+        return out.str();
+    }
+
+    std::string formatCostTotals(const CostReport& r) {
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "%dx%d %s: %.2f GMACs (%.2f GFLOPs), %.2fM params in %.1f MB, activations %.1f MB, %.1f MB peak live",
+                 r.inputH, r.inputW, precisionName(r.precision), r.macs / 1e9, 2 * r.macs / 1e9, r.params / 1e6,
+                 r.paramBytes / 1048576.0, r.activationBytes / 1048576.0, r.peakLiveBytes / 1048576.0);
+        return line;
+    }
+
+    bool getModelSpec(char net, ModelSpec& spec) {
+        switch (net) {
+            case 's': spec = ModelSpec{"yolov5s", 0.33f, 0.50f, Yolo::CLASS_NUM}; return true;
+            case 'm': spec = ModelSpec{"yolov5m", 0.67f, 0.75f, Yolo::CLASS_NUM}; return true;
+            case 'l': spec = ModelSpec{"yolov5l", 1.00f, 1.00f, Yolo::CLASS_NUM}; return true;
+            case 'x': spec = ModelSpec{"yolov5x", 1.33f, 1.25f, Yolo::CLASS_NUM}; return true;
+            default: return false;
+        }
+    }
+
+    // The builders below mirror convBlock/focus/bottleneck/bottleneckCSP/SPP in common.hpp;
+    // bottleneckCSP leaves out c1, which it does not need.
+
+    static int convBlock(Graph& g, int input, int outch, int ksize, int s, const std::string& lname) {
+        ConvDesc d;
+        d.name = lname;
+        d.weight = lname + ".conv.weight";
+        d.bn = lname + ".bn";
+        d.bnEps = 1e-3f;
+        d.outch = outch;
+        d.ksize = ksize;
+        d.stride = s;
+        d.pad = ksize / 2;
+        d.act = Activation::kHARDSWISH;
+        return g.conv(input, d);
+    }
+
+    static int focus(Graph& g, int input, int inch, int outch, int ksize, const std::string& lname) {
+        int slice = g.add(OpType::kFOCUS, lname + ".slice", {input}, inch * 4);
+        return convBlock(g, slice, outch, ksize, 1, lname + ".conv");
+    }
+
+    static int bottleneck(Graph& g, int input, int c1, int c2, bool shortcut, float e, const std::string& lname) {
+        int cv1 = convBlock(g, input, (int)((float)c2 * e), 1, 1, lname + ".cv1");
+        int cv2 = convBlock(g, cv1, c2, 3, 1, lname + ".cv2");
+        if (shortcut && c1 == c2) {
+            return g.add(OpType::kADD, lname, {input, cv2}, c2);
+        }
+        return cv2;
+    }
+
+    static int bottleneckCSP(Graph& g, int input, int c2, int n, bool shortcut, float e, const std::string& lname) {
+        int c_ = (int)((float)c2 * e);
+        int cv1 = convBlock(g, input, c_, 1, 1, lname + ".cv1");
+
+        // the bn + leaky after the concat is per channel, so it is folded into cv3 and cv2
+        ConvDesc d;
+        d.bn = lname + ".bn";
+        d.bnEps = 1e-4f;
+        d.outch = c_;
+        d.act = Activation::kLEAKY;
+
+        d.name = lname + ".cv2";
+        d.weight = lname + ".cv2.weight";
+        d.bnOffset = c_;
+        int cv2 = g.conv(input, d);
+
+        int y1 = cv1;
+        for (int i = 0; i < n; i++) {
+            y1 = bottleneck(g, y1, c_, c_, shortcut, 1.0, lname + ".m." + std::to_string(i));
+        }
+        d.name = lname + ".cv3";
+        d.weight = lname + ".cv3.weight";
+        d.bnOffset = 0;
+        int cv3 = g.conv(y1, d);
+
+        int cat = g.add(OpType::kCONCAT, lname + ".cat", {cv3, cv2}, 2 * c_);
+        return convBlock(g, cat, c2, 1, 1, lname + ".cv4");
+    }
+
+    static int SPP(Graph& g, int input, int c1, int c2, int k1, int k2, int k3, const std::string& lname) {
+        int c_ = c1 / 2;
+        int cv1 = convBlock(g, input, c_, 1, 1, lname + ".cv1");
+        int pool1 = g.add(OpType::kMAXPOOL, lname + ".m.0", {cv1}, c_, k1);
+        int pool2 = g.add(OpType::kMAXPOOL, lname + ".m.1", {cv1}, c_, k2);
+        int pool3 = g.add(OpType::kMAXPOOL, lname + ".m.2", {cv1}, c_, k3);
+        int cat = g.add(OpType::kCONCAT, lname + ".cat", {cv1, pool1, pool2, pool3}, 4 * c_);
+        return convBlock(g, cat, c2, 1, 1, lname + ".cv2");
+    }
+
+    static int detect(Graph& g, int input, int classes, int i) {
+        ConvDesc d;
+        d.name = "model.24.m." + std::to_string(i);
+        d.weight = d.name + ".weight";
+        d.bias = d.name + ".bias";
+        d.outch = Yolo::CHECK_COUNT * (classes + 5);
+        return g.conv(input, d);
+    }
+
+    Graph buildYolov5(const ModelSpec& spec) {
+        auto gw = [&](int c) { return (int)std::ceil(c * spec.width / 8) * 8; };
+        auto gd = [&](int n) { return std::max((int)std::round(n * spec.depth), 1); };
+        Graph g;
+        int data = g.input();
+
+        // yolov5 backbone
+        int focus0 = focus(g, data, 3, gw(64), 3, "model.0");
+        int conv1 = convBlock(g, focus0, gw(128), 3, 2, "model.1");
+        int csp2 = bottleneckCSP(g, conv1, gw(128), gd(3), true, 0.5, "model.2");
+        int conv3 = convBlock(g, csp2, gw(256), 3, 2, "model.3");
+        int csp4 = bottleneckCSP(g, conv3, gw(256), gd(9), true, 0.5, "model.4");
+        int conv5 = convBlock(g, csp4, gw(512), 3, 2, "model.5");
+        int csp6 = bottleneckCSP(g, conv5, gw(512), gd(9), true, 0.5, "model.6");
+        int conv7 = convBlock(g, csp6, gw(1024), 3, 2, "model.7");
+        int spp8 = SPP(g, conv7, gw(1024), gw(1024), 5, 9, 13, "model.8");
+
+        // yolov5 head
+        int csp9 = bottleneckCSP(g, spp8, gw(1024), gd(3), false, 0.5, "model.9");
+        int conv10 = convBlock(g, csp9, gw(512), 1, 1, "model.10");
+        int up11 = g.add(OpType::kUPSAMPLE, "model.11", {conv10}, gw(512));
+        int cat12 = g.add(OpType::kCONCAT, "model.12", {up11, csp6}, gw(512) * 2);
+        int csp13 = bottleneckCSP(g, cat12, gw(512), gd(3), false, 0.5, "model.13");
+        int conv14 = convBlock(g, csp13, gw(256), 1, 1, "model.14");
+        int up15 = g.add(OpType::kUPSAMPLE, "model.15", {conv14}, gw(256));
+        int cat16 = g.add(OpType::kCONCAT, "model.16", {up15, csp4}, gw(256) * 2);
+        int csp17 = bottleneckCSP(g, cat16, gw(256), gd(3), false, 0.5, "model.17");
+        int det0 = detect(g, csp17, spec.classes, 0);
+
+        int conv18 = convBlock(g, csp17, gw(256), 3, 2, "model.18");
+        int cat19 = g.add(OpType::kCONCAT, "model.19", {conv18, conv14}, gw(256) * 2);
+        int csp20 = bottleneckCSP(g, cat19, gw(512), gd(3), false, 0.5, "model.20");
+        int det1 = detect(g, csp20, spec.classes, 1);
+
+        int conv21 = convBlock(g, csp20, gw(512), 3, 2, "model.21");
+        int cat22 = g.add(OpType::kCONCAT, "model.22", {conv21, conv10}, gw(512) * 2);
+        int csp23 = bottleneckCSP(g, cat22, gw(1024), gd(3), false, 0.5, "model.23");
+        int det2 = detect(g, csp23, spec.classes, 2);
+
+        g.outputs = {det2, det1, det0};
+        for (const Yolo::YoloKernel& k : {Yolo::yolo1, Yolo::yolo2, Yolo::yolo3}) {
+            DetectHead head;
+            head.type = HeadType::kYOLOV5;
+            head.classes = spec.classes;
+            head.numBBoxes = Yolo::CHECK_COUNT;
+            head.anchors.assign(k.anchors, k.anchors + 2 * Yolo::CHECK_COUNT);
+            g.heads.push_back(head);
+        }
+        g.inputH = Yolo::INPUT_H;
+        g.inputW = Yolo::INPUT_W;
+        return g;
+    }
+
+    Network::Network(const ModelSpec& spec, const std::string& wtsFile, const NetworkOptions& options)
+        : Network(spec, buildYolov5(spec), wtsFile, [&] { return loadWeightMap(wtsFile); }, options) {}
+
+    static Graph loadDarknetGraph(const std::string& cfgFile) {
+        Darknet::Blocks blocks = Darknet::parseConfigFile(cfgFile);
+        if (blocks.empty()) {
+            std::cerr << "Unable to read darknet cfg " << cfgFile << std::endl;
+            abort();
+        }
+        return buildDarknet(blocks);
+    }
+
+    // "../yolov3-tiny.cfg" -> "yolov3-tiny", names the weight cache entry
+    static std::string modelName(const std::string& path) {
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        return name.substr(0, name.find_last_of('.'));
+    }
+
+    Network::Network(const std::string& cfgFile, const std::string& weightsFile, const NetworkOptions& options)
+        : Network(ModelSpec{modelName(cfgFile), 0.0f, 0.0f, 0}, loadDarknetGraph(cfgFile), weightsFile,
+                  [&] { return loadDarknetWeights(weightsFile, mGraph); }, options) {}
+
+    // Packed weights of the live Networks in the process, by cache entry name. The
+    // entry expires with the last Network holding them.
+    struct SharedWeights
+    {
+        std::mutex mutex;
+        std::map<std::string, std::weak_ptr<const PackedModel>> models;
+    };
+
+    static SharedWeights& sharedWeights() {
+        static SharedWeights shared;
+        return shared;
+    }
+
+    Network::Network(const ModelSpec& spec, Graph graph, const std::string& weightsFile,
+                     const std::function<WeightMap()>& loadWeights, const NetworkOptions& options)
+        : mSpec(spec), mGraph(std::move(graph)), mPrecision(options.precision),
+          mArena(options.hugePages), mCol(options.hugePages) {
+        const uint64_t key = weightCacheKey(weightsFile, mGraph, mPrecision);
+        const std::string entry = weightCachePath("", spec.name, mPrecision, key);
+        SharedWeights& shared = sharedWeights();
+        // held while packing, so instances created at once wait for the first one's copy
+        std::unique_lock<std::mutex> lock(shared.mutex, std::defer_lock);
+        if (options.shareWeights) {
+            lock.lock();
+            auto it = shared.models.find(entry);
+            if (it != shared.models.end()) mWeights = it->second.lock();
+        }
+        if (mWeights) {
+            std::cout << "Sharing packed weights with " << mWeights.use_count() - 1 << " other instances" << std::endl;
+        } else if (!options.cacheDir.empty()) {
+            const std::string cachePath = weightCachePath(options.cacheDir, spec.name, mPrecision, key);
+            mWeights = PackedModel::load(cachePath, mGraph, mPrecision, key, options.hugePages);
+            if (mWeights) {
+                std::cout << "Mapped prepacked weights: " << cachePath << std::endl;
+            } else {
+                std::unique_ptr<PackedModel> packed = PackedModel::pack(mGraph, loadWeights(), mPrecision, options.hugePages);
+                if (!packed->save(cachePath, key)) {
+                    std::cerr << "Unable to write weight cache " << cachePath << std::endl;
+                } else if (options.hugePages == HugePages::kNONE) {
+                    // map what was just written, so processes started later share the
+                    // pages with this one; huge pages the page cache could not give
+                    mWeights = PackedModel::load(cachePath, mGraph, mPrecision, key, options.hugePages);
+                }
+                if (!mWeights) mWeights = std::move(packed);
+            }
+        } else {
+            mWeights = PackedModel::pack(mGraph, loadWeights(), mPrecision, options.hugePages);
+        }
+        if (options.shareWeights) {
+            for (auto it = shared.models.begin(); it != shared.models.end();) {
+                if (it->second.expired()) it = shared.models.erase(it);
+                else ++it;
+            }
+            shared.models[entry] = mWeights;
+            lock.unlock();
+        }
+        int threads = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+        mPool.reset(new ThreadPool(threads));
+        mTune = options.tune;
+        if (!options.cacheDir.empty()) {
+            mTuningPath = tuningCachePath(options.cacheDir);
+            if (mTuning.load(mTuningPath)) {
+                std::cout << "Loaded " << mTuning.size() << " tuned conv blockings: " << mTuningPath << std::endl;
+            }
+        }
+        selectPlan(options.inputH > 0 ? options.inputH : mGraph.inputH,
+                   options.inputW > 0 ? options.inputW : mGraph.inputW);
+
+        mConsumers.resize(mGraph.nodes.size());
+        for (size_t i = 0; i < mGraph.nodes.size(); ++i) {
+            for (int j : mGraph.nodes[i].inputs) mConsumers[j].push_back((int)i);
+        }
+        foldInputNormalization();
+
+        const PackStats& stats = mWeights->stats();
+        std::cout << "Packed " << spec.name << " weights as " << precisionName(mPrecision) << ": "
+                  << stats.packedBytes / (1 << 20) << "MB (fp32 " << stats.fp32Bytes / (1 << 20) << "MB)";
+        if (mPrecision != Precision::kFP32) {
+            std::cout << ", max relative weight error " << stats.maxRelError << " in " << stats.worstLayer;
+        }
+        std::cout << ", " << mPool->size() << " threads" << std::endl;
+    }
+
+    // uint8 BGR input x feeds the Focus conv as x, not as RGB x / 255: scale the
+    // kernel by 1/255 and swap the R and B input channels of each of the 4 phases.
+    // The padding is zero in both cases, so the conv output is unchanged.
+    void Network::foldInputNormalization() {
+        for (const Node& node : mGraph.nodes) {
+            if (node.type != OpType::kCONV) continue;
+            const Node& in = mGraph.nodes[node.inputs[0]];
+            if (in.type == OpType::kFOCUS && mGraph.nodes[in.inputs[0]].type == OpType::kINPUT) {
+                mFocusConv = node.conv;
+                break;
+            }
+        }
+        if (mFocusConv < 0) return;
+        const ConvDesc& d = mGraph.convs[mFocusConv];
+        const PackedConv& pc = mWeights->convs()[mFocusConv];
+        const int kk = d.ksize * d.ksize;
+        const int K = d.inch * kk;
+        mFocusU8Weights.resize((size_t)d.outch * K);
+        for (int oc = 0; oc < d.outch; ++oc) {
+            for (int ic = 0; ic < d.inch; ++ic) {
+                const int rgb = ic / 3 * 3 + (2 - ic % 3);
+                for (int t = 0; t < kk; ++t) {
+                    mFocusU8Weights[(size_t)oc * K + ic * kk + t] = pc.weight.at(oc, rgb * kk + t) / 255.0f;
+                }
+            }
+        }
+        mFocusU8.weight.precision = Precision::kFP32;
+        mFocusU8.weight.rows = d.outch;
+        mFocusU8.weight.cols = K;
+        mFocusU8.weight.data = mFocusU8Weights.data();
+        mFocusU8.bias = pc.bias;
+    }
+
+    std::vector<std::pair<std::string, PageStats>> Network::pageStats() const {
+        std::vector<std::pair<std::string, PageStats>> stats;
+        stats.push_back({"weights", Cpu::pageStats(mWeights->blob(), mWeights->blobSize())});
+        stats.push_back({"arena", Cpu::pageStats(mArena.data(), mArena.size() * sizeof(float))});
+        stats.push_back({"im2col", Cpu::pageStats(mCol.data(), mCol.size() * sizeof(float))});
+        return stats;
+    }
+
+    // Plans are kept per input size, so alternating between camera resolutions only
+    // pays for makePlan() once. The arena and im2col scratch grow to the largest
+    // plan seen and are shared, as only one forward pass runs at a time.
+    void Network::selectPlan(int inputH, int inputW) {
+        if (mPlan && mPlan->inputH == inputH && mPlan->inputW == inputW) return;
+        std::unique_ptr<Plan>& plan = mPlans[std::make_pair(inputH, inputW)];
+        if (!plan) {
+            plan.reset(new Plan(makePlan(mGraph, inputH, inputW)));
+            assignBlocking(*plan);
+        }
+        mPlan = plan.get();
+        int kc = mBlocking.kc;
+        for (const GemmBlocking& blk : mPlan->blocking) kc = std::max(kc, blk.kc);
+        if (mUnpackStride < (size_t)4 * kc) {
+            mUnpackStride = (size_t)4 * kc;
+            mUnpack.resize(mUnpackStride * mPool->size());
+        }
+        if (mArena.size() < mPlan->arenaSize) mArena.resize(mPlan->arenaSize);
+        if (mCol.size() < mPlan->colSize * mPool->size()) mCol.resize(mPlan->colSize * mPool->size());
+    }
+
+    // The GEMM shape a conv is tuned for is what one gemm() call sees when the conv
+    // runs as a single chunk: the whole output for 1x1 convs, one im2col band otherwise.
+    // Intra-op chunks only narrow N, which the blocking handles the same way.
+    void Network::assignBlocking(Plan& plan) {
+        plan.blocking.assign(mGraph.convs.size(), mBlocking);
+        int tuned = 0;
+        for (size_t id = 0; id < mGraph.nodes.size(); ++id) {
+            const Node& node = mGraph.nodes[id];
+            if (node.type != OpType::kCONV) continue;
+            const ConvDesc& d = mGraph.convs[node.conv];
+            const int K = d.inch * d.ksize * d.ksize;
+            const int N = plan.shapes[id].h * plan.shapes[id].w;
+            const bool direct = d.ksize == 1 && d.stride == 1 && d.pad == 0;
+            const int cols = direct ? N : colBand(K, N);
+            GemmBlocking& blk = plan.blocking[node.conv];
+            if (mTuning.find(mPrecision, d.outch, K, cols, blk) || !mTune) continue;
+            double ns = 0.0;
+            blk = tuneGemm(mWeights->convs()[node.conv].weight, cols, &ns);
+            mTuning.put(mPrecision, d.outch, K, cols, blk, ns);
+            ++tuned;
+        }
+        if (!tuned) return;
+        std::cout << "Tuned " << tuned << " conv blockings for " << plan.inputH << "x" << plan.inputW << std::endl;
+        if (!mTuningPath.empty() && !mTuning.save(mTuningPath)) {
+            std::cerr << "Unable to write tuning cache " << mTuningPath << std::endl;
+        }
+    }
+
+    // Cost model for splitting one node across threads. A conv is split into column
+    // chunks of at least INTRA_OP_GRAIN MACs, but only over the threads that are not
+    // already busy with other ready nodes: wide layers in the backbone get intra-op
+    // parallelism, while the small parallel branches of the head (CSP cv2 vs
+    // cv1->m->cv3, the SPP pools, the three detect convs) overlap inter-op instead.
+    static const double INTRA_OP_GRAIN = 1 << 21;
+    static const int MIN_CHUNK_COLUMNS = 64;
+
+    int Network::intraOpChunks(int id) const {
+        if (mPool->size() == 1) return 1;
+        const Shape& s = mPlan->shapes[id];
+        int idle = mPool->size() - (mRunning - 1);
+        int chunks = (int)std::min<double>(mPlan->cost[id] / INTRA_OP_GRAIN, idle);
+        chunks = std::min(chunks, s.h * s.w / MIN_CHUNK_COLUMNS);
+        return std::max(chunks, 1);
+    }
+
+    void Network::convRange(const Node& node, const Shape& in, const Shape& out, const float* src, float* dst,
+                            int n0, int n1, int worker) {
+        const ConvDesc& d = mGraph.convs[node.conv];
+        const PackedConv& pc = mInputU8 && node.conv == mFocusConv ? mFocusU8 : mWeights->convs()[node.conv];
+        const int N = out.h * out.w;
+        const int K = d.inch * d.ksize * d.ksize;
+        const GemmBlocking& blk = mPlan->blocking[node.conv];
+        float* unpack = mUnpack.data() + (size_t)worker * mUnpackStride;
+        for (int oc = 0; oc < d.outch; ++oc) {
+            std::fill(dst + (size_t)oc * N + n0, dst + (size_t)oc * N + n1, pc.bias[oc]);
+        }
+        if (d.ksize == 1 && d.stride == 1 && d.pad == 0) {
+            gemm(pc.weight, src + n0, N, n1 - n0, dst + n0, N, blk, unpack);
+        } else {
+            float* col = mCol.data() + (size_t)worker * mPlan->colSize;
+            const int band = colBand(K, N);
+            for (int b0 = n0; b0 < n1; b0 += band) {
+                const int nb = std::min(band, n1 - b0);
+                im2col(src, in.c, in.h, in.w, d.ksize, d.stride, d.pad, out.w, b0, nb, col);
+                gemm(pc.weight, col, nb, nb, dst + b0, N, blk, unpack);
+            }
+        }
+        for (int oc = 0; oc < d.outch; ++oc) {
+            activate(dst + (size_t)oc * N + n0, n1 - n0, d.act);
+        }
+    }
+
+    void Network::runConv(const Node& node, const Shape& in, const Shape& out, const float* src, float* dst) {
+        const int N = out.h * out.w;
+        const int chunks = intraOpChunks((int)(&node - mGraph.nodes.data()));
+        if (chunks == 1) {
+            convRange(node, in, out, src, dst, 0, N, mPool->workerIndex());
+            return;
+        }
+        mPool->parallelFor(chunks, [&](int c) {
+            convRange(node, in, out, src, dst, (int)((long)N * c / chunks), (int)((long)N * (c + 1) / chunks),
+                      mPool->workerIndex());
+        });
+    }
+
+    void Network::runNode(int id) {
+        const Node& node = mGraph.nodes[id];
+        const Shape& out = mPlan->shapes[id];
+        float* dst = mArena.data() + mPlan->offsets[id];
+        const float* src = node.inputs.empty() ? mInput : mArena.data() + mPlan->offsets[node.inputs[0]];
+        const Shape& in = node.inputs.empty() ? out : mPlan->shapes[node.inputs[0]];
+        mRunning++;
+        switch (node.type) {
+            case OpType::kINPUT:
+                // uint8 frames are read directly by the Focus slice
+                if (!mInputU8) memcpy(dst, mInput, out.volume() * sizeof(float));
+                break;
+            case OpType::kFOCUS:
+                if (mInputU8 && mGraph.nodes[node.inputs[0]].type == OpType::kINPUT) {
+                    focusSliceU8(mInputU8, mInputLayout, in.h, in.w, dst);
+                } else {
+                    focusSlice(src, in.c, in.h, in.w, dst);
+                }
+                break;
+            case OpType::kCONV:
+                runConv(node, in, out, src, dst);
+                break;
+            case OpType::kMAXPOOL:
+                maxPool(src, in.c, in.h, in.w, node.ksize, node.stride, dst);
+                break;
+            case OpType::kREORG:
+                reorg(src, in.c, in.h, in.w, node.stride, dst);
+                break;
+            case OpType::kUPSAMPLE:
+                upsample2x(src, in.c, in.h, in.w, dst);
+                break;
+            case OpType::kCONCAT:
+                for (int j : node.inputs) {
+                    // channels are outermost, so a channel group is one contiguous block
+                    size_t n = mPlan->shapes[j].volume() / node.groups;
+                    memcpy(dst, mArena.data() + mPlan->offsets[j] + node.group * n, n * sizeof(float));
+                    dst += n;
+                }
+                break;
+            case OpType::kADD: {
+                const float* a = mArena.data() + mPlan->offsets[node.inputs[0]];
+                const float* b = mArena.data() + mPlan->offsets[node.inputs[1]];
+                for (size_t k = 0; k < out.volume(); ++k) dst[k] = a[k] + b[k];
+                break;
+            }
+        }
+        mRunning--;
+    }
+
+    void Network::forward() {
+        const int count = (int)mGraph.nodes.size();
+        if (mPool->size() == 1) {
+            for (int i = 0; i < count; ++i) runNode(i);
+            return;
+        }
+        // dataflow schedule: a node becomes a task once all of its inputs are done
+        std::unique_ptr<std::atomic<int>[]> deps(new std::atomic<int>[count]);
+        for (int i = 0; i < count; ++i) deps[i] = (int)mGraph.nodes[i].inputs.size();
+        std::atomic<int> pending(count);
+        std::function<void(int)> run = [&](int id) {
+            runNode(id);
+            for (int c : mConsumers[id]) {
+                if (--deps[c] == 0) mPool->submit([&run, c] { run(c); });
+            }
+            pending--;
+        };
+        for (int i = 0; i < count; ++i) {
+            if (mGraph.nodes[i].inputs.empty()) mPool->submit([&run, i] { run(i); });
+        }
+        mPool->waitFor(pending);
+    }
+
+    void Network::infer(const float* input, float* output, int batchSize) {
+        infer(input, mPlan->inputH, mPlan->inputW, output, batchSize);
+    }
+
+    void Network::infer(const float* input, int inputH, int inputW, float* output, int batchSize) {
+        selectPlan(inputH, inputW);
+        const size_t inputSize = 3 * (size_t)mPlan->inputH * mPlan->inputW;
+        const size_t outputSize = Yolo::OUTPUT_SIZE;
+        mInputU8 = nullptr;
+        for (int b = 0; b < batchSize; ++b) {
+            mInput = input + b * inputSize;
+            forward();
+            decode(output + b * outputSize);
+        }
+    }
+
+    void Network::infer(const uint8_t* input, PixelLayout layout, int inputH, int inputW, float* output, int batchSize) {
+        selectPlan(inputH, inputW);
+        const size_t inputSize = 3 * (size_t)mPlan->inputH * mPlan->inputW;
+        const size_t outputSize = Yolo::OUTPUT_SIZE;
+        assert(mFocusConv >= 0 && "uint8 input needs a Focus stem");
+        mInputLayout = layout;
+        for (int b = 0; b < batchSize; ++b) {
+            mInputU8 = input + b * inputSize;
+            forward();
+            decode(output + b * outputSize);
+        }
+        mInputU8 = nullptr;
+    }
+
+    void Network::decode(float* output) {
+        output[0] = 0;
+        for (size_t i = 0; i < mGraph.outputs.size(); ++i) {
+            int id = mGraph.outputs[i];
+            const DetectHead& head = mGraph.heads[i];
+            const Shape& s = mPlan->shapes[id];
+            const float* data = mArena.data() + mPlan->offsets[id];
+            assert(s.c == head.numBBoxes * (5 + head.classes));
+            switch (head.type) {
+                case HeadType::kYOLOV5:
+                    decodeYolo(data, s.w, s.h, head.anchors.data(), head.classes, mPlan->inputW, mPlan->inputH, output);
+                    break;
+                case HeadType::kYOLOV3:
+                    decodeYoloV3(data, s.w, s.h, head.anchors.data(), head.numBBoxes, head.classes, head.scaleXY,
+                                 mPlan->inputW, mPlan->inputH, output);
+                    break;
+                case HeadType::kREGION:
+                    decodeRegion(data, s.w, s.h, head.anchors.data(), head.numBBoxes, head.classes,
+                                 mPlan->inputW, mPlan->inputH, output);
+                    break;
+            }
+        }
+    }
+}
@@ -0,0 +1,269 @@
+#ifndef YOLOV5_CPU_BACKEND_H_
+#define YOLOV5_CPU_BACKEND_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "yolo_def.h"
+#include "cpu_kernels.h"
+#include "cpu_packed.h"
+#include "cpu_threadpool.h"
+#include "cpu_tuning.h"
+
+// Host-only executor for the yolov5 graph built in yolov5.cpp. It reads the same
+// .wts file, needs neither CUDA nor TensorRT, and writes the same output layout
+// as the "prob" blob, so nms() and get_rect() work on its results unchanged.
+// Darknet yolov2/yolov3/tiny cfg models run on it too, see cpu_darknet.h.
+namespace Cpu
+{
+    enum class OpType : int
+    {
+        kINPUT = 0,
+        kFOCUS,
+        kCONV,
+        kMAXPOOL,
+        kUPSAMPLE,
+        kCONCAT,
+        kADD,
+        kREORG
+    };
+
+    // A convolution with its batch norm folded in at pack time.
+    struct ConvDesc
+    {
+        std::string name;    // e.g. "model.2.cv1"
+        std::string weight;  // weight map key of the kernel
+        std::string bias;    // optional
+        std::string bn;      // optional batch norm prefix
+        float bnEps{1e-3f};
+        int bnOffset{0};     // first bn channel, the CSP concat bn covers two convs
+        int inch{0};
+        int outch{0};
+        int ksize{1};
+        int stride{1};
+        int pad{0};
+        Activation act{Activation::kNONE};
+    };
+
+    struct Node
+    {
+        std::string name;
+        OpType type{OpType::kINPUT};
+        std::vector<int> inputs;
+        int conv{-1};   // index into Graph::convs
+        int ksize{0};   // maxpool window
+        int stride{1};  // maxpool and reorg
+        int groups{1};  // concat takes channel group `group` of `groups` from each input,
+        int group{0};   // as a darknet [route] with groups / group_id does
+        int c{0};       // output channels, spatial dims live in the Plan
+    };
+
+    // How the raw output of a detect conv turns into boxes
+    enum class HeadType : int
+    {
+        kYOLOV5 = 0,  // YoloLayerPlugin
+        kYOLOV3,      // darknet [yolo], YoloLayerV3
+        kREGION       // darknet [region], Region_TRT
+    };
+
+    struct DetectHead
+    {
+        HeadType type{HeadType::kYOLOV5};
+        int classes{0};
+        int numBBoxes{0};
+        std::vector<float> anchors;  // w, h per box, in input pixels; grid cells for kREGION
+        float scaleXY{1.0f};         // yolov4 grid sensitivity, kYOLOV3 only
+    };
+
+    struct Graph
+    {
+        std::vector<Node> nodes;
+        std::vector<ConvDesc> convs;
+        std::vector<int> outputs;  // detect heads in YoloLayer input order: stride 32, 16, 8
+        std::vector<DetectHead> heads;  // one per output
+        int inputH{0};  // size the model was defined for
+        int inputW{0};
+
+        int input();
+        int add(OpType type, const std::string& name, const std::vector<int>& inputs, int c, int ksize = 0,
+                int stride = 1);
+        int conv(int input, const ConvDesc& desc);
+    };
+
+    struct Shape
+    {
+        int c;
+        int h;
+        int w;
+        size_t volume() const { return (size_t)c * h * w; }
+    };
+
+    // Per input resolution: node shapes, where each node's output lives in the arena
+    // and the MACs of each node for the scheduler.
+    struct Plan
+    {
+        int inputH{0};
+        int inputW{0};
+        std::vector<Shape> shapes;
+        std::vector<size_t> offsets;
+        std::vector<double> cost;
+        std::vector<GemmBlocking> blocking;  // per graph conv, tuned for this size or the default
+        size_t arenaSize{0};
+        size_t colSize{0};
+    };
+
+    // inputH and inputW must be multiples of 32; the detect grids follow from them.
+    Plan makePlan(const Graph& graph, int inputH, int inputW);
+
+    const char* opTypeName(OpType type);
+
+    // What one node costs at one input size
+    struct LayerCost
+    {
+        Shape shape;                // output
+        double macs{0.0};           // multiply-accumulates, convs only
+        size_t params{0};           // conv weights plus the bias BN folds into
+        size_t paramBytes{0};       // as packed: weights in the precision, bias in FP32
+        size_t activationBytes{0};  // output, FP32
+    };
+
+    // Where compute and memory go, from the graph alone: no weights and no GPU, so a
+    // variant can be sized before it is trained.
+    struct CostReport
+    {
+        int inputH{0};
+        int inputW{0};
+        Precision precision{Precision::kFP32};
+        std::vector<LayerCost> layers;  // per graph node
+        double macs{0.0};
+        size_t params{0};
+        size_t paramBytes{0};
+        size_t activationBytes{0};  // every node output, what Network's arena holds
+        size_t peakLiveBytes{0};    // the most outputs alive at once when a buffer is
+                                    // reused after its last consumer, as TensorRT does
+    };
+
+    CostReport costReport(const Graph& graph, int inputH, int inputW, Precision precision = Precision::kFP32);
+    // One row per node, then the totals; sizes print as HxW like the --sizes options
+    std::string formatCostReport(const Graph& graph, const CostReport& report);
+    std::string formatCostTotals(const CostReport& report);
+
+    struct ModelSpec
+    {
+        std::string name;
+        float depth;
+        float width;
+        int classes;
+    };
+
+    // net is one of s m l x, as the NET macro in yolov5.cpp
+    bool getModelSpec(char net, ModelSpec& spec);
+    Graph buildYolov5(const ModelSpec& spec);
+
+    struct NetworkOptions
+    {
+        Precision precision{Precision::kFP32};
+        int threads{0};        // 0: one per hardware thread
+        std::string cacheDir;  // prepacked weight cache, empty: always pack from the .wts
+        int inputH{0};  // default input size, 0: the model's own; infer() can pick others per call
+        int inputW{0};
+        HugePages hugePages{HugePages::kNONE};  // backing of the weight blob, arena and im2col columns
+        // Time the gemm blockings of conv shapes the tuning cache in cacheDir has no
+        // entry for, when an input size is first seen, and add the winners to it.
+        // Without it cached entries are still used and the rest get the default.
+        bool tune{false};
+        // Use the packed weights of a live Network of the same weights, graph and
+        // precision instead of a copy of its own, so an extra instance only costs its
+        // arena, scratch and plans. The first instance's hugePages decide their backing.
+        bool shareWeights{true};
+    };
+
+    // Not reentrant: one infer() at a time per Network. For parallel inference create
+    // several, they share the packed weights (NetworkOptions::shareWeights).
+    class Network
+    {
+    public:
+        Network(const ModelSpec& spec, const std::string& wtsFile, const NetworkOptions& options = NetworkOptions());
+        // Darknet yolov2/yolov3/tiny model from its .cfg and .weights
+        Network(const std::string& cfgFile, const std::string& weightsFile,
+                const NetworkOptions& options = NetworkOptions());
+
+        // size of the last inferred (or the default) input
+        int inputH() const { return mPlan->inputH; }
+        int inputW() const { return mPlan->inputW; }
+        Precision precision() const { return mPrecision; }
+        int threads() const { return mPool->size(); }
+        // Idle between infer() calls, other work on the inferring thread can borrow it
+        ThreadPool& pool() const { return *mPool; }
+        const PackStats& packStats() const { return mWeights->stats(); }
+        // Immutable, held by every Network that shares them
+        const std::shared_ptr<const PackedModel>& weights() const { return mWeights; }
+        const Graph& graph() const { return mGraph; }
+        const Plan& plan() const { return *mPlan; }
+        // Page sizes behind the weights, the activation arena and the im2col columns
+        std::vector<std::pair<std::string, PageStats>> pageStats() const;
+
+        // Output of node id for the last image of the last infer(), in plan().shapes[id].
+        // Every node has its own buffer, so all of them stay valid until the next call;
+        // the input node is not filled for uint8 input.
+        const float* tensor(int id) const { return mArena.data() + mPlan->offsets[id]; }
+
+        // input: batchSize x 3 x inputH() x inputW() planar RGB in [0, 1]
+        // output: batchSize x Yolo::OUTPUT_SIZE, the count and packed records as "prob"
+        void infer(const float* input, float* output, int batchSize);
+        // Same at any inputH x inputW that is a multiple of 32, e.g. a rectangular
+        // letterbox. Box coordinates are in that input's pixels.
+        void infer(const float* input, int inputH, int inputW, float* output, int batchSize);
+        // Raw uint8 BGR frames of inputH x inputW, e.g. the letterboxed cv::Mat data.
+        // The 1/255 scale and the BGR to RGB swap are folded into the Focus conv.
+        void infer(const uint8_t* input, PixelLayout layout, int inputH, int inputW, float* output, int batchSize);
+
+    private:
+        Network(const ModelSpec& spec, Graph graph, const std::string& weightsFile,
+                const std::function<WeightMap()>& loadWeights, const NetworkOptions& options);
+
+        void selectPlan(int inputH, int inputW);
+        void assignBlocking(Plan& plan);
+        void foldInputNormalization();
+        void forward();
+        void decode(float* output);
+        void runNode(int id);
+        void runConv(const Node& node, const Shape& in, const Shape& out, const float* src, float* dst);
+        void convRange(const Node& node, const Shape& in, const Shape& out, const float* src, float* dst,
+                       int n0, int n1, int worker);
+        int intraOpChunks(int id) const;
+
+        ModelSpec mSpec;
+        Graph mGraph;
+        std::map<std::pair<int, int>, std::unique_ptr<Plan>> mPlans;
+        const Plan* mPlan{nullptr};
+        Precision mPrecision;
+        std::shared_ptr<const PackedModel> mWeights;
+        HugeArray<float> mArena;     // largest arenaSize of all plans
+        HugeArray<float> mCol;       // largest colSize floats per pool participant
+        std::vector<float> mUnpack;  // 4 * largest kc floats per pool participant
+        size_t mUnpackStride{0};
+        GemmBlocking mBlocking;      // for shapes that are not tuned
+        TuningCache mTuning;
+        std::string mTuningPath;     // empty: tuning results are not kept
+        bool mTune{false};
+
+        // input of the running forward pass, either float or uint8
+        const float* mInput{nullptr};
+        const uint8_t* mInputU8{nullptr};
+        PixelLayout mInputLayout{PixelLayout::kINTERLEAVED};
+        // Focus conv with 1/255 and BGR->RGB folded in, kept in FP32 for uint8 input
+        int mFocusConv{-1};
+        PackedConv mFocusU8;
+        std::vector<float> mFocusU8Weights;
+
+        // inter-op scheduling: consumers of each node, the cost per node is in the plan
+        std::unique_ptr<ThreadPool> mPool;
+        std::vector<std::vector<int>> mConsumers;
+        std::atomic<int> mRunning{0};
+    };
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include "cpu_darknet.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+namespace Cpu
+{
+    static void unsupported(const Darknet::Block& block, const std::string& what) {
+        std::cerr << "Unsupported darknet " << block.at("type") << " layer: " << what << std::endl;
+        abort();
+    }
+
+    static int convLayer(Graph& g, int input, const Darknet::Block& block, const std::string& name) {
+        ConvDesc d;
+        d.name = name;
+        d.weight = name + ".weight";
+        d.outch = Darknet::intOption(block, "filters", 0);
+        d.ksize = Darknet::intOption(block, "size", 1);
+        d.stride = Darknet::intOption(block, "stride", 1);
+        d.pad = Darknet::intOption(block, "pad", 0) ? (d.ksize - 1) / 2 : 0;
+        if (Darknet::intOption(block, "groups", 1) != 1) unsupported(block, "groups");
+        if (Darknet::intOption(block, "batch_normalize", 0)) {
+            d.bn = name + ".bn";
+            d.bnEps = 1e-5f;
+        } else {
+            d.bias = name + ".bias";
+        }
+        std::string act = Darknet::option(block, "activation", "linear");
+        if (act == "leaky") {
+            d.act = Activation::kLEAKY;
+        } else if (act != "linear") {
+            unsupported(block, "activation " + act);
+        }
+        return g.conv(input, d);
+    }
+
+    static DetectHead headLayer(const Darknet::Block& block) {
+        DetectHead head;
+        head.classes = Darknet::intOption(block, "classes", 0);
+        std::vector<float> anchors = Darknet::parseFloats(Darknet::option(block, "anchors"));
+        if (block.at("type") == "region") {
+            head.type = HeadType::kREGION;
+            head.numBBoxes = Darknet::intOption(block, "num", 0);
+            head.anchors = anchors;
+        } else {
+            head.type = HeadType::kYOLOV3;
+            head.scaleXY = std::stof(Darknet::option(block, "scale_x_y", "1"));
+            if (Darknet::intOption(block, "new_coords", 0)) unsupported(block, "new_coords");
+            std::vector<int> masks = Darknet::parseInts(Darknet::option(block, "mask"));
+            if (masks.empty()) {
+                for (int i = 0; i < Darknet::intOption(block, "num", 0); ++i) masks.push_back(i);
+            }
+            head.numBBoxes = (int)masks.size();
+            for (int m : masks) {
+                assert(2 * m + 1 < (int)anchors.size());
+                head.anchors.push_back(anchors[2 * m]);
+                head.anchors.push_back(anchors[2 * m + 1]);
+            }
+        }
+        assert((int)head.anchors.size() == 2 * head.numBBoxes);
+        return head;
+    }
+
+    Graph buildDarknet(const Darknet::Blocks& blocks) {
+        Graph g;
+        int data = g.input();
+        // output node of each layer, darknet numbers the layers after [net] from 0
+        std::vector<int> layers;
+        int previous = data;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            const Darknet::Block& block = blocks[i];
+            const std::string& type = block.at("type");
+            const std::string index = std::to_string(i);
+            if (type == "net" || type == "network") {
+                g.inputH = Darknet::intOption(block, "height", 0);
+                g.inputW = Darknet::intOption(block, "width", 0);
+                if (Darknet::intOption(block, "channels", 3) != 3) unsupported(block, "channels other than 3");
+                continue;
+            }
+            if (type == "convolutional") {
+                previous = convLayer(g, previous, block, "conv_" + index);
+            } else if (type == "maxpool") {
+                int size = Darknet::intOption(block, "size", 2);
+                int stride = Darknet::intOption(block, "stride", 2);
+                previous = g.add(OpType::kMAXPOOL, "maxpool_" + index, {previous}, g.nodes[previous].c, size, stride);
+            } else if (type == "upsample") {
+                if (Darknet::intOption(block, "stride", 2) != 2) unsupported(block, "stride other than 2");
+                previous = g.add(OpType::kUPSAMPLE, "upsample_" + index, {previous}, g.nodes[previous].c);
+            } else if (type == "reorg") {
+                int stride = Darknet::intOption(block, "stride", 2);
+                int c = g.nodes[previous].c * stride * stride;
+                previous = g.add(OpType::kREORG, "reorg_" + index, {previous}, c, 0, stride);
+            } else if (type == "route") {
+                // yolov4-tiny's CSP blocks route the second half of the channels only
+                int groups = Darknet::intOption(block, "groups", 1);
+                int group = Darknet::intOption(block, "group_id", 0);
+                if (groups < 1 || group < 0 || group >= groups) unsupported(block, "group_id out of range");
+                std::vector<int> inputs;
+                int c = 0;
+                for (int l : Darknet::parseInts(Darknet::option(block, "layers"))) {
+                    if (l < 0) l += (int)layers.size();
+                    assert(l >= 0 && l < (int)layers.size());
+                    if (g.nodes[layers[l]].c % groups) unsupported(block, "groups not dividing the channels");
+                    inputs.push_back(layers[l]);
+                    c += g.nodes[layers[l]].c / groups;
+                }
+                if (inputs.empty()) unsupported(block, "no layers");
+                previous = g.add(OpType::kCONCAT, "route_" + index, inputs, c);
+                g.nodes[previous].groups = groups;
+                g.nodes[previous].group = group;
+            } else if (type == "shortcut") {
+                if (Darknet::option(block, "activation", "linear") != "linear") unsupported(block, "activation");
+                int from = Darknet::intOption(block, "from", 0);
+                if (from < 0) from += (int)layers.size();
+                assert(from >= 0 && from < (int)layers.size());
+                assert(g.nodes[layers[from]].c == g.nodes[previous].c);
+                previous = g.add(OpType::kADD, "shortcut_" + index, {previous, layers[from]}, g.nodes[previous].c);
+            } else if (type == "yolo" || type == "region") {
+                // the head decodes the conv output in place, there is no node of its own
+                DetectHead head = headLayer(block);
+                assert(g.nodes[previous].c == head.numBBoxes * (5 + head.classes));
+                g.outputs.push_back(previous);
+                g.heads.push_back(head);
+            } else {
+                unsupported(block, "type");
+            }
+            layers.push_back(previous);
+        }
+        if (g.outputs.empty()) {
+            std::cerr << "Darknet cfg has no [yolo] or [region] layer" << std::endl;
+            abort();
+        }
+        return g;
+    }
+
+    WeightMap loadDarknetWeights(const std::string& file, const Graph& graph) {
+        std::cout << "Loading weights: " << file << std::endl;
+        FILE* fp = fopen(file.c_str(), "rb");
+        if (!fp) {
+            std::cerr << "Unable to open darknet weights " << file << std::endl;
+            abort();
+        }
+        int32_t version[3];
+        bool ok = fread(version, sizeof(int32_t), 3, fp) == 3;
+        if ((version[0] * 10 + version[1]) >= 2 && version[0] < 1000 && version[1] < 1000) {
+            uint64_t seen;
+            ok = ok && fread(&seen, sizeof(seen), 1, fp) == 1;
+        } else {
+            uint32_t seen;
+            ok = ok && fread(&seen, sizeof(seen), 1, fp) == 1;
+        }
+
+        auto read = [&](size_t n) {
+            std::vector<float> values(n);
+            ok = ok && fread(values.data(), sizeof(float), n, fp) == n;
+            return values;
+        };
+        WeightMap weightMap;
+        for (const ConvDesc& d : graph.convs) {
+            // per layer: biases or the bn beta, gamma, mean, var; then the kernel
+            if (d.bn.empty()) {
+                weightMap[d.bias] = read(d.outch);
+            } else {
+                weightMap[d.bn + ".bias"] = read(d.outch);
+                weightMap[d.bn + ".weight"] = read(d.outch);
+                weightMap[d.bn + ".running_mean"] = read(d.outch);
+                weightMap[d.bn + ".running_var"] = read(d.outch);
+            }
+            weightMap[d.weight] = read((size_t)d.outch * d.inch * d.ksize * d.ksize);
+        }
+        char extra;
+        bool atEnd = fread(&extra, 1, 1, fp) == 0;
+        fclose(fp);
+        if (!ok || !atEnd) {
+            std::cerr << "Darknet weights " << file << " do not match the cfg: " << (ok ? "values left over" : "file too short")
+                      << std::endl;
+            abort();
+        }
+        return weightMap;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef YOLOV5_CPU_DARKNET_H_
+#define YOLOV5_CPU_DARKNET_H_
+
+#include <string>
+#include "darknet_cfg.h"
+#include "cpu_backend.h"
+
+// Darknet yolov2, yolov3, yolov4-tiny and the other tiny variants on the CPU backend,
+// from the same cfg blocks the DeepStream Yolo parser reads. Layers map as
+// buildYoloNetwork() maps them to TensorRT: conv-bn-leaky and conv-linear, maxpool,
+// route (with groups / group_id), shortcut, upsample, reorg, and [yolo] / [region]
+// heads decoded like the DeepStream parser.
+namespace Cpu
+{
+    // Nodes are named after the cfg block index as in the TensorRT network, e.g.
+    // "conv_12"; conv weights are keyed "<name>.weight", "<name>.bias" and
+    // "<name>.bn.*", so PackedModel folds the darknet batch norm like any other.
+    Graph buildDarknet(const Darknet::Blocks& blocks);
+
+    // Reads a darknet .weights file into the keys buildDarknet() uses. The header is
+    // 4 ints for files before version 0.2 (yolov2) and 3 ints + a 64 bit image count
+    // after, as in darknet's load_weights(); aborts if the size does not match graph.
+    WeightMap loadDarknetWeights(const std::string& file, const Graph& graph);
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "cpu_flow.h"
+#include "cpu_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace Cpu
+{
+    // Smallest eigenvalue of the window's gradient matrix, per pixel in gray levels
+    // squared, below which the window has no texture to track.
+    static const float MIN_EIGEN = 1e-2f;
+    static const float STEP_EPS = 1e-2f;  // pixels, an LK step shorter than this has converged
+    static const int ROW_CHUNKS = 4;      // row chunks per pool participant when building a pyramid
+
+    static void parallelRows(ThreadPool& pool, int h, const std::function<void(int, int)>& fn) {
+        const int chunks = std::min(h, pool.size() * ROW_CHUNKS);
+        pool.parallelFor(chunks, [&](int i) { fn(h * i / chunks, h * (i + 1) / chunks); });
+    }
+
+    // The sampled window plus the pixel bilinear reads past it must be inside the level.
+    static bool windowFits(const FlowPyramid::Level& level, float x, float y, int r) {
+        const float x0 = std::floor(x - r), y0 = std::floor(y - r);
+        return x0 >= 0.0f && y0 >= 0.0f && x0 + 2 * r + 2 <= level.w && y0 + 2 * r + 2 <= level.h;
+    }
+
+    static float median(std::vector<float>& v) {
+        std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+        return v[v.size() / 2];
+    }
+
+    BoxFlow::BoxFlow(const BoxFlowOptions& options) : mOptions(options), mPool(options.pool) {
+        if (!mPool) {
+            // it shares the cores with the detector and the pipeline stages
+            int threads = options.threads > 0 ? options.threads
+                                              : std::max(1, (int)std::thread::hardware_concurrency() / 4);
+            mOwnPool.reset(new ThreadPool(threads));
+            mPool = mOwnPool.get();
+        }
+        const int size = 2 * mOptions.window + 1;
+        mScratch.resize((size_t)4 * size * size * mPool->size());
+    }
+
+    void BoxFlow::buildPyramid(const uint8_t* gray, int width, int height, size_t stride, FlowPyramid& pyr) {
+        // stop before a level gets too small to hold one window
+        const int minSide = 2 * mOptions.window + 2;
+        int levels = 1;
+        while (levels <= mOptions.levels && std::min(width >> levels, height >> levels) >= minSide) ++levels;
+        pyr.levels.resize(levels);
+        int w = width, h = height;
+        for (auto& level : pyr.levels) {
+            level.w = w;
+            level.h = h;
+            level.image.resize((size_t)w * h);
+            level.gradX.resize((size_t)w * h);
+            level.gradY.resize((size_t)w * h);
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+
+        parallelRows(*mPool, height, [&](int y0, int y1) {
+            widenGray(gray, stride, width, pyr.levels[0].image.data(), y0, y1);
+        });
+        for (int l = 1; l < levels; ++l) {
+            const FlowPyramid::Level& src = pyr.levels[l - 1];
+            FlowPyramid::Level& dst = pyr.levels[l];
+            parallelRows(*mPool, dst.h, [&](int y0, int y1) {
+                pyrDown(src.image.data(), src.w, src.h, dst.image.data(), y0, y1);
+            });
+        }
+        for (auto& level : pyr.levels) {
+            parallelRows(*mPool, level.h, [&](int y0, int y1) {
+                gradient(level.image.data(), level.w, level.h, level.gradX.data(), level.gradY.data(), y0, y1);
+            });
+        }
+    }
+
+    // Pyramidal LK of one point, coarse to fine: the displacement found on a level,
+    // doubled, is the starting guess of the next. Levels where the window does not
+    // fit or has no texture pass the guess on; only the full resolution one can fail.
+    bool BoxFlow::track(const FlowPyramid& from, const FlowPyramid& to, float x, float y, float& nx, float& ny,
+                        float* scratch) const {
+        const int r = mOptions.window, size = 2 * r + 1, n = size * size;
+        float* I = scratch;
+        float* Ix = I + n;
+        float* Iy = Ix + n;
+        float* J = Iy + n;
+
+        float gx = 0.0f, gy = 0.0f;
+        const int top = (int)std::min(from.levels.size(), to.levels.size()) - 1;
+        for (int l = top; l >= 0; --l) {
+            const FlowPyramid::Level& a = from.levels[l];
+            const FlowPyramid::Level& b = to.levels[l];
+            const float scale = 1.0f / (1 << l);
+            const float px = x * scale, py = y * scale;
+            float dx = 0.0f, dy = 0.0f;
+            bool converged = false;
+            if (windowFits(a, px, py, r)) {
+                sampleWindow(a.image.data(), a.w, px - r, py - r, size, I);
+                sampleWindow(a.gradX.data(), a.w, px - r, py - r, size, Ix);
+                sampleWindow(a.gradY.data(), a.w, px - r, py - r, size, Iy);
+                float gxx = 0.0f, gxy = 0.0f, gyy = 0.0f;
+                for (int i = 0; i < n; ++i) {
+                    gxx += Ix[i] * Ix[i];
+                    gxy += Ix[i] * Iy[i];
+                    gyy += Iy[i] * Iy[i];
+                }
+                const float minEigen = (gxx + gyy - std::sqrt((gxx - gyy) * (gxx - gyy) + 4.0f * gxy * gxy)) / 2.0f;
+                const float det = gxx * gyy - gxy * gxy;
+                if (minEigen >= MIN_EIGEN * n) {
+                    converged = true;
+                    for (int it = 0; it < mOptions.iterations; ++it) {
+                        const float qx = px + gx + dx, qy = py + gy + dy;
+                        if (!windowFits(b, qx, qy, r)) {
+                            converged = false;
+                            break;
+                        }
+                        sampleWindow(b.image.data(), b.w, qx - r, qy - r, size, J);
+                        float bx, by;
+                        lkMismatch(I, J, Ix, Iy, n, bx, by);
+                        const float ex = (gyy * bx - gxy * by) / det;
+                        const float ey = (gxx * by - gxy * bx) / det;
+                        dx += ex;
+                        dy += ey;
+                        if (ex * ex + ey * ey < STEP_EPS * STEP_EPS) break;
+                    }
+                }
+            }
+            if (l == 0) {
+                if (!converged) return false;
+                gx += dx;
+                gy += dy;
+            } else {
+                gx = 2.0f * (gx + dx);
+                gy = 2.0f * (gy + dy);
+            }
+        }
+        nx = x + gx;
+        ny = y + gy;
+        return true;
+    }
+
+    bool BoxFlow::moveBox(Yolo::Detection& det, float* scratch) const {
+        const int side = mOptions.pointsPerSide;
+        const float cx = det.bbox[0], cy = det.bbox[1], bw = det.bbox[2], bh = det.bbox[3];
+        std::vector<float> x0, y0, x1, y1, fb;
+        for (int i = 0; i < side; ++i) {
+            for (int j = 0; j < side; ++j) {
+                const float px = cx + bw * ((j + 0.5f) / side - 0.5f);
+                const float py = cy + bh * ((i + 0.5f) / side - 0.5f);
+                float fx, fy, bx, by;
+                if (!track(mPrev, mCur, px, py, fx, fy, scratch)) continue;
+                if (!track(mCur, mPrev, fx, fy, bx, by, scratch)) continue;
+                x0.push_back(px);
+                y0.push_back(py);
+                x1.push_back(fx);
+                y1.push_back(fy);
+                fb.push_back(std::hypot(bx - px, by - py));
+            }
+        }
+        if (x0.empty() || x0.size() < mOptions.minTracked * side * side) return false;
+
+        // keep the better half by forward-backward error
+        std::vector<float> errors(fb);
+        const float fbMedian = median(errors);
+        if (fbMedian > mOptions.maxFbError) return false;
+        std::vector<int> keep;
+        for (size_t i = 0; i < fb.size(); ++i) {
+            if (fb[i] <= fbMedian) keep.push_back((int)i);
+        }
+
+        std::vector<float> dx, dy, ratios;
+        for (int i : keep) {
+            dx.push_back(x1[i] - x0[i]);
+            dy.push_back(y1[i] - y0[i]);
+        }
+        for (size_t a = 0; a < keep.size(); ++a) {
+            for (size_t b = a + 1; b < keep.size(); ++b) {
+                const int i = keep[a], j = keep[b];
+                const float before = std::hypot(x0[i] - x0[j], y0[i] - y0[j]);
+                if (before < 1.0f) continue;
+                ratios.push_back(std::hypot(x1[i] - x1[j], y1[i] - y1[j]) / before);
+            }
+        }
+        const float s = ratios.empty() ? 1.0f : median(ratios);
+        det.bbox[0] += median(dx);
+        det.bbox[1] += median(dy);
+        det.bbox[2] *= s;
+        det.bbox[3] *= s;
+        return true;
+    }
+
+    void BoxFlow::keyframe(const uint8_t* gray, int width, int height, size_t stride,
+                           const std::vector<Yolo::Detection>& dets) {
+        buildPyramid(gray, width, height, stride, mPrev);
+        mBoxes = dets;
+        mAge = 0;
+    }
+
+    bool BoxFlow::propagate(const uint8_t* gray, int width, int height, size_t stride,
+                            std::vector<Yolo::Detection>& dets) {
+        if (mPrev.levels.empty() || mPrev.levels[0].w != width || mPrev.levels[0].h != height) {
+            dets.clear();
+            return false;
+        }
+        buildPyramid(gray, width, height, stride, mCur);
+
+        // one box per task, each participant with its own LK windows
+        std::vector<char> moved(mBoxes.size());
+        const size_t windows = mScratch.size() / mPool->size();
+        mPool->parallelFor((int)mBoxes.size(), [&](int i) {
+            moved[i] = moveBox(mBoxes[i], mScratch.data() + windows * mPool->workerIndex());
+        });
+
+        bool all = true;
+        size_t kept = 0;
+        for (size_t i = 0; i < mBoxes.size(); ++i) {
+            if (moved[i]) mBoxes[kept++] = mBoxes[i];
+            else all = false;
+        }
+        mBoxes.resize(kept);
+        std::swap(mPrev, mCur);
+        ++mAge;
+        dets = mBoxes;
+        return all;
+    }
+}
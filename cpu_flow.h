@@ -0,0 +1,83 @@
+#ifndef YOLOV5_CPU_FLOW_H_
+#define YOLOV5_CPU_FLOW_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cpu_threadpool.h"
+#include "yolo_def.h"
+
+namespace Cpu
+{
+    struct BoxFlowOptions
+    {
+        int levels{3};           // pyramid levels above full resolution, each half the size
+        int window{7};           // half size of the LK window, 15 x 15
+        int iterations{10};      // Gauss-Newton steps per level
+        int pointsPerSide{8};    // 8 x 8 grid of points tracked in every box
+        float maxFbError{3.0f};  // median forward-backward error in pixels above which a box is lost
+        float minTracked{0.3f};  // fraction of a box's points that must track both ways
+        // Runs on pool when set, e.g. Network::pool() when the flow and the network take
+        // turns on one thread; otherwise on a pool of its own of threads threads.
+        ThreadPool* pool{nullptr};
+        int threads{0};          // 0: a quarter of the hardware threads, at least one
+    };
+
+    // Gray image pyramid with its gradients, level 0 at full resolution
+    struct FlowPyramid
+    {
+        struct Level
+        {
+            int w{0};
+            int h{0};
+            std::vector<float> image;
+            std::vector<float> gradX;
+            std::vector<float> gradY;
+        };
+        std::vector<Level> levels;
+    };
+
+    // Moves detector boxes between keyframes with sparse pyramidal Lucas-Kanade flow,
+    // the median flow scheme: a grid of points in each box is tracked forward to the
+    // new frame and back, the points with a forward-backward error above the median
+    // are dropped, and the box is shifted by the median displacement of the rest and
+    // scaled by the median ratio of their pairwise distances. The CPU counterpart of
+    // the NvDsOpticalFlowMeta vectors nvof attaches in DeepStream.
+    // Not reentrant: one call at a time per BoxFlow.
+    class BoxFlow
+    {
+    public:
+        explicit BoxFlow(const BoxFlowOptions& options = BoxFlowOptions());
+
+        // Frame the detector ran on. bbox is cx, cy, w, h in frame pixels.
+        void keyframe(const uint8_t* gray, int width, int height, size_t stride,
+                      const std::vector<Yolo::Detection>& dets);
+        // Moves the boxes of the previous frame to this one and returns them in dets.
+        // Returns false if any box was lost: the detector should run on this frame,
+        // earlier than the keyframe interval asks for. No boxes before a keyframe.
+        bool propagate(const uint8_t* gray, int width, int height, size_t stride,
+                       std::vector<Yolo::Detection>& dets);
+
+        // frames propagated since the last keyframe
+        int age() const { return mAge; }
+        const std::vector<Yolo::Detection>& boxes() const { return mBoxes; }
+
+    private:
+        void buildPyramid(const uint8_t* gray, int width, int height, size_t stride, FlowPyramid& pyr);
+        bool track(const FlowPyramid& from, const FlowPyramid& to, float x, float y, float& nx, float& ny,
+                   float* scratch) const;
+        bool moveBox(Yolo::Detection& det, float* scratch) const;
+
+        BoxFlowOptions mOptions;
+        std::unique_ptr<ThreadPool> mOwnPool;
+        ThreadPool* mPool;
+        FlowPyramid mPrev;
+        FlowPyramid mCur;
+        std::vector<Yolo::Detection> mBoxes;
+        std::vector<float> mScratch;  // 4 windows per pool participant
+        int mAge{0};
+    };
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include "cpu_hugepage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace Cpu
+{
+    static const size_t HUGE_PAGE = (size_t)2 << 20;  // x86-64 and 4 KB granule aarch64 PMD size
+
+    const char* hugePagesName(HugePages h) {
+        switch (h) {
+            case HugePages::kTHP: return "thp";
+            case HugePages::kHUGETLB: return "hugetlb";
+            default: return "none";
+        }
+    }
+
+    bool parseHugePages(const std::string& s, HugePages& h) {
+        if (s == "none") h = HugePages::kNONE;
+        else if (s == "thp") h = HugePages::kTHP;
+        else if (s == "hugetlb") h = HugePages::kHUGETLB;
+        else return false;
+        return true;
+    }
+
+    static size_t roundUp(size_t n, size_t to) {
+        return (n + to - 1) / to * to;
+    }
+
+    HugeBuffer::HugeBuffer(size_t bytes, HugePages mode) {
+        if (bytes == 0) return;
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        // below one huge page there is nothing to gain, keep the small mapping
+        if (bytes < HUGE_PAGE) mode = HugePages::kNONE;
+
+#ifdef MAP_HUGETLB
+        if (mode == HugePages::kHUGETLB) {
+            const size_t len = roundUp(bytes, HUGE_PAGE);
+            void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                mData = mMap = p;
+                mSize = bytes;
+                mMapSize = len;
+                mBacking = HugePages::kHUGETLB;
+                return;
+            }
+            // the reserved pool is empty or too small, see vm.nr_hugepages
+            mode = HugePages::kTHP;
+        }
+#endif
+
+        if (mode == HugePages::kNONE) {
+            const size_t len = roundUp(bytes, page);
+            void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                std::cerr << "Unable to map " << bytes << " bytes" << std::endl;
+                abort();
+            }
+            mData = mMap = p;
+            mSize = bytes;
+            mMapSize = len;
+            return;
+        }
+
+        // over map by one huge page and start at the first 2 MB boundary, so every
+        // huge page of the buffer can be backed by THP
+        const size_t len = roundUp(bytes, HUGE_PAGE);
+        void* p = mmap(nullptr, len + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            std::cerr << "Unable to map " << bytes << " bytes" << std::endl;
+            abort();
+        }
+        uintptr_t begin = (uintptr_t)p, aligned = roundUp(begin, HUGE_PAGE);
+        if (aligned > begin) munmap(p, aligned - begin);
+        const size_t tail = (begin + len + HUGE_PAGE) - (aligned + len);
+        if (tail) munmap((void*)(aligned + len), tail);
+        mData = mMap = (void*)aligned;
+        mSize = bytes;
+        mMapSize = len;
+#ifdef MADV_HUGEPAGE
+        if (madvise(mMap, mMapSize, MADV_HUGEPAGE) == 0) mBacking = HugePages::kTHP;
+#endif
+    }
+
+    HugeBuffer::~HugeBuffer() {
+        if (mMap) munmap(mMap, mMapSize);
+    }
+
+    HugeBuffer& HugeBuffer::operator=(HugeBuffer&& other) {
+        if (this != &other) {
+            if (mMap) munmap(mMap, mMapSize);
+            mData = other.mData;
+            mSize = other.mSize;
+            mMap = other.mMap;
+            mMapSize = other.mMapSize;
+            mBacking = other.mBacking;
+            other.mData = other.mMap = nullptr;
+            other.mSize = other.mMapSize = 0;
+            other.mBacking = HugePages::kNONE;
+        }
+        return *this;
+    }
+
+    PageStats pageStats(const void* addr, size_t bytes) {
+        PageStats s;
+        std::ifstream smaps("/proc/self/smaps");
+        const uintptr_t lo = (uintptr_t)addr, hi = lo + bytes;
+        bool inside = false;
+        std::string line;
+        while (std::getline(smaps, line)) {
+            unsigned long long start, end;
+            // a mapping starts with "start-end perms ...", its fields are "Name: value kB"
+            if (sscanf(line.c_str(), "%llx-%llx ", &start, &end) == 2) {
+                inside = start < hi && end > lo;
+                continue;
+            }
+            if (!inside) continue;
+            std::istringstream ss(line);
+            std::string name;
+            size_t kb = 0;
+            ss >> name >> kb;
+            if (name == "Rss:") s.bytes += kb << 10;
+            else if (name == "AnonHugePages:" || name == "FilePmdMapped:") s.thpBytes += kb << 10;
+            else if (name == "Private_Hugetlb:" || name == "Shared_Hugetlb:") s.hugetlbBytes += kb << 10;
+            else if (name == "KernelPageSize:") s.kernelPageSize = std::max(s.kernelPageSize, kb << 10);
+        }
+        // hugetlb pages are not part of Rss
+        s.bytes += s.hugetlbBytes;
+        return s;
+    }
+
+    std::string formatPageStats(const PageStats& s) {
+        std::ostringstream out;
+        out << (s.bytes >> 20) << "MB resident, " << (s.hugetlbBytes >> 20) << "MB hugetlb, "
+            << (s.thpBytes >> 20) << "MB thp (" << (int)(s.hugeFraction() * 100) << "% huge), kernel page "
+            << (s.kernelPageSize >> 10) << "KB";
+        return out.str();
+    }
+}
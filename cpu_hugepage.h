@@ -0,0 +1,98 @@
+#ifndef YOLOV5_CPU_HUGEPAGE_H_
+#define YOLOV5_CPU_HUGEPAGE_H_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace Cpu
+{
+    // Backing asked for by the large, streamed buffers: packed weights, the activation
+    // arena, im2col columns and input staging. Each falls back to the next one down
+    // when the system cannot provide it.
+    enum class HugePages : int
+    {
+        kNONE = 0,     // ordinary mapping, 4 KB pages unless THP is set to "always"
+        kTHP = 1,      // 2 MB aligned and madvise(MADV_HUGEPAGE)
+        kHUGETLB = 2   // MAP_HUGETLB from the reserved pool (vm.nr_hugepages), else kTHP
+    };
+
+    const char* hugePagesName(HugePages h);
+    bool parseHugePages(const std::string& s, HugePages& h);
+
+    // Page sizes behind a buffer, from /proc/self/smaps, of the mappings that hold it.
+    // Transparent huge pages are only counted once touched, so read it after a run.
+    struct PageStats
+    {
+        size_t bytes{0};         // resident
+        size_t hugetlbBytes{0};  // in hugetlbfs pages
+        size_t thpBytes{0};      // in transparent huge pages
+        size_t kernelPageSize{0};
+
+        double hugeFraction() const { return bytes ? (double)(hugetlbBytes + thpBytes) / bytes : 0.0; }
+    };
+    PageStats pageStats(const void* addr, size_t bytes);
+    std::string formatPageStats(const PageStats& s);
+
+    // Page aligned anonymous mapping of a fixed size, zero filled.
+    class HugeBuffer
+    {
+    public:
+        HugeBuffer() = default;
+        HugeBuffer(size_t bytes, HugePages mode);
+        ~HugeBuffer();
+        HugeBuffer(HugeBuffer&& other) { *this = std::move(other); }
+        HugeBuffer& operator=(HugeBuffer&& other);
+        HugeBuffer(const HugeBuffer&) = delete;
+        HugeBuffer& operator=(const HugeBuffer&) = delete;
+
+        void* data() const { return mData; }
+        size_t size() const { return mSize; }
+        // what the mapping actually got, kNONE after every fallback
+        HugePages backing() const { return mBacking; }
+
+    private:
+        void* mData{nullptr};
+        size_t mSize{0};
+        void* mMap{nullptr};
+        size_t mMapSize{0};
+        HugePages mBacking{HugePages::kNONE};
+    };
+
+    // std::vector-like array of trivially copyable T on a HugeBuffer; resize() keeps
+    // the contents and zero fills the rest.
+    template <typename T>
+    class HugeArray
+    {
+    public:
+        explicit HugeArray(HugePages mode = HugePages::kNONE) : mMode(mode) {}
+        HugeArray(size_t n, HugePages mode) : mMode(mode) { resize(n); }
+
+        void resize(size_t n) {
+            if (n == mSize) return;
+            if (n * sizeof(T) > mBuffer.size()) {
+                HugeBuffer grown(n * sizeof(T), mMode);
+                if (mSize) memcpy(grown.data(), mBuffer.data(), mSize * sizeof(T));
+                mBuffer = std::move(grown);
+            } else if (n > mSize) {
+                memset(data() + mSize, 0, (n - mSize) * sizeof(T));
+            }
+            mSize = n;
+        }
+
+        T* data() { return static_cast<T*>(mBuffer.data()); }
+        const T* data() const { return static_cast<const T*>(mBuffer.data()); }
+        size_t size() const { return mSize; }
+        T& operator[](size_t i) { return data()[i]; }
+        const T& operator[](size_t i) const { return data()[i]; }
+        const HugeBuffer& buffer() const { return mBuffer; }
+
+    private:
+        HugePages mMode;
+        HugeBuffer mBuffer;
+        size_t mSize{0};
+    };
+}
+
+#endif
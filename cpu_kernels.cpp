@@ -0,0 +1,713 @@
+#include "cpu_kernels.h"
+#include "yolo_def.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include "cpu_kernels_sve.h"
+#endif
+
+// Builds the hot loops for several ISA levels and picks one at load time, so the
+// same binary runs on every node but still uses AVX2/AVX-512 FMA where present.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define CPU_KERNEL_CLONES __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define CPU_KERNEL_CLONES
+#endif
+
+namespace Cpu
+{
+    const char* precisionName(Precision p) {
+        switch (p) {
+            case Precision::kFP16: return "fp16";
+            case Precision::kBF16: return "bf16";
+            default: return "fp32";
+        }
+    }
+
+    bool parsePrecision(const std::string& s, Precision& p) {
+        if (s == "fp32") p = Precision::kFP32;
+        else if (s == "fp16") p = Precision::kFP16;
+        else if (s == "bf16") p = Precision::kBF16;
+        else return false;
+        return true;
+    }
+
+    uint16_t floatToBf16(float f) {
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        if ((x & 0x7fffffff) > 0x7f800000) return (uint16_t)((x >> 16) | 0x40);
+        x += 0x7fff + ((x >> 16) & 1);
+        return (uint16_t)(x >> 16);
+    }
+
+    float bf16ToFloat(uint16_t h) {
+        uint32_t bits = (uint32_t)h << 16;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    static void unpackHalfScalar(const uint16_t* src, float* dst, int n) {
+        for (int i = 0; i < n; ++i) dst[i] = halfToFloat(src[i]);
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx,f16c")))
+    static void unpackHalfF16C(const uint16_t* src, float* dst, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+        }
+        for (; i < n; ++i) dst[i] = halfToFloat(src[i]);
+    }
+#endif
+
+#if defined(__aarch64__)
+    static void unpackHalfNeon(const uint16_t* src, float* dst, int n) {
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint16x8_t h = vld1q_u16(src + i);
+            vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vget_low_u16(h))));
+            vst1q_f32(dst + i + 4, vcvt_high_f32_f16(vreinterpretq_f16_u16(h)));
+        }
+        for (; i < n; ++i) dst[i] = halfToFloat(src[i]);
+    }
+
+    // SVE kernels are only linked in when the build could compile cpu_kernels_sve.cpp
+    static bool useSve() {
+#if defined(CPU_KERNELS_SVE) && defined(HWCAP_SVE)
+        static const bool sve = (getauxval(AT_HWCAP) & HWCAP_SVE) != 0;
+        return sve;
+#else
+        return false;
+#endif
+    }
+#endif
+
+    typedef void (*UnpackFn)(const uint16_t*, float*, int);
+
+    static UnpackFn selectHalfUnpack() {
+#if defined(__x86_64__) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("f16c")) return unpackHalfF16C;
+#elif defined(__aarch64__)
+        return unpackHalfNeon;
+#endif
+        return unpackHalfScalar;
+    }
+
+    CPU_KERNEL_CLONES
+    static void unpackBf16(const uint16_t* __restrict src, float* __restrict dst, int n) {
+        // bf16 is the top half of an fp32 word, so this is a plain widening shift
+        uint32_t* out = reinterpret_cast<uint32_t*>(dst);
+        for (int i = 0; i < n; ++i) out[i] = (uint32_t)src[i] << 16;
+    }
+
+    void unpackRow(const uint16_t* src, float* dst, int n, Precision p) {
+        static const UnpackFn unpackHalf = selectHalfUnpack();
+        if (p == Precision::kBF16) unpackBf16(src, dst, n);
+        else unpackHalf(src, dst, n);
+    }
+
+    const char* isaName() {
+#if defined(__x86_64__) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return "avx512";
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return "avx2";
+        if (__builtin_cpu_supports("f16c")) return "f16c";
+        return "sse2";
+#elif defined(__aarch64__)
+        return useSve() ? "sve" : "neon";
+#else
+        return "generic";
+#endif
+    }
+
+    size_t PackedMatrix::sizeFor(size_t count, Precision p) {
+        return count * (p == Precision::kFP32 ? sizeof(float) : sizeof(uint16_t));
+    }
+
+    void PackedMatrix::pack(const float* src, size_t count, Precision p, void* dst) {
+        if (p == Precision::kFP32) {
+            memcpy(dst, src, count * sizeof(float));
+            return;
+        }
+        uint16_t* out = static_cast<uint16_t*>(dst);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = p == Precision::kFP16 ? floatToHalf(src[i]) : floatToBf16(src[i]);
+        }
+    }
+
+    const float* PackedMatrix::row(int r, int k0, int n, float* tmp) const {
+        size_t off = (size_t)r * cols + k0;
+        if (precision == Precision::kFP32) return static_cast<const float*>(data) + off;
+        unpackRow(static_cast<const uint16_t*>(data) + off, tmp, n, precision);
+        return tmp;
+    }
+
+    float PackedMatrix::at(int r, int c) const {
+        size_t off = (size_t)r * cols + c;
+        switch (precision) {
+            case Precision::kFP16: return halfToFloat(static_cast<const uint16_t*>(data)[off]);
+            case Precision::kBF16: return bf16ToFloat(static_cast<const uint16_t*>(data)[off]);
+            default: return static_cast<const float*>(data)[off];
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    static void gemmRows4(const float* a0, const float* a1, const float* a2, const float* a3,
+                          const float* B, int ldb, int kb, int nb,
+                          float* __restrict c0, float* __restrict c1, float* __restrict c2, float* __restrict c3) {
+        for (int k = 0; k < kb; ++k) {
+            const float* __restrict b = B + (size_t)k * ldb;
+            const float w0 = a0[k], w1 = a1[k], w2 = a2[k], w3 = a3[k];
+            for (int n = 0; n < nb; ++n) {
+                float v = b[n];
+                c0[n] += w0 * v;
+                c1[n] += w1 * v;
+                c2[n] += w2 * v;
+                c3[n] += w3 * v;
+            }
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    static void gemmRow1(const float* a0, const float* B, int ldb, int kb, int nb, float* __restrict c0) {
+        for (int k = 0; k < kb; ++k) {
+            const float* __restrict b = B + (size_t)k * ldb;
+            const float w0 = a0[k];
+            for (int n = 0; n < nb; ++n) c0[n] += w0 * b[n];
+        }
+    }
+
+#if defined(__aarch64__)
+    // 4 rows x 16 columns of C stay in NEON registers over the whole k block, instead
+    // of being reloaded for every k as in the auto-vectorized loops above
+    static void gemmRows4Neon(const float* a0, const float* a1, const float* a2, const float* a3,
+                              const float* B, int ldb, int kb, int nb,
+                              float* c0, float* c1, float* c2, float* c3) {
+        int n = 0;
+        for (; n + 16 <= nb; n += 16) {
+            float32x4_t r0[4], r1[4], r2[4], r3[4];
+            for (int j = 0; j < 4; ++j) {
+                r0[j] = vld1q_f32(c0 + n + 4 * j);
+                r1[j] = vld1q_f32(c1 + n + 4 * j);
+                r2[j] = vld1q_f32(c2 + n + 4 * j);
+                r3[j] = vld1q_f32(c3 + n + 4 * j);
+            }
+            for (int k = 0; k < kb; ++k) {
+                const float* b = B + (size_t)k * ldb + n;
+                const float w0 = a0[k], w1 = a1[k], w2 = a2[k], w3 = a3[k];
+                for (int j = 0; j < 4; ++j) {
+                    float32x4_t v = vld1q_f32(b + 4 * j);
+                    r0[j] = vfmaq_n_f32(r0[j], v, w0);
+                    r1[j] = vfmaq_n_f32(r1[j], v, w1);
+                    r2[j] = vfmaq_n_f32(r2[j], v, w2);
+                    r3[j] = vfmaq_n_f32(r3[j], v, w3);
+                }
+            }
+            for (int j = 0; j < 4; ++j) {
+                vst1q_f32(c0 + n + 4 * j, r0[j]);
+                vst1q_f32(c1 + n + 4 * j, r1[j]);
+                vst1q_f32(c2 + n + 4 * j, r2[j]);
+                vst1q_f32(c3 + n + 4 * j, r3[j]);
+            }
+        }
+        for (; n + 4 <= nb; n += 4) {
+            float32x4_t r0 = vld1q_f32(c0 + n), r1 = vld1q_f32(c1 + n);
+            float32x4_t r2 = vld1q_f32(c2 + n), r3 = vld1q_f32(c3 + n);
+            for (int k = 0; k < kb; ++k) {
+                float32x4_t v = vld1q_f32(B + (size_t)k * ldb + n);
+                r0 = vfmaq_n_f32(r0, v, a0[k]);
+                r1 = vfmaq_n_f32(r1, v, a1[k]);
+                r2 = vfmaq_n_f32(r2, v, a2[k]);
+                r3 = vfmaq_n_f32(r3, v, a3[k]);
+            }
+            vst1q_f32(c0 + n, r0);
+            vst1q_f32(c1 + n, r1);
+            vst1q_f32(c2 + n, r2);
+            vst1q_f32(c3 + n, r3);
+        }
+        if (n < nb) gemmRows4(a0, a1, a2, a3, B + n, ldb, kb, nb - n, c0 + n, c1 + n, c2 + n, c3 + n);
+    }
+
+    static void gemmRow1Neon(const float* a0, const float* B, int ldb, int kb, int nb, float* c0) {
+        int n = 0;
+        for (; n + 16 <= nb; n += 16) {
+            float32x4_t r[4];
+            for (int j = 0; j < 4; ++j) r[j] = vld1q_f32(c0 + n + 4 * j);
+            for (int k = 0; k < kb; ++k) {
+                const float* b = B + (size_t)k * ldb + n;
+                for (int j = 0; j < 4; ++j) r[j] = vfmaq_n_f32(r[j], vld1q_f32(b + 4 * j), a0[k]);
+            }
+            for (int j = 0; j < 4; ++j) vst1q_f32(c0 + n + 4 * j, r[j]);
+        }
+        if (n < nb) gemmRow1(a0, B + n, ldb, kb, nb - n, c0 + n);
+    }
+#endif
+
+    typedef void (*GemmRows4Fn)(const float*, const float*, const float*, const float*,
+                                const float*, int, int, int, float*, float*, float*, float*);
+    typedef void (*GemmRow1Fn)(const float*, const float*, int, int, int, float*);
+
+    struct GemmKernels
+    {
+        GemmRows4Fn rows4;
+        GemmRow1Fn row1;
+    };
+
+    // x86 picks its ISA inside the target_clones, aarch64 picks NEON or SVE here
+    static GemmKernels selectGemmKernels() {
+#if defined(__aarch64__)
+#if defined(CPU_KERNELS_SVE)
+        if (useSve()) return GemmKernels{gemmRows4Sve, gemmRow1Sve};
+#endif
+        return GemmKernels{gemmRows4Neon, gemmRow1Neon};
+#else
+        return GemmKernels{gemmRows4, gemmRow1};
+#endif
+    }
+
+    void gemm(const PackedMatrix& A, const float* B, int ldb, int N, float* C, int ldc,
+              const GemmBlocking& blk, float* scratch) {
+        static const GemmKernels kernels = selectGemmKernels();
+        const int M = A.rows;
+        const int K = A.cols;
+        for (int n0 = 0; n0 < N; n0 += blk.nc) {
+            const int nb = std::min(blk.nc, N - n0);
+            for (int k0 = 0; k0 < K; k0 += blk.kc) {
+                const int kb = std::min(blk.kc, K - k0);
+                const float* b = B + (size_t)k0 * ldb + n0;
+                for (int m0 = 0; m0 < M; m0 += blk.mc) {
+                    const int mEnd = std::min(M, m0 + blk.mc);
+                    int m = m0;
+                    for (; m + 4 <= mEnd; m += 4) {
+                        const float* a0 = A.row(m, k0, kb, scratch);
+                        const float* a1 = A.row(m + 1, k0, kb, scratch + blk.kc);
+                        const float* a2 = A.row(m + 2, k0, kb, scratch + 2 * blk.kc);
+                        const float* a3 = A.row(m + 3, k0, kb, scratch + 3 * blk.kc);
+                        float* c = C + (size_t)m * ldc + n0;
+                        kernels.rows4(a0, a1, a2, a3, b, ldb, kb, nb, c, c + ldc, c + 2 * ldc, c + 3 * ldc);
+                    }
+                    for (; m < mEnd; ++m) {
+                        const float* a0 = A.row(m, k0, kb, scratch);
+                        kernels.row1(a0, b, ldb, kb, nb, C + (size_t)m * ldc + n0);
+                    }
+                }
+            }
+        }
+    }
+
+    void im2col(const float* in, int c, int h, int w, int k, int stride, int pad,
+                int ow, int n0, int nb, float* col) {
+        const int oy0 = n0 / ow;
+        const int ox0 = n0 % ow;
+        for (int ic = 0; ic < c; ++ic) {
+            const float* src = in + (size_t)ic * h * w;
+            for (int ky = 0; ky < k; ++ky) {
+                for (int kx = 0; kx < k; ++kx) {
+                    float* dst = col + ((size_t)(ic * k + ky) * k + kx) * nb;
+                    int oy = oy0, ox = ox0;
+                    for (int j = 0; j < nb; ++j) {
+                        int iy = oy * stride - pad + ky;
+                        int ix = ox * stride - pad + kx;
+                        dst[j] = (iy >= 0 && iy < h && ix >= 0 && ix < w) ? src[iy * w + ix] : 0.f;
+                        if (++ox == ow) {
+                            ox = 0;
+                            ++oy;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    static void activateScalar(float* data, size_t n, Activation act) {
+        if (act == Activation::kHARDSWISH) {
+            // same piecewise form as HardSwishKer
+            for (size_t i = 0; i < n; ++i) {
+                float x = data[i];
+                float r = std::min(std::max(x + 3.0f, 0.0f), 6.0f);
+                data[i] = x * r * (1.0f / 6.0f);
+            }
+        } else if (act == Activation::kLEAKY) {
+            for (size_t i = 0; i < n; ++i) {
+                float x = data[i];
+                data[i] = x > 0.0f ? x : 0.1f * x;
+            }
+        }
+    }
+
+#if defined(__aarch64__)
+    static void activateNeon(float* data, size_t n, Activation act) {
+        size_t i = 0;
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        if (act == Activation::kHARDSWISH) {
+            const float32x4_t three = vdupq_n_f32(3.0f), six = vdupq_n_f32(6.0f);
+            const float32x4_t sixth = vdupq_n_f32(1.0f / 6.0f);
+            for (; i + 4 <= n; i += 4) {
+                float32x4_t x = vld1q_f32(data + i);
+                float32x4_t r = vminq_f32(vmaxq_f32(vaddq_f32(x, three), zero), six);
+                vst1q_f32(data + i, vmulq_f32(vmulq_f32(x, r), sixth));
+            }
+        } else if (act == Activation::kLEAKY) {
+            const float32x4_t slope = vdupq_n_f32(0.1f);
+            for (; i + 4 <= n; i += 4) {
+                float32x4_t x = vld1q_f32(data + i);
+                vst1q_f32(data + i, vbslq_f32(vcgtq_f32(x, zero), x, vmulq_f32(x, slope)));
+            }
+        }
+        activateScalar(data + i, n - i, act);
+    }
+#endif
+
+    void activate(float* data, size_t n, Activation act) {
+#if defined(__aarch64__)
+        activateNeon(data, n, act);
+#else
+        activateScalar(data, n, act);
+#endif
+    }
+
+    CPU_KERNEL_CLONES
+    static void maxInto(float* __restrict d, const float* __restrict s, int n) {
+        for (int i = 0; i < n; ++i) d[i] = std::max(d[i], s[i]);
+    }
+
+    void maxPool(const float* in, int c, int h, int w, int k, int stride, float* out) {
+        // separable: horizontal window max into tmp, then vertical window max. With
+        // stride 1 both passes are elementwise max of shifted rows, which every ISA
+        // vectorizes; the row is padded with -FLT_MAX so the window needs no clamping.
+        const int oh = (h + stride - 1) / stride, ow = (w + stride - 1) / stride;
+        const int padY = std::max((oh - 1) * stride + k - h, 0) / 2;
+        const int padX = std::max((ow - 1) * stride + k - w, 0) / 2;
+        const int rowLen = std::max((ow - 1) * stride + k, padX + w);
+        std::vector<float> tmp((size_t)h * ow);
+        std::vector<float> row(rowLen, -FLT_MAX);
+        for (int ch = 0; ch < c; ++ch) {
+            const float* src = in + (size_t)ch * h * w;
+            float* dst = out + (size_t)ch * oh * ow;
+            for (int y = 0; y < h; ++y) {
+                std::copy(src + y * w, src + (y + 1) * w, row.begin() + padX);
+                float* t = tmp.data() + y * ow;
+                if (stride == 1) {
+                    std::copy(row.begin(), row.begin() + ow, t);
+                    for (int i = 1; i < k; ++i) maxInto(t, row.data() + i, ow);
+                } else {
+                    for (int x = 0; x < ow; ++x) {
+                        const float* r = row.data() + x * stride;
+                        t[x] = *std::max_element(r, r + k);
+                    }
+                }
+            }
+            for (int y = 0; y < oh; ++y) {
+                int y0 = std::max(0, y * stride - padY), y1 = std::min(h - 1, y * stride - padY + k - 1);
+                float* d = dst + y * ow;
+                std::copy(tmp.data() + y0 * ow, tmp.data() + (y0 + 1) * ow, d);
+                for (int j = y0 + 1; j <= y1; ++j) maxInto(d, tmp.data() + j * ow, ow);
+            }
+        }
+    }
+
+    void upsample2x(const float* in, int c, int h, int w, float* out) {
+        const int ow = w * 2;
+        for (int ch = 0; ch < c; ++ch) {
+            const float* src = in + (size_t)ch * h * w;
+            float* dst = out + (size_t)ch * h * w * 4;
+            for (int y = 0; y < h; ++y) {
+                float* d = dst + (size_t)(2 * y) * ow;
+                for (int x = 0; x < w; ++x) {
+                    d[2 * x] = d[2 * x + 1] = src[y * w + x];
+                }
+                std::copy(d, d + ow, d + ow);
+            }
+        }
+    }
+
+    void focusSlice(const float* in, int c, int h, int w, float* out) {
+        const int oh = h / 2, ow = w / 2;
+        const int phase[4][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}};
+        for (int p = 0; p < 4; ++p) {
+            for (int ch = 0; ch < c; ++ch) {
+                const float* src = in + (size_t)ch * h * w;
+                float* dst = out + (size_t)(p * c + ch) * oh * ow;
+                for (int y = 0; y < oh; ++y) {
+                    const float* s = src + (size_t)(2 * y + phase[p][0]) * w + phase[p][1];
+                    for (int x = 0; x < ow; ++x) dst[y * ow + x] = s[2 * x];
+                }
+            }
+        }
+    }
+
+    void focusSliceU8(const uint8_t* in, PixelLayout layout, int h, int w, float* out) {
+        const int oh = h / 2, ow = w / 2;
+        const int phase[4][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}};
+        // element step between neighbouring pixels and between channels
+        const size_t px = layout == PixelLayout::kINTERLEAVED ? 3 : 1;
+        const size_t cs = layout == PixelLayout::kINTERLEAVED ? 1 : (size_t)h * w;
+        for (int p = 0; p < 4; ++p) {
+            for (int ch = 0; ch < 3; ++ch) {
+                float* dst = out + (size_t)(p * 3 + ch) * oh * ow;
+                for (int y = 0; y < oh; ++y) {
+                    const uint8_t* s = in + ch * cs + ((size_t)(2 * y + phase[p][0]) * w + phase[p][1]) * px;
+                    for (int x = 0; x < ow; ++x) dst[y * ow + x] = s[2 * x * px];
+                }
+            }
+        }
+    }
+
+    void reorg(const float* in, int c, int h, int w, int stride, float* out) {
+        // darknet's reorg_cpu(forward = 0) called with the input dims: the input is
+        // read as if it were c / stride^2 x h * stride x w * stride
+        const int outC = c / (stride * stride);
+        for (int k = 0; k < c; ++k) {
+            const int c2 = k % outC, offset = k / outC;
+            for (int j = 0; j < h; ++j) {
+                const int h2 = j * stride + offset / stride;
+                const float* s = in + ((size_t)c2 * h * stride + h2) * w * stride + offset % stride;
+                float* d = out + ((size_t)k * h + j) * w;
+                for (int i = 0; i < w; ++i) d[i] = s[i * stride];
+            }
+        }
+    }
+
+    void widenGray(const uint8_t* src, size_t stride, int w, float* dst, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* s = src + y * stride;
+            float* d = dst + (size_t)y * w;
+            for (int x = 0; x < w; ++x) d[x] = s[x];
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    static void binomialRows(const float* __restrict r0, const float* __restrict r1, const float* __restrict r2,
+                             float* __restrict d, int n) {
+        for (int i = 0; i < n; ++i) d[i] = 0.25f * (r0[i] + r2[i]) + 0.5f * r1[i];
+    }
+
+    void pyrDown(const float* src, int w, int h, float* dst, int y0, int y1) {
+        const int ow = (w + 1) / 2;
+        std::vector<float> tmp(w);
+        for (int y = y0; y < y1; ++y) {
+            // vertical pass on whole rows, which vectorizes, then the strided horizontal one
+            const int sy = 2 * y;
+            const float* r0 = src + (size_t)std::max(sy - 1, 0) * w;
+            const float* r1 = src + (size_t)sy * w;
+            const float* r2 = src + (size_t)std::min(sy + 1, h - 1) * w;
+            binomialRows(r0, r1, r2, tmp.data(), w);
+            float* d = dst + (size_t)y * ow;
+            for (int x = 0; x < ow; ++x) {
+                const int sx = 2 * x;
+                d[x] = 0.25f * (tmp[std::max(sx - 1, 0)] + tmp[std::min(sx + 1, w - 1)]) + 0.5f * tmp[sx];
+            }
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    static void halfDiff(const float* __restrict a, const float* __restrict b, float* __restrict d, int n) {
+        for (int i = 0; i < n; ++i) d[i] = 0.5f * (a[i] - b[i]);
+    }
+
+    void gradient(const float* src, int w, int h, float* gx, float* gy, int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const float* s = src + (size_t)y * w;
+            float* dx = gx + (size_t)y * w;
+            if (w > 1) {
+                halfDiff(s + 2, s, dx + 1, w - 2);
+                dx[0] = 0.5f * (s[1] - s[0]);
+                dx[w - 1] = 0.5f * (s[w - 1] - s[w - 2]);
+            } else {
+                dx[0] = 0.0f;
+            }
+            halfDiff(src + (size_t)std::min(y + 1, h - 1) * w, src + (size_t)std::max(y - 1, 0) * w,
+                     gy + (size_t)y * w, w);
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    static void bilinearRow(const float* __restrict p0, const float* __restrict p1, float w00, float w01,
+                            float w10, float w11, float* __restrict d, int n) {
+        for (int i = 0; i < n; ++i) d[i] = w00 * p0[i] + w01 * p0[i + 1] + w10 * p1[i] + w11 * p1[i + 1];
+    }
+
+    void sampleWindow(const float* src, int stride, float x, float y, int size, float* dst) {
+        // one subpixel offset for the whole window, so every row is the same 4 tap blend
+        const int ix = (int)std::floor(x), iy = (int)std::floor(y);
+        const float ax = x - ix, ay = y - iy;
+        const float w00 = (1.0f - ax) * (1.0f - ay), w01 = ax * (1.0f - ay);
+        const float w10 = (1.0f - ax) * ay, w11 = ax * ay;
+        for (int r = 0; r < size; ++r) {
+            const float* p0 = src + (size_t)(iy + r) * stride + ix;
+            bilinearRow(p0, p0 + stride, w00, w01, w10, w11, dst + r * size, size);
+        }
+    }
+
+    CPU_KERNEL_CLONES
+    void lkMismatch(const float* I, const float* J, const float* gx, const float* gy, int n,
+                    float& bx, float& by) {
+        float sx = 0.0f, sy = 0.0f;
+        for (int i = 0; i < n; ++i) {
+            const float d = I[i] - J[i];
+            sx += d * gx[i];
+            sy += d * gy[i];
+        }
+        bx = sx;
+        by = sy;
+    }
+
+    static inline float logist(float data) { return 1.0f / (1.0f + expf(-data)); }
+
+    void decodeYolo(const float* head, int gridW, int gridH, const float* anchors, int classes,
+                    int inputW, int inputH, float* output) {
+        using namespace Yolo;
+        const int totalGrid = gridW * gridH;
+        const int infoLen = 5 + classes;
+        int count = (int)output[0];
+        PackedDetection* dets = reinterpret_cast<PackedDetection*>(output + 1);
+        // Most cells fail the objectness test, so it is first made on the logit, without
+        // expf; the margin leaves the exact sigmoid test below to decide at the boundary.
+        const float objLogit = logf(IGNORE_THRESH / (1.0f - IGNORE_THRESH)) - 1e-3f;
+        for (int k = 0; k < CHECK_COUNT; ++k) {
+            const float* cur = head + (size_t)k * infoLen * totalGrid;
+            const float* obj = cur + 4 * totalGrid;
+            for (int idx = 0; idx < totalGrid; ++idx) {
+#if defined(__aarch64__)
+                // skip 4 cells at a time while none of them clears the threshold
+                if ((idx & 3) == 0 && idx + 4 <= totalGrid &&
+                    vmaxvq_u32(vcgeq_f32(vld1q_f32(obj + idx), vdupq_n_f32(objLogit))) == 0) {
+                    idx += 3;
+                    continue;
+                }
+#endif
+                if (obj[idx] < objLogit) continue;
+                float boxProb = logist(obj[idx]);
+                if (boxProb < IGNORE_THRESH) continue;
+                // sigmoid is monotonic, so the argmax can run on the logits. It and the
+                // sigmoids stay scalar on every ISA: only the few cells past the test
+                // above get here, a cell's classes are totalGrid floats apart, and
+                // NEON has no exp to vectorize logist() with.
+                int classId = 0;
+                float maxLogit = cur[5 * totalGrid + idx];
+                for (int i = 1; i < classes; ++i) {
+                    float v = cur[(5 + i) * totalGrid + idx];
+                    if (v > maxLogit) {
+                        maxLogit = v;
+                        classId = i;
+                    }
+                }
+                if (count >= MAX_OUTPUT_BBOX_COUNT) break;
+                Detection det;
+                int row = idx / gridW;
+                int col = idx % gridW;
+                det.bbox[0] = (col - 0.5f + 2.0f * logist(cur[idx])) * inputW / gridW;
+                det.bbox[1] = (row - 0.5f + 2.0f * logist(cur[totalGrid + idx])) * inputH / gridH;
+                det.bbox[2] = 2.0f * logist(cur[2 * totalGrid + idx]);
+                det.bbox[2] = det.bbox[2] * det.bbox[2] * anchors[2 * k];
+                det.bbox[3] = 2.0f * logist(cur[3 * totalGrid + idx]);
+                det.bbox[3] = det.bbox[3] * det.bbox[3] * anchors[2 * k + 1];
+                det.conf = boxProb * logist(maxLogit);
+                det.class_id = classId;
+                dets[count++] = packDetection(det);
+            }
+        }
+        output[0] = count;
+    }
+
+    void decodeYoloV3(const float* head, int gridW, int gridH, const float* anchors, int numBBoxes,
+                      int classes, float scaleXY, int inputW, int inputH, float* output) {
+        using namespace Yolo;
+        const int totalGrid = gridW * gridH;
+        const float offsetXY = 0.5f * (scaleXY - 1.0f);
+        const int infoLen = 5 + classes;
+        int count = (int)output[0];
+        PackedDetection* dets = reinterpret_cast<PackedDetection*>(output + 1);
+        const float objLogit = logf(IGNORE_THRESH / (1.0f - IGNORE_THRESH)) - 1e-3f;
+        for (int k = 0; k < numBBoxes; ++k) {
+            const float* cur = head + (size_t)k * infoLen * totalGrid;
+            const float* obj = cur + 4 * totalGrid;
+            for (int idx = 0; idx < totalGrid; ++idx) {
+                if (obj[idx] < objLogit) continue;
+                float boxProb = logist(obj[idx]);
+                if (boxProb < IGNORE_THRESH) continue;
+                int classId = 0;
+                float maxLogit = cur[5 * totalGrid + idx];
+                for (int i = 1; i < classes; ++i) {
+                    float v = cur[(5 + i) * totalGrid + idx];
+                    if (v > maxLogit) {
+                        maxLogit = v;
+                        classId = i;
+                    }
+                }
+                if (count >= MAX_OUTPUT_BBOX_COUNT) break;
+                Detection det;
+                int row = idx / gridW;
+                int col = idx % gridW;
+                det.bbox[0] = (col + logist(cur[idx]) * scaleXY - offsetXY) * inputW / gridW;
+                det.bbox[1] = (row + logist(cur[totalGrid + idx]) * scaleXY - offsetXY) * inputH / gridH;
+                det.bbox[2] = expf(cur[2 * totalGrid + idx]) * anchors[2 * k];
+                det.bbox[3] = expf(cur[3 * totalGrid + idx]) * anchors[2 * k + 1];
+                det.conf = boxProb * logist(maxLogit);
+                det.class_id = classId;
+                dets[count++] = packDetection(det);
+            }
+        }
+        output[0] = count;
+    }
+
+    void decodeRegion(const float* head, int gridW, int gridH, const float* anchors, int numBBoxes,
+                      int classes, int inputW, int inputH, float* output) {
+        using namespace Yolo;
+        const int totalGrid = gridW * gridH;
+        const int infoLen = 5 + classes;
+        const float strideX = (float)inputW / gridW, strideY = (float)inputH / gridH;
+        int count = (int)output[0];
+        PackedDetection* dets = reinterpret_cast<PackedDetection*>(output + 1);
+        const float objLogit = logf(IGNORE_THRESH / (1.0f - IGNORE_THRESH)) - 1e-3f;
+        for (int k = 0; k < numBBoxes; ++k) {
+            const float* cur = head + (size_t)k * infoLen * totalGrid;
+            const float* obj = cur + 4 * totalGrid;
+            for (int idx = 0; idx < totalGrid; ++idx) {
+                if (obj[idx] < objLogit) continue;
+                float boxProb = logist(obj[idx]);
+                if (boxProb < IGNORE_THRESH) continue;
+                // the softmax maximum is 1 / sum(exp(v - max))
+                int classId = 0;
+                float maxLogit = cur[5 * totalGrid + idx];
+                for (int i = 1; i < classes; ++i) {
+                    float v = cur[(5 + i) * totalGrid + idx];
+                    if (v > maxLogit) {
+                        maxLogit = v;
+                        classId = i;
+                    }
+                }
+                float sum = 0.0f;
+                for (int i = 0; i < classes; ++i) sum += expf(cur[(5 + i) * totalGrid + idx] - maxLogit);
+                if (count >= MAX_OUTPUT_BBOX_COUNT) break;
+                Detection det;
+                int row = idx / gridW;
+                int col = idx % gridW;
+                det.bbox[0] = (col + logist(cur[idx])) * strideX;
+                det.bbox[1] = (row + logist(cur[totalGrid + idx])) * strideY;
+                det.bbox[2] = expf(cur[2 * totalGrid + idx]) * anchors[2 * k] * strideX;
+                det.bbox[3] = expf(cur[3 * totalGrid + idx]) * anchors[2 * k + 1] * strideY;
+                det.conf = boxProb / sum;
+                det.class_id = classId;
+                dets[count++] = packDetection(det);
+            }
+        }
+        output[0] = count;
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef YOLOV5_CPU_KERNELS_H_
+#define YOLOV5_CPU_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "yolo_def.h"
+
+namespace Cpu
+{
+    // Storage precision of packed weights. Activations are always FP32.
+    enum class Precision : int
+    {
+        kFP32 = 0,
+        kFP16 = 1,
+        kBF16 = 2
+    };
+
+    enum class Activation : int
+    {
+        kNONE = 0,
+        kHARDSWISH = 1,
+        kLEAKY = 2  // slope 0.1, as after the bottleneckCSP concat and in darknet
+    };
+
+    // Memory order of raw 3 channel uint8 frames
+    enum class PixelLayout : int
+    {
+        kINTERLEAVED = 0,  // HWC, as cv::Mat stores them
+        kPLANAR = 1        // CHW
+    };
+
+    const char* precisionName(Precision p);
+    bool parsePrecision(const std::string& s, Precision& p);
+
+    // shared with the packed detection records
+    using Yolo::floatToHalf;
+    using Yolo::halfToFloat;
+    uint16_t floatToBf16(float f);
+    float bf16ToFloat(uint16_t h);
+
+    // Expand n FP16/BF16 values to FP32. Uses F16C when the cpu supports it.
+    void unpackRow(const uint16_t* src, float* dst, int n, Precision p);
+
+    // Widest instruction set the kernels dispatch to on this cpu, e.g. "avx2".
+    const char* isaName();
+
+    // Row major [rows x cols] view of a weight matrix stored in FP32 or as 16 bit FP16/BF16 words.
+    // The storage itself is owned by a PackedModel.
+    struct PackedMatrix
+    {
+        Precision precision{Precision::kFP32};
+        int rows{0};
+        int cols{0};
+        const void* data{nullptr};
+
+        static size_t sizeFor(size_t count, Precision p);
+        // Converts count FP32 values into dst, which must hold sizeFor(count, p) bytes.
+        static void pack(const float* src, size_t count, Precision p, void* dst);
+
+        // Row r, columns [k0, k0 + n) as FP32. tmp must hold n floats and is only
+        // written when the matrix is not stored in FP32.
+        const float* row(int r, int k0, int n, float* tmp) const;
+        float at(int r, int c) const;
+        size_t bytes() const { return sizeFor((size_t)rows * cols, precision); }
+    };
+
+    // Cache blocking of the conv GEMM: mc output channels x nc output pixels x kc reduction.
+    // The register block inside it is fixed, 4 rows (x 16 columns on NEON and SVE), and
+    // is not part of what tuneGemm() searches.
+    struct GemmBlocking
+    {
+        int mc{64};
+        int nc{256};
+        int kc{256};
+    };
+
+    // C[M x N] += A[M x K] * B[K x N], M = A.rows, K = A.cols. scratch must hold 4 * blk.kc floats.
+    void gemm(const PackedMatrix& A, const float* B, int ldb, int N, float* C, int ldc,
+              const GemmBlocking& blk, float* scratch);
+
+    // Unfolds output pixels [n0, n0 + nb) of a k x k conv into col[(c*k*k) x nb].
+    void im2col(const float* in, int c, int h, int w, int k, int stride, int pad,
+                int ow, int n0, int nb, float* col);
+
+    void activate(float* data, size_t n, Activation act);
+    // max pooling with TensorRT's SAME_UPPER padding: the output is ceil(h / stride) x
+    // ceil(w / stride) and any odd padding goes to the bottom and right. k / 2 on each
+    // side for the odd windows of SPP, none for darknet's size 2 stride 2.
+    void maxPool(const float* in, int c, int h, int w, int k, int stride, float* out);
+    // nearest neighbour x2, equivalent to the all-ones grouped deconv of the TensorRT graph
+    void upsample2x(const float* in, int c, int h, int w, float* out);
+    // Focus space-to-depth: concat of the (0,0), (1,0), (0,1), (1,1) row/col phases
+    void focusSlice(const float* in, int c, int h, int w, float* out);
+    // Same for a 3 channel uint8 frame, widened to float without scaling
+    void focusSliceU8(const uint8_t* in, PixelLayout layout, int h, int w, float* out);
+    // darknet reorg (yolov2 passthrough), the permutation Reorg_TRT implements:
+    // c x h x w in, c * stride^2 x h / stride x w / stride out
+    void reorg(const float* in, int c, int h, int w, int stride, float* out);
+
+    // Optical flow image pyramids, see cpu_flow.h. All work on rows [y0, y1) so the
+    // caller can split an image over threads.
+    // uint8 gray rows, stride bytes apart, widened to float
+    void widenGray(const uint8_t* src, size_t stride, int w, float* dst, int y0, int y1);
+    // 2x downsample with a 1-2-1 binomial filter, edges replicated: w x h in,
+    // (w + 1) / 2 x (h + 1) / 2 out, y0 and y1 are output rows
+    void pyrDown(const float* src, int w, int h, float* dst, int y0, int y1);
+    // central differences (I(x + 1) - I(x - 1)) / 2 and the same in y, edges replicated
+    void gradient(const float* src, int w, int h, float* gx, float* gy, int y0, int y1);
+    // Bilinear size x size window of src with its top left corner at (x, y). Rows
+    // floor(y) .. floor(y) + size and columns floor(x) .. floor(x) + size are read.
+    void sampleWindow(const float* src, int stride, float x, float y, int size, float* dst);
+    // Lucas-Kanade mismatch vector of a window: sum (I - J) * gx and sum (I - J) * gy
+    void lkMismatch(const float* I, const float* J, const float* gx, const float* gy, int n,
+                    float& bx, float& by);
+
+    // Host version of YoloLayerPlugin's CalDetection. Appends to output laid out as
+    // [count, PackedDetection x MAX_OUTPUT_BBOX_COUNT], just like the "prob" blob.
+    void decodeYolo(const float* head, int gridW, int gridH, const float* anchors, int classes,
+                    int inputW, int inputH, float* output);
+    // Same output for a darknet [yolo] head, as YoloLayerV3 plus decodeYoloV3Tensor in
+    // the DeepStream parser: sigmoid x, y, objectness and classes, exp w, h. anchors
+    // are the masked ones, in input pixels. yolov4 heads stretch the x, y sigmoid by
+    // scaleXY around the cell centre, as decodeYoloV4Tensor does.
+    void decodeYoloV3(const float* head, int gridW, int gridH, const float* anchors, int numBBoxes,
+                      int classes, float scaleXY, int inputW, int inputH, float* output);
+    // yolov2 [region] head, as Region_TRT plus decodeYoloV2Tensor: softmax over the
+    // classes and anchors in grid cells.
+    void decodeRegion(const float* head, int gridW, int gridH, const float* anchors, int numBBoxes,
+                      int classes, int inputW, int inputH, float* output);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "cpu_kernels_sve.h"
+
+#if defined(__ARM_FEATURE_SVE)
+#include <arm_sve.h>
+
+namespace Cpu
+{
+    // Same register blocking as the NEON kernel, 4 rows x 2 vectors of C, but the
+    // vector length is whatever the core implements and the column tail is predicated.
+    void gemmRows4Sve(const float* a0, const float* a1, const float* a2, const float* a3,
+                      const float* B, int ldb, int kb, int nb,
+                      float* c0, float* c1, float* c2, float* c3) {
+        const int vl = (int)svcntw();
+        for (int n = 0; n < nb; n += 2 * vl) {
+            const svbool_t p0 = svwhilelt_b32(n, nb);
+            const svbool_t p1 = svwhilelt_b32(n + vl, nb);
+            svfloat32_t r00 = svld1(p0, c0 + n), r01 = svld1(p1, c0 + n + vl);
+            svfloat32_t r10 = svld1(p0, c1 + n), r11 = svld1(p1, c1 + n + vl);
+            svfloat32_t r20 = svld1(p0, c2 + n), r21 = svld1(p1, c2 + n + vl);
+            svfloat32_t r30 = svld1(p0, c3 + n), r31 = svld1(p1, c3 + n + vl);
+            for (int k = 0; k < kb; ++k) {
+                const float* b = B + (size_t)k * ldb + n;
+                const svfloat32_t v0 = svld1(p0, b);
+                const svfloat32_t v1 = svld1(p1, b + vl);
+                r00 = svmla_n_f32_m(p0, r00, v0, a0[k]);
+                r01 = svmla_n_f32_m(p1, r01, v1, a0[k]);
+                r10 = svmla_n_f32_m(p0, r10, v0, a1[k]);
+                r11 = svmla_n_f32_m(p1, r11, v1, a1[k]);
+                r20 = svmla_n_f32_m(p0, r20, v0, a2[k]);
+                r21 = svmla_n_f32_m(p1, r21, v1, a2[k]);
+                r30 = svmla_n_f32_m(p0, r30, v0, a3[k]);
+                r31 = svmla_n_f32_m(p1, r31, v1, a3[k]);
+            }
+            svst1(p0, c0 + n, r00);
+            svst1(p1, c0 + n + vl, r01);
+            svst1(p0, c1 + n, r10);
+            svst1(p1, c1 + n + vl, r11);
+            svst1(p0, c2 + n, r20);
+            svst1(p1, c2 + n + vl, r21);
+            svst1(p0, c3 + n, r30);
+            svst1(p1, c3 + n + vl, r31);
+        }
+    }
+
+    void gemmRow1Sve(const float* a0, const float* B, int ldb, int kb, int nb, float* c0) {
+        const int vl = (int)svcntw();
+        for (int n = 0; n < nb; n += 2 * vl) {
+            const svbool_t p0 = svwhilelt_b32(n, nb);
+            const svbool_t p1 = svwhilelt_b32(n + vl, nb);
+            svfloat32_t r0 = svld1(p0, c0 + n), r1 = svld1(p1, c0 + n + vl);
+            for (int k = 0; k < kb; ++k) {
+                const float* b = B + (size_t)k * ldb + n;
+                r0 = svmla_n_f32_m(p0, r0, svld1(p0, b), a0[k]);
+                r1 = svmla_n_f32_m(p1, r1, svld1(p1, b + vl), a0[k]);
+            }
+            svst1(p0, c0 + n, r0);
+            svst1(p1, c0 + n + vl, r1);
+        }
+    }
+}
+#endif
@@ -0,0 +1,16 @@
+#ifndef YOLOV5_CPU_KERNELS_SVE_H_
+#define YOLOV5_CPU_KERNELS_SVE_H_
+
+// GEMM microkernels of cpu_kernels.cpp for Arm SVE. They live in their own file
+// because it is the only one compiled with SVE code generation (-march=armv8.2-a+sve);
+// the build defines CPU_KERNELS_SVE when it does, and they are only called once
+// getauxval() reports SVE, so the same binary still runs on NEON-only cores.
+namespace Cpu
+{
+    void gemmRows4Sve(const float* a0, const float* a1, const float* a2, const float* a3,
+                      const float* B, int ldb, int kb, int nb,
+                      float* c0, float* c1, float* c2, float* c3);
+    void gemmRow1Sve(const float* a0, const float* B, int ldb, int kb, int nb, float* c0);
+}
+
+#endif
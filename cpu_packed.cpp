@@ -0,0 +1,286 @@
+#include "cpu_packed.h"
+#include "cpu_backend.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Cpu
+{
+    static const size_t BLOB_ALIGN = 64;           // bytes, one cache line per matrix row start
+    static const size_t CACHE_BLOB_OFFSET = 4096;  // page aligned so the mapping is too
+    static const uint32_t CACHE_VERSION = 1;
+    static const char CACHE_MAGIC[8] = {'Y', 'V', '5', 'P', 'A', 'C', 'K', 0};
+
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t precision;
+        uint64_t key;
+        uint64_t blobSize;
+        uint64_t fp32Bytes;
+        double maxRelError;
+        char worstLayer[64];
+    };
+
+    static size_t alignUp(size_t n) {
+        return (n + BLOB_ALIGN - 1) / BLOB_ALIGN * BLOB_ALIGN;
+    }
+
+    // Blob offsets of each conv's weight and bias; returns the blob size.
+    static size_t layout(const Graph& graph, Precision precision, std::vector<size_t>& offsets) {
+        size_t size = 0;
+        offsets.clear();
+        for (const ConvDesc& d : graph.convs) {
+            offsets.push_back(size);
+            size = alignUp(size + PackedMatrix::sizeFor((size_t)d.outch * d.inch * d.ksize * d.ksize, precision));
+            offsets.push_back(size);
+            size = alignUp(size + d.outch * sizeof(float));
+        }
+        return size;
+    }
+
+    // Same text format as loadWeights() in common.hpp: [name] [size] <data x size in hex>
+    WeightMap loadWeightMap(const std::string& file) {
+        std::cout << "Loading weights: " << file << std::endl;
+        WeightMap weightMap;
+
+        std::ifstream input(file);
+        assert(input.is_open() && "Unable to load weight file. please check if the .wts file path is right!!!!!!");
+
+        int32_t count;
+        input >> count;
+        assert(count > 0 && "Invalid weight map file.");
+
+        while (count--) {
+            std::string name;
+            uint32_t size;
+            input >> name >> std::dec >> size;
+            std::vector<float> values(size);
+            for (uint32_t x = 0; x < size; ++x) {
+                uint32_t bits;
+                input >> std::hex >> bits;
+                memcpy(&values[x], &bits, sizeof(bits));
+            }
+            weightMap[name] = std::move(values);
+        }
+        return weightMap;
+    }
+
+    static const std::vector<float>& lookup(const WeightMap& weightMap, const std::string& key) {
+        auto it = weightMap.find(key);
+        if (it == weightMap.end()) {
+            std::cerr << "Missing weight blob: " << key << std::endl;
+            abort();
+        }
+        return it->second;
+    }
+
+    PackedModel::~PackedModel() {
+        if (mMap) munmap(mMap, mMapSize);
+    }
+
+    void PackedModel::bind(const Graph& graph, const char* blob) {
+        std::vector<size_t> offsets;
+        mBlobSize = layout(graph, mPrecision, offsets);
+        mBlob = blob;
+        mConvs.resize(graph.convs.size());
+        for (size_t i = 0; i < graph.convs.size(); ++i) {
+            const ConvDesc& d = graph.convs[i];
+            PackedConv& pc = mConvs[i];
+            pc.weight.precision = mPrecision;
+            pc.weight.rows = d.outch;
+            pc.weight.cols = d.inch * d.ksize * d.ksize;
+            pc.weight.data = blob + offsets[2 * i];
+            pc.bias = reinterpret_cast<const float*>(blob + offsets[2 * i + 1]);
+        }
+    }
+
+    std::unique_ptr<PackedModel> PackedModel::pack(const Graph& graph, const WeightMap& weightMap, Precision precision,
+                                                   HugePages hugePages) {
+        std::unique_ptr<PackedModel> model(new PackedModel());
+        model->mPrecision = precision;
+
+        // page aligned and zero filled, which covers BLOB_ALIGN and the padding
+        std::vector<size_t> offsets;
+        size_t size = layout(graph, precision, offsets);
+        model->mOwned = HugeBuffer(std::max<size_t>(size, BLOB_ALIGN), hugePages);
+        char* blob = static_cast<char*>(model->mOwned.data());
+        model->bind(graph, blob);
+
+        PackStats& st = model->mStats;
+        for (size_t i = 0; i < graph.convs.size(); ++i) {
+            const ConvDesc& d = graph.convs[i];
+            const int K = d.inch * d.ksize * d.ksize;
+            std::vector<float> w = lookup(weightMap, d.weight);
+            assert((int)w.size() == d.outch * K);
+            std::vector<float> bias(d.outch, 0.f);
+            if (!d.bias.empty()) bias = lookup(weightMap, d.bias);
+
+            if (!d.bn.empty()) {
+                const std::vector<float>& gamma = lookup(weightMap, d.bn + ".weight");
+                const std::vector<float>& beta = lookup(weightMap, d.bn + ".bias");
+                const std::vector<float>& mean = lookup(weightMap, d.bn + ".running_mean");
+                const std::vector<float>& var = lookup(weightMap, d.bn + ".running_var");
+                assert((int)var.size() >= d.bnOffset + d.outch);
+                for (int oc = 0; oc < d.outch; ++oc) {
+                    int c = d.bnOffset + oc;
+                    float scale = gamma[c] / sqrt(var[c] + d.bnEps);
+                    for (int k = 0; k < K; ++k) w[(size_t)oc * K + k] *= scale;
+                    bias[oc] = beta[c] + (bias[oc] - mean[c]) * scale;
+                }
+            }
+
+            const PackedConv& pc = model->mConvs[i];
+            PackedMatrix::pack(w.data(), w.size(), precision, blob + offsets[2 * i]);
+            memcpy(blob + offsets[2 * i + 1], bias.data(), d.outch * sizeof(float));
+
+            double err = 0.0, ref = 0.0;
+            for (int oc = 0; oc < d.outch; ++oc) {
+                for (int k = 0; k < K; ++k) {
+                    double v = w[(size_t)oc * K + k];
+                    double diff = v - pc.weight.at(oc, k);
+                    err += diff * diff;
+                    ref += v * v;
+                }
+            }
+            double rel = ref > 0.0 ? std::sqrt(err / ref) : 0.0;
+            if (rel > st.maxRelError || st.worstLayer.empty()) {
+                st.maxRelError = rel;
+                st.worstLayer = d.name;
+            }
+            st.fp32Bytes += w.size() * sizeof(float);
+            st.packedBytes += pc.weight.bytes();
+        }
+        return model;
+    }
+
+    std::unique_ptr<PackedModel> PackedModel::load(const std::string& path, const Graph& graph,
+                                                   Precision precision, uint64_t key, HugePages hugePages) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < CACHE_BLOB_OFFSET) {
+            close(fd);
+            return nullptr;
+        }
+        size_t fileSize = (size_t)st.st_size;
+        void* map = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+        if (hugePages != HugePages::kNONE) madvise(map, fileSize, MADV_HUGEPAGE);
+#endif
+
+        std::unique_ptr<PackedModel> model(new PackedModel());
+        model->mMap = map;
+        model->mMapSize = fileSize;
+        model->mPrecision = precision;
+
+        std::vector<size_t> offsets;
+        size_t blobSize = layout(graph, precision, offsets);
+        CacheHeader header;
+        memcpy(&header, map, sizeof(header));
+        if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+            header.precision != (uint32_t)precision || header.key != key || header.blobSize != blobSize ||
+            fileSize < CACHE_BLOB_OFFSET + blobSize) {
+            std::cerr << "Ignoring stale weight cache " << path << std::endl;
+            return nullptr;
+        }
+
+        model->bind(graph, static_cast<const char*>(map) + CACHE_BLOB_OFFSET);
+        model->mStats.fp32Bytes = header.fp32Bytes;
+        model->mStats.maxRelError = header.maxRelError;
+        header.worstLayer[sizeof(header.worstLayer) - 1] = 0;
+        model->mStats.worstLayer = header.worstLayer;
+        for (const PackedConv& pc : model->mConvs) model->mStats.packedBytes += pc.weight.bytes();
+        return model;
+    }
+
+    bool PackedModel::save(const std::string& path, uint64_t key) const {
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.precision = (uint32_t)mPrecision;
+        header.key = key;
+        header.blobSize = mBlobSize;
+        header.fp32Bytes = mStats.fp32Bytes;
+        header.maxRelError = mStats.maxRelError;
+        strncpy(header.worstLayer, mStats.worstLayer.c_str(), sizeof(header.worstLayer) - 1);
+
+        std::ostringstream tmp;
+        tmp << path << ".tmp." << getpid();
+        std::ofstream out(tmp.str(), std::ios::binary);
+        if (!out) return false;
+        std::vector<char> page(CACHE_BLOB_OFFSET, 0);
+        memcpy(page.data(), &header, sizeof(header));
+        out.write(page.data(), page.size());
+        out.write(mBlob, mBlobSize);
+        out.close();
+        if (!out || rename(tmp.str().c_str(), path.c_str()) != 0) {
+            remove(tmp.str().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // FNV-1a, 64 bit
+    static void hashBytes(uint64_t& h, const void* data, size_t n) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < n; ++i) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    static void hashValue(uint64_t& h, const T& v) {
+        hashBytes(h, &v, sizeof(v));
+    }
+
+    static void hashString(uint64_t& h, const std::string& s) {
+        hashBytes(h, s.c_str(), s.size() + 1);
+    }
+
+    uint64_t weightCacheKey(const std::string& wtsFile, const Graph& graph, Precision precision) {
+        uint64_t h = 14695981039346656037ull;
+        struct stat st;
+        if (stat(wtsFile.c_str(), &st) == 0) {
+            hashValue(h, (int64_t)st.st_size);
+            hashValue(h, (int64_t)st.st_mtim.tv_sec);
+            hashValue(h, (int64_t)st.st_mtim.tv_nsec);
+        }
+        hashValue(h, CACHE_VERSION);
+        hashValue(h, (int)precision);
+        for (const ConvDesc& d : graph.convs) {
+            hashString(h, d.weight);
+            hashString(h, d.bias);
+            hashString(h, d.bn);
+            hashValue(h, d.bnEps);
+            int dims[6] = {d.bnOffset, d.inch, d.outch, d.ksize, d.stride, d.pad};
+            hashValue(h, dims);
+        }
+        return h;
+    }
+
+    std::string weightCachePath(const std::string& dir, const std::string& model, Precision precision, uint64_t key) {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+        std::string path = dir.empty() ? std::string(".") : dir;
+        if (path.back() != '/') path += '/';
+        return path + model + "-" + precisionName(precision) + "-" + isaName() + "-" + hex + ".pack";
+    }
+}
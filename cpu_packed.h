@@ -0,0 +1,93 @@
+#ifndef YOLOV5_CPU_PACKED_H_
+#define YOLOV5_CPU_PACKED_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cpu_hugepage.h"
+#include "cpu_kernels.h"
+
+namespace Cpu
+{
+    struct Graph;
+
+    typedef std::map<std::string, std::vector<float>> WeightMap;
+    WeightMap loadWeightMap(const std::string& file);
+
+    struct PackedConv
+    {
+        PackedMatrix weight;       // [outch x inch*k*k]
+        const float* bias{nullptr};  // [outch]
+    };
+
+    // Weight footprint and worst relative L2 error of the storage precision against FP32.
+    struct PackStats
+    {
+        size_t fp32Bytes{0};
+        size_t packedBytes{0};
+        double maxRelError{0.0};
+        std::string worstLayer;
+    };
+
+    // BN-folded conv weights of a graph in one blob. The blob layout only depends on
+    // the graph and the precision, so it can be written to disk as is and mapped
+    // back read-only: a cached model starts without parsing the .wts text or
+    // touching pages of layers that are never run.
+    class PackedModel
+    {
+    public:
+        ~PackedModel();
+
+        // Folds BN and converts every conv of graph to precision, into a blob backed by
+        // hugePages when the system has them.
+        static std::unique_ptr<PackedModel> pack(const Graph& graph, const WeightMap& weightMap, Precision precision,
+                                                 HugePages hugePages = HugePages::kNONE);
+
+        // Maps a cache file written by save(). Returns null when the file is missing,
+        // truncated or was written for a different key, graph or precision. Page cache
+        // pages are only collapsed into huge ones by kernels with READ_ONLY_THP_FOR_FS,
+        // so anything but kNONE is just an madvise here.
+        static std::unique_ptr<PackedModel> load(const std::string& path, const Graph& graph,
+                                                 Precision precision, uint64_t key,
+                                                 HugePages hugePages = HugePages::kNONE);
+
+        // Writes to a temporary file and renames it, so concurrent writers and readers
+        // of the same cache entry never see a partial file.
+        bool save(const std::string& path, uint64_t key) const;
+
+        const std::vector<PackedConv>& convs() const { return mConvs; }
+        const PackStats& stats() const { return mStats; }
+        Precision precision() const { return mPrecision; }
+        bool mapped() const { return mMap != nullptr; }
+        const char* blob() const { return mBlob; }
+        size_t blobSize() const { return mBlobSize; }
+
+    private:
+        PackedModel() = default;
+        PackedModel(const PackedModel&) = delete;
+        PackedModel& operator=(const PackedModel&) = delete;
+
+        void bind(const Graph& graph, const char* blob);
+
+        Precision mPrecision{Precision::kFP32};
+        PackStats mStats;
+        std::vector<PackedConv> mConvs;
+        const char* mBlob{nullptr};
+        size_t mBlobSize{0};
+        HugeBuffer mOwned;       // blob after pack()
+        void* mMap{nullptr};     // whole cache file after load()
+        size_t mMapSize{0};
+    };
+
+    // Identifies the packed form of wtsFile: its size and modification time, every
+    // conv of the graph and the precision. The .wts contents are not hashed, that
+    // would cost as much as the parse the cache is there to skip.
+    uint64_t weightCacheKey(const std::string& wtsFile, const Graph& graph, Precision precision);
+
+    // <dir>/<model>-<precision>-<isa>-<key>.pack
+    std::string weightCachePath(const std::string& dir, const std::string& model, Precision precision, uint64_t key);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "cpu_threadpool.h"
+
+namespace Cpu
+{
+    static thread_local const ThreadPool* tlsPool = nullptr;
+    static thread_local int tlsIndex = 0;
+
+    ThreadPool::ThreadPool(int threads) {
+        if (threads < 1) threads = 1;
+        for (int i = 0; i < threads; ++i) {
+            mQueues.emplace_back(new Queue());
+        }
+        for (int i = 1; i < threads; ++i) {
+            mWorkers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mStop = true;
+        }
+        mWake.notify_all();
+        for (auto& t : mWorkers) t.join();
+    }
+
+    int ThreadPool::workerIndex() const {
+        return tlsPool == this ? tlsIndex : 0;
+    }
+
+    void ThreadPool::submit(std::function<void()> task) {
+        int self = workerIndex();
+        // tasks spawned by a worker stay local, external submissions are spread out
+        int target = self != 0 ? self : (int)(mNext++ % mQueues.size());
+        {
+            std::lock_guard<std::mutex> lock(mQueues[target]->mutex);
+            mQueues[target]->tasks.push_back(std::move(task));
+        }
+        mQueued++;
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+        }
+        mWake.notify_one();
+    }
+
+    bool ThreadPool::tryRun(int self) {
+        std::function<void()> task;
+        {
+            Queue& own = *mQueues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (size_t i = 1; !task && i < mQueues.size(); ++i) {
+            Queue& victim = *mQueues[(self + i) % mQueues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        mQueued--;
+        task();
+        return true;
+    }
+
+    void ThreadPool::workerLoop(int index) {
+        tlsPool = this;
+        tlsIndex = index;
+        while (true) {
+            if (tryRun(index)) continue;
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mWake.wait(lock, [&] { return mStop || mQueued > 0; });
+            if (mStop) return;
+        }
+    }
+
+    void ThreadPool::waitFor(const std::atomic<int>& pending) {
+        int self = workerIndex();
+        while (pending > 0) {
+            if (!tryRun(self)) std::this_thread::yield();
+        }
+    }
+
+    void ThreadPool::parallelFor(int n, const std::function<void(int)>& fn) {
+        if (n <= 0) return;
+        std::atomic<int> remaining(n);
+        for (int i = 1; i < n; ++i) {
+            submit([&, i] {
+                fn(i);
+                remaining--;
+            });
+        }
+        fn(0);
+        remaining--;
+        waitFor(remaining);
+    }
+}
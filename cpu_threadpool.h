@@ -0,0 +1,61 @@
+#ifndef YOLOV5_CPU_THREADPOOL_H_
+#define YOLOV5_CPU_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Cpu
+{
+    // Work-stealing pool. Every participant owns a deque: it pushes and pops at the
+    // back and idle participants steal from the front of the others. The thread that
+    // waits on a batch of work helps run tasks, so it counts as participant 0 and
+    // nested parallelFor() from inside a task cannot deadlock.
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(int threads);
+        ~ThreadPool();
+
+        // number of participants, including the waiting caller
+        int size() const { return (int)mQueues.size(); }
+
+        void submit(std::function<void()> task);
+
+        // Runs fn(i) for i in [0, n); returns when all calls are done.
+        void parallelFor(int n, const std::function<void(int)>& fn);
+
+        // Runs queued tasks until pending drops to zero.
+        void waitFor(const std::atomic<int>& pending);
+
+        // Participant index of the calling thread: 1..size()-1 for pool workers,
+        // 0 for any other thread. Stable for the life of a task, so it can select
+        // per-thread scratch buffers.
+        int workerIndex() const;
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        bool tryRun(int self);
+        void workerLoop(int index);
+
+        std::vector<std::unique_ptr<Queue>> mQueues;
+        std::vector<std::thread> mWorkers;
+        std::mutex mSleepMutex;
+        std::condition_variable mWake;
+        std::atomic<int> mQueued{0};
+        std::atomic<unsigned> mNext{0};
+        bool mStop{false};
+    };
+}
+
+#endif
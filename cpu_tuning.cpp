@@ -0,0 +1,158 @@
+#include "cpu_tuning.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+namespace Cpu
+{
+    static const char TUNING_HEADER[] = "# yolov5 cpu tuning v1";
+    static const double MIN_TUNE_SECONDS = 2e-3;  // per candidate, at least one call
+    static const int TUNE_REPEATS = 3;             // the best of these is kept
+
+    std::string cpuModelKey() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line, model, implementer, part;
+        while (std::getline(cpuinfo, line)) {
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = line.substr(0, line.find_last_not_of(" \t", colon - 1) + 1);
+            std::string value = line.substr(std::min(colon + 2, line.size()));
+            if (name == "model name" && model.empty()) model = value;
+            else if (name == "CPU implementer" && implementer.empty()) implementer = value;
+            else if (name == "CPU part" && part.empty()) part = value;
+        }
+        if (model.empty()) model = implementer.empty() ? "unknown" : "arm " + implementer + " " + part;
+
+        // lower case, every run of other characters becomes one '-'
+        std::string key;
+        for (char c : model + " " + isaName()) {
+            if (isalnum((unsigned char)c)) key += (char)tolower((unsigned char)c);
+            else if (!key.empty() && key.back() != '-') key += '-';
+        }
+        while (!key.empty() && key.back() == '-') key.pop_back();
+        return key;
+    }
+
+    std::string tuningCachePath(const std::string& dir) {
+        std::string path = dir.empty() ? std::string(".") : dir;
+        if (path.back() != '/') path += '/';
+        return path + "tuning-" + cpuModelKey() + ".txt";
+    }
+
+    bool TuningCache::load(const std::string& path) {
+        mEntries.clear();
+        std::ifstream in(path);
+        std::string line;
+        if (!std::getline(in, line) || line != TUNING_HEADER) return false;
+        if (!std::getline(in, line) || line != "cpu " + cpuModelKey()) return false;
+        while (std::getline(in, line)) {
+            std::istringstream ss(line);
+            std::string precision;
+            int M, K, N;
+            Entry e;
+            Precision p;
+            if (!(ss >> precision >> M >> K >> N >> e.blk.mc >> e.blk.nc >> e.blk.kc >> e.ns) ||
+                !parsePrecision(precision, p)) {
+                mEntries.clear();
+                return false;
+            }
+            mEntries[std::make_tuple((int)p, M, K, N)] = e;
+        }
+        return true;
+    }
+
+    bool TuningCache::save(const std::string& path) const {
+        std::ostringstream tmp;
+        tmp << path << ".tmp." << getpid();
+        std::ofstream out(tmp.str());
+        if (!out) return false;
+        out << TUNING_HEADER << "\n" << "cpu " << cpuModelKey() << "\n";
+        for (const auto& it : mEntries) {
+            const Entry& e = it.second;
+            out << precisionName((Precision)std::get<0>(it.first)) << " " << std::get<1>(it.first) << " "
+                << std::get<2>(it.first) << " " << std::get<3>(it.first) << " " << e.blk.mc << " " << e.blk.nc << " "
+                << e.blk.kc << " " << e.ns << "\n";
+        }
+        out.close();
+        if (!out || rename(tmp.str().c_str(), path.c_str()) != 0) {
+            remove(tmp.str().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool TuningCache::find(Precision p, int M, int K, int N, GemmBlocking& blk) const {
+        auto it = mEntries.find(std::make_tuple((int)p, M, K, N));
+        if (it == mEntries.end()) return false;
+        blk = it->second.blk;
+        return true;
+    }
+
+    void TuningCache::put(Precision p, int M, int K, int N, const GemmBlocking& blk, double ns) {
+        mEntries[std::make_tuple((int)p, M, K, N)] = Entry{blk, ns};
+    }
+
+    // Best of TUNE_REPEATS timings of gemm() with blk, in ns per call
+    static double timeGemm(const PackedMatrix& A, const float* B, int N, float* C, float* scratch,
+                           const GemmBlocking& blk) {
+        double fastest = 1e30;
+        for (int r = 0; r < TUNE_REPEATS; ++r) {
+            int calls = 0;
+            auto start = std::chrono::steady_clock::now();
+            double elapsed = 0.0;
+            do {
+                gemm(A, B, N, N, C, N, blk, scratch);
+                ++calls;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (elapsed < MIN_TUNE_SECONDS);
+            fastest = std::min(fastest, elapsed * 1e9 / calls);
+        }
+        return fastest;
+    }
+
+    GemmBlocking tuneGemm(const PackedMatrix& A, int N, double* ns) {
+        static const std::vector<int> MC = {16, 32, 64, 128};
+        static const std::vector<int> NC = {64, 128, 256, 512, 1024};
+        static const std::vector<int> KC = {64, 128, 256, 512};
+        const int M = A.rows, K = A.cols;
+
+        std::vector<float> B((size_t)K * N), C((size_t)M * N);
+        for (size_t i = 0; i < B.size(); ++i) B[i] = (float)((i * 7919) % 255) / 255.0f;
+        std::vector<float> scratch(4 * (size_t)K);
+
+        // Coordinate descent from the default: sweep kc, then nc, then mc, keeping
+        // the best of each axis. About a dozen timings per shape instead of the 80
+        // of the full grid, and the axes interact little: kc sizes the packed A rows
+        // in L1, nc the B panel in L2, mc how often that panel is reused.
+        // Blockings larger than the matrix behave alike and are timed once.
+        GemmBlocking best;
+        std::set<std::tuple<int, int, int>> timed;
+        double bestNs = 1e30;
+        for (int axis = 0; axis < 3; ++axis) {
+            const std::vector<int>& values = axis == 0 ? KC : axis == 1 ? NC : MC;
+            const GemmBlocking base = best;
+            for (int v : values) {
+                GemmBlocking blk = base;
+                if (axis == 0) blk.kc = std::min(v, K);
+                else if (axis == 1) blk.nc = std::min(v, N);
+                else blk.mc = std::min(v, (M + 3) / 4 * 4);  // a multiple of the 4 row kernel
+                if (!timed.insert(std::make_tuple(blk.mc, blk.nc, blk.kc)).second) continue;
+                double t = timeGemm(A, B.data(), N, C.data(), scratch.data(), blk);
+                if (t < bestNs) {
+                    bestNs = t;
+                    best = blk;
+                }
+            }
+        }
+        if (ns) *ns = bestNs;
+        return best;
+    }
+}
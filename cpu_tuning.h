@@ -0,0 +1,48 @@
+#ifndef YOLOV5_CPU_TUNING_H_
+#define YOLOV5_CPU_TUNING_H_
+
+#include <map>
+#include <string>
+#include <tuple>
+#include "cpu_kernels.h"
+
+namespace Cpu
+{
+    // Names the machine a tuning result is valid for, e.g.
+    // "intel-r-xeon-r-gold-6230-cpu-2-10ghz-avx512": the cpu model from /proc/cpuinfo
+    // (implementer and part on ARM) and the ISA the kernels dispatch to.
+    std::string cpuModelKey();
+
+    // Fastest GemmBlocking per conv GEMM shape measured on one cpu model, like the
+    // tactic choices TensorRT stores in an engine. Text, one line per shape:
+    //   <precision> <M> <K> <N> <mc> <nc> <kc> <ns per call>
+    class TuningCache
+    {
+    public:
+        // false when the file is missing or written for another cpu; the cache is empty then
+        bool load(const std::string& path);
+        // writes to a temporary file and renames it, like the weight cache
+        bool save(const std::string& path) const;
+
+        bool find(Precision p, int M, int K, int N, GemmBlocking& blk) const;
+        void put(Precision p, int M, int K, int N, const GemmBlocking& blk, double ns);
+        size_t size() const { return mEntries.size(); }
+
+    private:
+        struct Entry
+        {
+            GemmBlocking blk;
+            double ns;
+        };
+        std::map<std::tuple<int, int, int, int>, Entry> mEntries;
+    };
+
+    // <dir>/tuning-<cpuModelKey()>.txt
+    std::string tuningCachePath(const std::string& dir);
+
+    // Times gemm() of A with a K x N panel for every candidate blocking on the calling
+    // thread and returns the fastest; ns gets its time per call.
+    GemmBlocking tuneGemm(const PackedMatrix& A, int N, double* ns = nullptr);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef YOLOV5_DARKNET_CFG_H_
+#define YOLOV5_DARKNET_CFG_H_
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Darknet .cfg reader shared by the DeepStream Yolo parser, which turns the blocks
+// into a TensorRT network, and by Cpu::buildDarknet(). Header only and free of
+// TensorRT, so CPU-only builds can include it.
+namespace Darknet
+{
+    // one [section]: "type" holds the section name, the other keys its options
+    typedef std::map<std::string, std::string> Block;
+    typedef std::vector<Block> Blocks;
+
+    inline std::string trim(const std::string& s) {
+        const char* ws = " \t\r\n";
+        size_t b = s.find_first_not_of(ws);
+        if (b == std::string::npos) return std::string();
+        return s.substr(b, s.find_last_not_of(ws) - b + 1);
+    }
+
+    // Empty if the file cannot be read.
+    inline Blocks parseConfigFile(const std::string& cfgFile) {
+        std::ifstream file(cfgFile);
+        Blocks blocks;
+        Block block;
+        std::string line;
+        while (getline(file, line)) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+            if (line[0] == '[') {
+                if (!block.empty()) {
+                    blocks.push_back(block);
+                    block.clear();
+                }
+                block["type"] = trim(line.substr(1, line.size() - 2));
+            } else {
+                size_t eq = line.find('=');
+                if (eq == std::string::npos) continue;
+                block[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+            }
+        }
+        if (!block.empty()) blocks.push_back(block);
+        return blocks;
+    }
+
+    // "a, b, c" lists of anchors, masks and route layers
+    inline std::vector<float> parseFloats(const std::string& s) {
+        std::vector<float> values;
+        size_t pos = 0;
+        while (pos < s.size()) {
+            size_t comma = s.find(',', pos);
+            if (comma == std::string::npos) comma = s.size();
+            std::string v = trim(s.substr(pos, comma - pos));
+            if (!v.empty()) values.push_back(std::stof(v));
+            pos = comma + 1;
+        }
+        return values;
+    }
+
+    inline std::vector<int> parseInts(const std::string& s) {
+        std::vector<int> values;
+        for (float v : parseFloats(s)) values.push_back((int)v);
+        return values;
+    }
+
+    inline std::string option(const Block& block, const std::string& key, const std::string& fallback = "") {
+        auto it = block.find(key);
+        return it == block.end() ? fallback : it->second;
+    }
+
+    inline int intOption(const Block& block, const std::string& key, int fallback) {
+        auto it = block.find(key);
+        return it == block.end() ? fallback : std::stoi(it->second);
+    }
+}
+
+#endif
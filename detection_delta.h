@@ -0,0 +1,217 @@
+#ifndef YOLOV5_DETECTION_DELTA_H_
+#define YOLOV5_DETECTION_DELTA_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "yolo_def.h"
+
+namespace Yolo
+{
+    // Change-only emission of per frame detections. Each source keeps the set it last
+    // sent; a frame is diffed against it by class and IoU and only the boxes that
+    // appeared, moved or disappeared go out. Every keyframeInterval frames, and on the
+    // first frame of a source, the whole set is sent so a receiver can join late or
+    // recover from a lost message.
+    //
+    // Message, native byte order:
+    //   DeltaHeader, then count x (DeltaRecord [+ PackedDetection for kADD and kUPDATE])
+    // A keyframe holds only kADD records and replaces the receiver's set.
+    struct DeltaOptions
+    {
+        float matchIou{0.3f};      // same class and at least this IoU: the same object
+        float unchangedIou{0.9f};  // a matched box this close to what was sent is not updated
+        float confDelta{0.1f};     // ... unless its conf moved by more than this
+        int keyframeInterval{30};  // frames, 1: every frame is a keyframe
+    };
+
+    enum class DeltaOp : uint8_t
+    {
+        kADD = 0,
+        kUPDATE = 1,
+        kREMOVE = 2
+    };
+
+    struct DeltaHeader
+    {
+        uint32_t source;
+        uint32_t frame;
+        uint16_t count;
+        uint8_t keyframe;
+        uint8_t reserved;
+    };
+
+    struct DeltaRecord
+    {
+        uint16_t id;  // per source, stays with the object until it is removed; once the
+                      // ids wrap, a new object skips those still in use
+        uint8_t op;
+        uint8_t reserved;
+    };
+
+    inline float deltaIou(const float* a, const float* b) {
+        const float x0 = std::max(a[0] - a[2] / 2.f, b[0] - b[2] / 2.f);
+        const float x1 = std::min(a[0] + a[2] / 2.f, b[0] + b[2] / 2.f);
+        const float y0 = std::max(a[1] - a[3] / 2.f, b[1] - b[3] / 2.f);
+        const float y1 = std::min(a[1] + a[3] / 2.f, b[1] + b[3] / 2.f);
+        if (x1 <= x0 || y1 <= y0) return 0.0f;
+        const float inter = (x1 - x0) * (y1 - y0);
+        return inter / (a[2] * a[3] + b[2] * b[3] - inter);
+    }
+
+    class DeltaEncoder
+    {
+    public:
+        explicit DeltaEncoder(const DeltaOptions& options = DeltaOptions()) : mOptions(options) {}
+
+        // Appends the message for this frame of source to out and returns its size in
+        // bytes, a bare header when nothing changed. dets are as nms() returns them.
+        size_t encode(uint32_t source, const std::vector<Detection>& dets, std::vector<uint8_t>& out) {
+            Source& s = mSources[source];
+            const bool keyframe = s.frame == 0 || mOptions.keyframeInterval <= 1 ||
+                                  s.frame % mOptions.keyframeInterval == 0;
+            const size_t begin = out.size();
+            out.resize(begin + sizeof(DeltaHeader));
+            uint16_t count = 0;
+
+            // greedy matching, best IoU first, within a class
+            std::vector<Match> matches;
+            for (size_t i = 0; i < s.sent.size(); ++i) {
+                for (size_t j = 0; j < dets.size(); ++j) {
+                    if (s.sent[i].det.class_id != dets[j].class_id) continue;
+                    const float overlap = deltaIou(s.sent[i].det.bbox, dets[j].bbox);
+                    if (overlap >= mOptions.matchIou) matches.push_back(Match{overlap, (int)i, (int)j});
+                }
+            }
+            std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) { return a.iou > b.iou; });
+            std::vector<int> sentToDet(s.sent.size(), -1), detToSent(dets.size(), -1);
+            for (const Match& m : matches) {
+                if (sentToDet[m.sent] >= 0 || detToSent[m.det] >= 0) continue;
+                sentToDet[m.sent] = m.det;
+                detToSent[m.det] = m.sent;
+            }
+
+            std::vector<Sent> next;
+            for (size_t i = 0; i < s.sent.size(); ++i) {
+                const int j = sentToDet[i];
+                if (j < 0) {
+                    if (!keyframe) append(out, s.sent[i].id, DeltaOp::kREMOVE, nullptr, count);
+                    continue;
+                }
+                Sent kept = s.sent[i];
+                const bool changed = deltaIou(kept.det.bbox, dets[j].bbox) < mOptions.unchangedIou ||
+                                     std::fabs(kept.det.conf - dets[j].conf) > mOptions.confDelta;
+                // the receiver's copy is what was sent, so it only moves on an update
+                if (changed || keyframe) kept.det = dets[j];
+                if (keyframe) append(out, kept.id, DeltaOp::kADD, &kept.det, count);
+                else if (changed) append(out, kept.id, DeltaOp::kUPDATE, &kept.det, count);
+                next.push_back(kept);
+            }
+            // ids wrap after 65536 objects, a new one must not take the id of one still alive
+            std::vector<uint16_t> live;
+            for (const Sent& kept : next) live.push_back(kept.id);
+            std::sort(live.begin(), live.end());
+            for (size_t j = 0; j < dets.size(); ++j) {
+                if (detToSent[j] >= 0) continue;
+                while (std::binary_search(live.begin(), live.end(), s.nextId)) ++s.nextId;
+                Sent added{s.nextId++, dets[j]};
+                live.insert(std::upper_bound(live.begin(), live.end(), added.id), added.id);
+                append(out, added.id, DeltaOp::kADD, &added.det, count);
+                next.push_back(added);
+            }
+
+            DeltaHeader header{source, s.frame, count, (uint8_t)keyframe, 0};
+            memcpy(&out[begin], &header, sizeof(header));
+            s.sent.swap(next);
+            ++s.frame;
+            return out.size() - begin;
+        }
+
+        // Forgets a source, e.g. at the end of its stream; its next frame is a keyframe.
+        void reset(uint32_t source) { mSources.erase(source); }
+
+    private:
+        struct Sent
+        {
+            uint16_t id;
+            Detection det;
+        };
+
+        struct Source
+        {
+            std::vector<Sent> sent;
+            uint32_t frame{0};
+            uint16_t nextId{0};
+        };
+
+        struct Match
+        {
+            float iou;
+            int sent;
+            int det;
+        };
+
+        static void append(std::vector<uint8_t>& out, uint16_t id, DeltaOp op, const Detection* det,
+                           uint16_t& count) {
+            DeltaRecord record{id, (uint8_t)op, 0};
+            const size_t at = out.size();
+            out.resize(at + sizeof(record) + (det ? sizeof(PackedDetection) : 0));
+            memcpy(&out[at], &record, sizeof(record));
+            if (det) {
+                PackedDetection packed = packDetection(*det);
+                memcpy(&out[at + sizeof(record)], &packed, sizeof(packed));
+            }
+            ++count;
+        }
+
+        DeltaOptions mOptions;
+        std::map<uint32_t, Source> mSources;
+    };
+
+    // Receiving side: applies messages to the per source sets, keyed by object id.
+    class DeltaDecoder
+    {
+    public:
+        // Returns the number of bytes consumed, 0 if data does not hold a whole message
+        // or the message is a delta for a source that has not had a keyframe yet.
+        size_t decode(const uint8_t* data, size_t size) {
+            DeltaHeader header;
+            if (size < sizeof(header)) return 0;
+            memcpy(&header, data, sizeof(header));
+            size_t at = sizeof(header);
+            std::map<uint16_t, Detection> objects;
+            if (!header.keyframe) {
+                auto it = mSources.find(header.source);
+                if (it == mSources.end()) return 0;
+                objects = it->second;
+            }
+            for (uint16_t i = 0; i < header.count; ++i) {
+                DeltaRecord record;
+                if (size < at + sizeof(record)) return 0;
+                memcpy(&record, data + at, sizeof(record));
+                at += sizeof(record);
+                if ((DeltaOp)record.op == DeltaOp::kREMOVE) {
+                    objects.erase(record.id);
+                    continue;
+                }
+                PackedDetection packed;
+                if (size < at + sizeof(packed)) return 0;
+                memcpy(&packed, data + at, sizeof(packed));
+                at += sizeof(packed);
+                objects[record.id] = unpackDetection(packed);
+            }
+            mSources[header.source].swap(objects);
+            return at;
+        }
+
+        const std::map<uint16_t, Detection>& objects(uint32_t source) { return mSources[source]; }
+
+    private:
+        std::map<uint32_t, std::map<uint16_t, Detection>> mSources;
+    };
+}
+
+#endif
@@ -0,0 +1,105 @@
+// Checks of the change-only detection messages in detection_delta.h, run by ctest:
+// a round trip through DeltaEncoder and DeltaDecoder, and object ids that wrap
+// around 16 bits while an object from the first frame is still alive.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "detection_delta.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+static Yolo::Detection box(float x, float y, float w, float h, float conf, int class_id) {
+    Yolo::Detection det;
+    det.bbox[0] = x;
+    det.bbox[1] = y;
+    det.bbox[2] = w;
+    det.bbox[3] = h;
+    det.conf = conf;
+    det.class_id = class_id;
+    return det;
+}
+
+// The decoder's set matches what was encoded, through appear, move, vanish and keyframes.
+static void testRoundTrip() {
+    Yolo::DeltaEncoder encoder;
+    Yolo::DeltaDecoder decoder;
+    std::vector<uint8_t> message;
+    for (int frame = 0; frame < 100; ++frame) {
+        std::vector<Yolo::Detection> dets;
+        dets.push_back(box(100.f + frame, 100.f, 40.f, 80.f, 0.9f, 0));  // walks right
+        dets.push_back(box(300.f, 200.f, 60.f, 60.f, 0.7f, 2));          // stands still
+        if (frame % 10 < 5) dets.push_back(box(500.f, 300.f, 30.f, 30.f, 0.6f, 1));  // blinks
+        message.clear();
+        const size_t bytes = encoder.encode(3, dets, message);
+        check(bytes == message.size(), "encode returns the message size");
+        check(decoder.decode(message.data(), message.size()) == bytes, "decode consumes the whole message");
+        const auto& objects = decoder.objects(3);
+        check(objects.size() == dets.size(), "frame " + std::to_string(frame) + ": one object per detection");
+        for (const Yolo::Detection& det : dets) {
+            bool found = false;
+            for (const auto& object : objects) {
+                found |= object.second.class_id == det.class_id && Yolo::deltaIou(object.second.bbox, det.bbox) >= 0.9f;
+            }
+            check(found, "frame " + std::to_string(frame) + ": class " + std::to_string((int)det.class_id) + " is where it was sent");
+        }
+    }
+}
+
+// One object stays for the whole run while a new one replaces the last on every frame,
+// so the next id goes round 16 bits and comes back to the one still in use.
+static void testIdWrap() {
+    Yolo::DeltaEncoder encoder;
+    Yolo::DeltaDecoder decoder;
+    std::vector<uint8_t> message;
+    const Yolo::Detection stays = box(50.f, 50.f, 20.f, 20.f, 0.8f, 0);
+    uint16_t stayId = 0, lastId = 0;
+    bool wrapped = false;
+    for (int frame = 0; frame < 65536 + 10; ++frame) {
+        std::vector<Yolo::Detection> dets;
+        dets.push_back(stays);
+        // the other side of the frame each time, so it never matches the one before
+        dets.push_back(box(frame % 2 ? 200.f : 400.f, 300.f, 20.f, 20.f, 0.8f, 0));
+        message.clear();
+        encoder.encode(0, dets, message);
+        if (decoder.decode(message.data(), message.size()) != message.size()) {
+            check(false, "frame " + std::to_string(frame) + ": decode consumes the whole message");
+            return;
+        }
+        const auto& objects = decoder.objects(0);
+        if (objects.size() != 2) {
+            check(false, "frame " + std::to_string(frame) + ": the new object took the id of the one that stays");
+            return;
+        }
+        uint16_t newId = 0;
+        for (const auto& object : objects) {
+            if (object.second.bbox[0] == stays.bbox[0]) {
+                if (frame == 0) stayId = object.first;
+                check(object.first == stayId, "the object that stays keeps its id");
+            } else {
+                newId = object.first;
+            }
+        }
+        if (frame > 0 && newId < lastId) wrapped = true;
+        lastId = newId;
+    }
+    check(wrapped, "the ids wrapped");
+}
+
+int main() {
+    testRoundTrip();
+    testIdWrap();
+    if (failures) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "detection delta checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,41 @@
+import sys
+import torch
+import struct
+from utils.torch_utils import select_device
+
+# Dumps the input and every module output of one forward pass in the .wts text
+# format, as reference tensors for yolov5_verify --golden.
+# usage: python gen_golden.py [height width]
+h, w = (int(sys.argv[1]), int(sys.argv[2])) if len(sys.argv) == 3 else (608, 608)
+
+# Initialize
+device = select_device('cpu')
+# Load model
+model = torch.load('weights/yolov5s.pt', map_location=device)['model'].float()  # load to FP32
+model.to(device).eval()
+
+outputs = {}
+def hook(name):
+    def fn(module, inputs, output):
+        if isinstance(output, torch.Tensor):
+            outputs[name] = output.detach()
+    return fn
+
+for name, m in model.named_modules():
+    if name.startswith('model.'):
+        m.register_forward_hook(hook(name))
+
+torch.manual_seed(0)
+data = torch.rand(1, 3, h, w)
+with torch.no_grad():
+    model(data)
+
+f = open('yolov5s_golden.wts', 'w')
+f.write('{}\n'.format(len(outputs) + 1))
+for k, v in [('data', data)] + list(outputs.items()):
+    vr = v.reshape(-1).cpu().numpy()
+    f.write('{} {} '.format(k, len(vr)))
+    for vv in vr:
+        f.write(' ')
+        f.write(struct.pack('>f',float(vv)).hex())
+    f.write('\n')
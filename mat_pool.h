@@ -0,0 +1,137 @@
+#ifndef YOLOV5_MAT_POOL_H_
+#define YOLOV5_MAT_POOL_H_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct MatPoolStats
+{
+    uint64_t hits{0};       // allocations served from a free list
+    uint64_t misses{0};     // allocations that went to the heap
+    uint64_t released{0};   // buffers freed because the pool was full
+    size_t pooledBytes{0};  // held in free lists right now
+    size_t liveBytes{0};    // handed out and not yet returned
+
+    double hitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0.0; }
+};
+
+// cv::MatAllocator that keeps freed buffers in free lists by size class, so the
+// frames, letterbox canvases and annotation copies a pipeline creates for every
+// frame reuse the previous frame's memory instead of going to the heap. There are
+// four size classes per power of two, so a buffer wastes less than 25%.
+// Installed with cv::Mat::setDefaultAllocator(); it must outlive every Mat it
+// allocated, so create it once and do not destroy it. Thread safe.
+class MatPool : public cv::MatAllocator
+{
+public:
+#if CV_VERSION_MAJOR >= 4
+    typedef cv::AccessFlag AccessFlags;
+#else
+    typedef int AccessFlags;
+#endif
+
+    explicit MatPool(size_t maxPooledBytes = (size_t)512 << 20) : mMaxPooledBytes(maxPooledBytes) {}
+
+    // Same layout rules as OpenCV's StdMatAllocator, only the buffer comes from the pool.
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                           AccessFlags, cv::UMatUsageFlags) const override {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = data0 ? (uchar*)data0 : take(sizeClass(total));
+        u->size = total;
+        if (data0) u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, AccessFlags, cv::UMatUsageFlags) const override {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            give(u->origdata, sizeClass(u->size));
+            u->origdata = 0;
+        }
+        delete u;
+    }
+
+    MatPoolStats stats() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+    // Frees every pooled buffer, e.g. after the input resolution changed for good.
+    void trim() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto& list : mFree) {
+            for (uchar* p : list.second) cv::fastFree(p);
+        }
+        mFree.clear();
+        mStats.pooledBytes = 0;
+    }
+
+private:
+    static size_t sizeClass(size_t size) {
+        static const size_t MIN_CLASS = 64;
+        if (size <= MIN_CLASS) return MIN_CLASS;
+        size_t pow2 = MIN_CLASS;
+        while (pow2 < size) pow2 <<= 1;
+        const size_t step = pow2 / 8;
+        return (size + step - 1) / step * step;
+    }
+
+    uchar* take(size_t size) const {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.liveBytes += size;
+            auto it = mFree.find(size);
+            if (it != mFree.end() && !it->second.empty()) {
+                uchar* p = it->second.back();
+                it->second.pop_back();
+                mStats.pooledBytes -= size;
+                ++mStats.hits;
+                return p;
+            }
+            ++mStats.misses;
+        }
+        return (uchar*)cv::fastMalloc(size);
+    }
+
+    void give(uchar* p, size_t size) const {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.liveBytes -= size;
+            if (mStats.pooledBytes + size <= mMaxPooledBytes) {
+                mFree[size].push_back(p);
+                mStats.pooledBytes += size;
+                return;
+            }
+            ++mStats.released;
+        }
+        cv::fastFree(p);
+    }
+
+    const size_t mMaxPooledBytes;
+    mutable std::mutex mMutex;
+    mutable std::map<size_t, std::vector<uchar*>> mFree;
+    mutable MatPoolStats mStats;
+};
+
+#endif
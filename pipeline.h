@@ -0,0 +1,466 @@
+#ifndef YOLOV5_PIPELINE_H_
+#define YOLOV5_PIPELINE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StageOptions
+{
+    int minWorkers{1};     // the autoscaler keeps the stage between these
+    int maxWorkers{1};
+    int batch{1};          // a call gets up to this many of the waiting items
+    bool ordered{false};   // items arrive in push() order, for stages that keep state across frames
+    double maxWaitMs{0.0}; // batch > 1: a batch short of items, or a bucket's, goes out once its oldest waited this long,
+                           // 0: whatever is waiting goes out at once
+};
+
+struct PipelineOptions
+{
+    int maxInFlight{0};    // push() blocks above this, 0: every worker busy plus one waiting item per stage;
+                           // raise it to buckets x batch for bucketed stages to fill their batches
+    int workerBudget{0};   // active workers over all stages, 0: hardware threads
+    double interval{1.0};  // seconds between scaling decisions
+    bool log{true};        // print every decision to std::cout
+};
+
+// Totals of one stage since the pipeline started
+struct StageStats
+{
+    std::string name;
+    int workers{0};        // active now
+    uint64_t items{0};
+    uint64_t batches{0};   // calls of the stage function
+    uint64_t fullBatches{0};
+    double serviceMs{0.0}; // mean time in the stage function per item
+    double queued{0.0};    // mean number of items waiting for a worker
+};
+
+// Runs items through a chain of stages, each with its own workers and an input
+// queue. Every interval the controller looks at what each stage did since the last
+// look: the mean number of items waiting in its queue and how busy its workers
+// were. The stage with the most items waiting gets a worker when it is below its
+// maxWorkers, taken from the idlest stage if the budget is spent, and a stage whose
+// work would fit in one worker less at 70% load gives one up. The numbers of
+// workers settle where the stages keep pace with each other, whatever the image
+// size, model and core count. Every worker thread is created up front; the ones
+// above the active count are parked.
+//
+// A batched stage holds a short batch back until its oldest item has waited maxWaitMs,
+// so batches fill when items arrive a little apart; ordered stages count only the
+// items that follow on without a gap. A bucketed stage only batches items of the same
+// bucket, e.g. inputs that share one padded shape, so a batch of mixed frames is not
+// padded to the largest of them. A bucket goes out as soon as it holds batch items,
+// or short once its oldest item has waited maxWaitMs, in whatever order the buckets fill.
+template <typename T>
+class Pipeline
+{
+public:
+    // gets between 1 and batch items, in sequence order within the call
+    typedef std::function<void(std::vector<T*>& items)> StageFn;
+    typedef std::function<void(std::unique_ptr<T> item)> Sink;
+    typedef std::function<int64_t(const T& item)> BucketFn;
+
+    explicit Pipeline(const PipelineOptions& options = PipelineOptions()) : mOptions(options) {}
+    ~Pipeline() { finish(); }
+
+    void addStage(const std::string& name, StageFn fn, const StageOptions& options = StageOptions()) {
+        addStage(name, std::move(fn), options, BucketFn());
+    }
+
+    // Batches hold items with one bucket(item), the key is read when the item arrives.
+    void addStage(const std::string& name, StageFn fn, const StageOptions& options, BucketFn bucket) {
+        assert(!mStarted);
+        assert(options.minWorkers >= 1 && options.minWorkers <= options.maxWorkers && options.batch >= 1);
+        // more than one worker would hand items on out of order again
+        assert(!options.ordered || options.maxWorkers == 1);
+        // buckets fill in any order
+        assert(!options.ordered || !bucket);
+        mStages.emplace_back(new Stage(name, std::move(fn), options));
+        mStages.back()->bucket = std::move(bucket);
+    }
+
+    // Where items go after the last stage, e.g. back to a free list. Default: destroyed.
+    void setSink(Sink sink) { mSink = std::move(sink); }
+
+    // Starts the workers on the first call.
+    void push(std::unique_ptr<T> item) {
+        if (!mStarted) start();
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDrained.wait(lock, [&] { return mInFlight < mMaxInFlight; });
+        ++mInFlight;
+        lock.unlock();
+        enqueue(0, mPushed++, std::move(item));
+    }
+
+    // Waits until every pushed item has left the last stage and stops the threads.
+    void finish() {
+        if (!mStarted) return;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mDrained.wait(lock, [&] { return mInFlight == 0; });
+            mStop = true;
+        }
+        mTick.notify_all();
+        mController.join();
+        for (auto& stage : mStages) {
+            {
+                std::lock_guard<std::mutex> lock(stage->mutex);
+                stage->stop = true;
+            }
+            stage->ready.notify_all();
+            for (std::thread& t : stage->threads) t.join();
+            stage->threads.clear();
+        }
+        mStarted = false;
+    }
+
+    std::vector<StageStats> stats() const {
+        std::vector<StageStats> out;
+        const double elapsed = seconds(mStart, Clock::now());
+        for (const auto& stage : mStages) {
+            std::lock_guard<std::mutex> lock(stage->mutex);
+            StageStats s;
+            s.name = stage->name;
+            s.workers = stage->active;
+            s.items = stage->items;
+            s.batches = stage->batches;
+            s.fullBatches = stage->fullBatches;
+            s.serviceMs = stage->items ? stage->busy * 1e3 / stage->items : 0.0;
+            s.queued = elapsed > 0.0 ? (stage->queueArea + stage->queue.size() * seconds(stage->queueTime, Clock::now())) / elapsed : 0.0;
+            out.push_back(s);
+        }
+        return out;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stage
+    {
+        Stage(const std::string& n, StageFn f, const StageOptions& o) : name(n), fn(std::move(f)), options(o), active(o.minWorkers) {}
+
+        std::string name;
+        StageFn fn;
+        StageOptions options;
+
+        mutable std::mutex mutex;
+        std::condition_variable ready;
+        std::map<uint64_t, std::unique_ptr<T>> queue;  // by sequence number, the oldest first
+        uint64_t next{0};                              // ordered: the sequence number to hand out next
+        BucketFn bucket;                               // empty: batches in sequence order
+        // bucketed: the sequence numbers in queue per bucket with their arrival, the oldest first
+        std::map<int64_t, std::deque<std::pair<uint64_t, Clock::time_point>>> buckets;
+        std::map<uint64_t, Clock::time_point> arrived;  // unbucketed: arrival of every item in queue
+        int active;
+        bool stop{false};
+        std::vector<std::thread> threads;
+
+        // totals, under mutex
+        uint64_t items{0};
+        uint64_t batches{0}, fullBatches{0};
+        double busy{0.0};       // seconds inside fn, over all workers
+        double queueArea{0.0};  // integral of the queue length over time
+        Clock::time_point queueTime;
+
+        // controller's values at its last look
+        uint64_t lastItems{0};
+        double lastBusy{0.0}, lastArea{0.0};
+
+        // integrates the queue length up to now, call before it changes
+        void account(Clock::time_point now) {
+            queueArea += queue.size() * seconds(queueTime, now);
+            queueTime = now;
+        }
+        Clock::duration maxWait() const {
+            return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(options.maxWaitMs));
+        }
+        // unbucketed: whether the item at the head of the queue may be handed out
+        bool headReady() const {
+            return !queue.empty() && (!options.ordered || queue.begin()->first == next);
+        }
+        // unbucketed: the oldest item in queue arrived at
+        Clock::time_point oldest() const {
+            Clock::time_point first = Clock::time_point::max();
+            for (const auto& a : arrived) first = std::min(first, a.second);
+            return first;
+        }
+        // Whether a batch can go out now: a full one, or a short one whose oldest item is
+        // due. For a bucketed stage key is the bucket, a full one or else a due one, the
+        // one waiting longest first.
+        bool available(Clock::time_point now, int64_t* key = nullptr) const {
+            const Clock::duration wait = maxWait();
+            if (!bucket) {
+                if (!headReady()) return false;
+                if (options.batch == 1 || options.maxWaitMs <= 0.0) return true;
+                // ordered: only the run that follows on from next can go out
+                int run = 0;
+                for (auto it = queue.begin(); it != queue.end() && run < options.batch; ++it, ++run) {
+                    if (options.ordered && it->first != next + run) break;
+                }
+                return run >= options.batch || oldest() + wait <= now;
+            }
+            auto best = buckets.end();
+            for (auto it = buckets.begin(); it != buckets.end(); ++it) {
+                const bool full = (int)it->second.size() >= options.batch;
+                if (!full && it->second.front().second + wait > now) continue;
+                if (best == buckets.end()) {
+                    best = it;
+                } else {
+                    const bool bestFull = (int)best->second.size() >= options.batch;
+                    if (full != bestFull ? full : it->second.front().second < best->second.front().second) best = it;
+                }
+            }
+            if (best == buckets.end()) return false;
+            if (key) *key = best->first;
+            return true;
+        }
+        // when the longest waiting batch or bucket is due, max() if none is waiting
+        Clock::time_point deadline() const {
+            if (!bucket) {
+                if (queue.empty() || options.batch == 1 || options.maxWaitMs <= 0.0) return Clock::time_point::max();
+                return oldest() + maxWait();
+            }
+            Clock::time_point due = Clock::time_point::max();
+            for (const auto& b : buckets) due = std::min(due, b.second.front().second + maxWait());
+            return due;
+        }
+    };
+
+    static double seconds(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double>(to - from).count();
+    }
+
+    void start() {
+        assert(!mStages.empty());
+        int slots = 0;
+        for (const auto& stage : mStages) slots += stage->options.maxWorkers * stage->options.batch + 1;
+        mMaxInFlight = mOptions.maxInFlight > 0 ? mOptions.maxInFlight : slots;
+        mBudget = mOptions.workerBudget > 0 ? mOptions.workerBudget : std::max(1, (int)std::thread::hardware_concurrency());
+        mStart = Clock::now();
+        mStop = false;
+        mPushed = 0;
+        for (size_t s = 0; s < mStages.size(); ++s) {
+            Stage& stage = *mStages[s];
+            stage.queueTime = mStart;
+            stage.stop = false;
+            for (int i = 0; i < stage.options.maxWorkers; ++i) {
+                stage.threads.emplace_back(&Pipeline::workerLoop, this, s, i);
+            }
+        }
+        mController = std::thread(&Pipeline::controllerLoop, this);
+        mStarted = true;
+    }
+
+    void enqueue(size_t s, uint64_t seq, std::unique_ptr<T> item) {
+        if (s == mStages.size()) {
+            if (mSink) mSink(std::move(item));
+            item.reset();
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mInFlight;
+            mDrained.notify_all();
+            return;
+        }
+        Stage& stage = *mStages[s];
+        {
+            std::lock_guard<std::mutex> lock(stage.mutex);
+            const Clock::time_point now = Clock::now();
+            stage.account(now);
+            if (stage.bucket) {
+                stage.buckets[stage.bucket(*item)].emplace_back(seq, now);
+            } else {
+                stage.arrived[seq] = now;
+            }
+            stage.queue[seq] = std::move(item);
+        }
+        // parked workers wait on the same condition, wake all so an active one runs
+        stage.ready.notify_all();
+    }
+
+    void workerLoop(size_t s, int index) {
+        Stage& stage = *mStages[s];
+        std::vector<uint64_t> seqs;
+        std::vector<std::unique_ptr<T>> owned;
+        std::vector<T*> items;
+        std::unique_lock<std::mutex> lock(stage.mutex);
+        while (true) {
+            int64_t key = 0;
+            while (!stage.stop && !(index < stage.active && stage.available(Clock::now(), &key))) {
+                // a bucket short of a batch wakes its worker when it is due
+                const Clock::time_point due = index < stage.active ? stage.deadline() : Clock::time_point::max();
+                if (due == Clock::time_point::max()) {
+                    stage.ready.wait(lock);
+                } else {
+                    stage.ready.wait_until(lock, due);
+                }
+            }
+            if (stage.stop) break;
+            stage.account(Clock::now());
+            seqs.clear();
+            owned.clear();
+            if (stage.bucket) {
+                auto& waiting = stage.buckets[key];
+                while ((int)owned.size() < stage.options.batch && !waiting.empty()) {
+                    auto it = stage.queue.find(waiting.front().first);
+                    seqs.push_back(it->first);
+                    owned.push_back(std::move(it->second));
+                    stage.queue.erase(it);
+                    waiting.pop_front();
+                }
+                if (waiting.empty()) stage.buckets.erase(key);
+            } else {
+                // the batch is due, take what follows on even if it is short
+                while ((int)owned.size() < stage.options.batch && stage.headReady()) {
+                    auto it = stage.queue.begin();
+                    seqs.push_back(it->first);
+                    owned.push_back(std::move(it->second));
+                    stage.arrived.erase(it->first);
+                    stage.queue.erase(it);
+                    if (stage.options.ordered) ++stage.next;
+                }
+            }
+            lock.unlock();
+
+            items.clear();
+            for (auto& item : owned) items.push_back(item.get());
+            const Clock::time_point begin = Clock::now();
+            stage.fn(items);
+            const double took = seconds(begin, Clock::now());
+            for (size_t i = 0; i < owned.size(); ++i) enqueue(s + 1, seqs[i], std::move(owned[i]));
+
+            lock.lock();
+            stage.busy += took;
+            stage.items += seqs.size();
+            ++stage.batches;
+            if ((int)seqs.size() == stage.options.batch) ++stage.fullBatches;
+            // an ordered stage may have been waiting on an item another worker held
+            if (stage.available(Clock::now())) stage.ready.notify_all();
+        }
+    }
+
+    void controllerLoop() {
+        Clock::time_point last = Clock::now();
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStop) {
+            mTick.wait_for(lock, std::chrono::duration<double>(mOptions.interval), [&] { return mStop; });
+            if (mStop) break;
+            const Clock::time_point now = Clock::now();
+            const double window = seconds(last, now);
+            last = now;
+            lock.unlock();
+            rebalance(window, now);
+            lock.lock();
+        }
+    }
+
+    struct Window
+    {
+        double queued;   // mean items waiting
+        double load;     // mean busy workers
+        double serviceMs;
+        int active;
+    };
+
+    void rebalance(double window, Clock::time_point now) {
+        std::vector<Window> w(mStages.size());
+        int total = 0;
+        for (size_t s = 0; s < mStages.size(); ++s) {
+            Stage& stage = *mStages[s];
+            std::lock_guard<std::mutex> lock(stage.mutex);
+            stage.account(now);
+            const uint64_t items = stage.items - stage.lastItems;
+            w[s].queued = (stage.queueArea - stage.lastArea) / window;
+            w[s].load = (stage.busy - stage.lastBusy) / window;
+            w[s].serviceMs = items ? (stage.busy - stage.lastBusy) * 1e3 / items : 0.0;
+            w[s].active = stage.active;
+            stage.lastItems = stage.items;
+            stage.lastBusy = stage.busy;
+            stage.lastArea = stage.queueArea;
+            total += stage.active;
+        }
+
+        // the bottleneck: the stage with the most items waiting, at least one on average
+        int grow = -1;
+        for (size_t s = 0; s < mStages.size(); ++s) {
+            if (w[s].queued >= 1.0 && (grow < 0 || w[s].queued > w[grow].queued)) grow = (int)s;
+        }
+        if (grow >= 0 && w[grow].active < mStages[grow]->options.maxWorkers) {
+            if (total >= mBudget) {
+                // out of budget, move a worker over from the idlest stage that can spare one
+                int donor = -1;
+                for (size_t s = 0; s < mStages.size(); ++s) {
+                    if ((int)s == grow || w[s].active <= mStages[s]->options.minWorkers) continue;
+                    if (donor < 0 || w[s].load / w[s].active < w[donor].load / w[donor].active) donor = (int)s;
+                }
+                if (donor >= 0 && w[donor].load < w[donor].active - 1) {
+                    setActive(donor, w[donor].active - 1, w[donor], "budget");
+                    --w[donor].active;
+                    --total;
+                }
+            }
+            if (total < mBudget) {
+                setActive(grow, w[grow].active + 1, w[grow], "backlog");
+                ++total;
+            }
+        } else {
+            grow = -1;
+        }
+
+        // a stage that just grew is left alone this round
+        for (size_t s = 0; s < mStages.size(); ++s) {
+            if ((int)s == grow || w[s].active <= mStages[s]->options.minWorkers) continue;
+            if (w[s].queued < 0.5 && w[s].load <= 0.7 * (w[s].active - 1)) {
+                setActive((int)s, w[s].active - 1, w[s], "idle");
+            }
+        }
+    }
+
+    void setActive(int s, int workers, const Window& w, const char* reason) {
+        Stage& stage = *mStages[s];
+        int from;
+        {
+            std::lock_guard<std::mutex> lock(stage.mutex);
+            from = stage.active;
+            stage.active = workers;
+        }
+        stage.ready.notify_all();
+        if (mOptions.log) {
+            std::ostringstream line;
+            line.setf(std::ios::fixed);
+            line.precision(1);
+            line << "pipeline: " << stage.name << " " << from << " -> " << workers << " workers (" << reason << "), "
+                 << w.queued << " queued, " << w.serviceMs << " ms per item, " << (int)(w.load * 100 / from) << "% busy";
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    PipelineOptions mOptions;
+    std::vector<std::unique_ptr<Stage>> mStages;
+    Sink mSink;
+    bool mStarted{false};
+    int mMaxInFlight{0};
+    int mBudget{0};
+    uint64_t mPushed{0};
+    Clock::time_point mStart;
+
+    std::mutex mMutex;
+    std::condition_variable mDrained;
+    std::condition_variable mTick;
+    int mInFlight{0};
+    bool mStop{false};
+    std::thread mController;
+};
+
+#endif
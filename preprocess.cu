@@ -0,0 +1,23 @@
+#include "preprocess.h"
+
+__global__ void U8HwcToFloatChwKer(const uint8_t* src, float* dst, int area, int numElem) {
+    int idx = threadIdx.x + blockIdx.x * blockDim.x;
+    if (idx >= numElem)
+        return;
+
+    // one thread per pixel: read 3 adjacent bytes, write 3 planes
+    int b = idx / area;
+    int pix = idx - b * area;
+    const uint8_t* in = src + (size_t)idx * 3;
+    float* out = dst + (size_t)b * 3 * area + pix;
+    out[0] = in[0];
+    out[area] = in[1];
+    out[2 * area] = in[2];
+}
+
+void u8HwcToFloatChw(const uint8_t* src, float* dst, int batch, int h, int w, cudaStream_t stream) {
+    const int threadCount = 256;
+    int numElem = batch * h * w;
+    U8HwcToFloatChwKer<<<(numElem + threadCount - 1) / threadCount, threadCount, 0, stream>>>
+        (src, dst, h * w, numElem);
+}
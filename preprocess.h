@@ -0,0 +1,12 @@
+#ifndef YOLOV5_PREPROCESS_H_
+#define YOLOV5_PREPROCESS_H_
+
+#include <cstdint>
+#include <cuda_runtime_api.h>
+
+// Widens batch interleaved (HWC) uint8 frames of h x w x 3 to planar float on the
+// device, keeping the BGR order and the [0, 255] range. Used with engines built
+// with foldInputNormalization(), so only a quarter of the bytes cross PCIe.
+void u8HwcToFloatChw(const uint8_t* src, float* dst, int batch, int h, int w, cudaStream_t stream);
+
+#endif
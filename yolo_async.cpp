@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "async_detect.h"
+#include "common.hpp"
+#include "cpu_backend.h"
+
+#if !defined(__cpp_impl_coroutine)
+#error "yolo_async needs C++20 coroutines, build it with -std=c++20"
+#endif
+
+#define NMS_THRESH 0.4
+#define CONF_THRESH 0.5
+
+// Many concurrent clients on a few threads: --concurrency coroutines each loop on
+// co_await session.detect(image) over the images of a directory until --requests
+// are served, on an Executor of --threads threads. The session batches whatever is
+// pending, up to --batch, and runs it on the CPU backend from its poller thread.
+
+struct AsyncOptions
+{
+    std::string source;           // directory of images
+    std::string wtsDir{".."};     // where yolov5<model>.wts live
+    char model{'s'};
+    int size{640};                // square letterbox, so any requests batch together
+    Cpu::Precision precision{Cpu::Precision::kFP32};
+    int requests{1000};
+    int concurrency{256};         // clients awaiting at once
+    int threads{2};               // executor threads
+    int batch{8};
+    std::string json;
+};
+
+static void usage() {
+    std::cerr << "./yolo_async [options] images" << std::endl;
+    std::cerr << "  images                directory of images the clients send" << std::endl;
+    std::cerr << "  --model m             s, m, l or x (s)" << std::endl;
+    std::cerr << "  --wts-dir dir         where yolov5<model>.wts are (..)" << std::endl;
+    std::cerr << "  --size n              letterbox side, a multiple of 32 (640)" << std::endl;
+    std::cerr << "  --precision p         fp32, fp16 or bf16 (fp32)" << std::endl;
+    std::cerr << "  --requests n          detections to serve in total (1000)" << std::endl;
+    std::cerr << "  --concurrency n       clients with a request in flight (256)" << std::endl;
+    std::cerr << "  --threads n           executor threads that run the clients (2)" << std::endl;
+    std::cerr << "  --batch n             most requests per inference (8)" << std::endl;
+    std::cerr << "  --json file           write the results" << std::endl;
+}
+
+static bool parseArgs(int argc, char** argv, AsyncOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a.compare(0, 2, "--") != 0) {
+            if (!opt.source.empty()) return false;
+            opt.source = a;
+            continue;
+        }
+        if (i + 1 == argc) return false;
+        std::string v = argv[++i];
+        if (a == "--model") {
+            Cpu::ModelSpec spec;
+            if (v.size() != 1 || !Cpu::getModelSpec(v[0], spec)) return false;
+            opt.model = v[0];
+        } else if (a == "--wts-dir") {
+            opt.wtsDir = v;
+        } else if (a == "--size") {
+            opt.size = atoi(v.c_str());
+        } else if (a == "--precision") {
+            if (!Cpu::parsePrecision(v, opt.precision)) return false;
+        } else if (a == "--requests") {
+            opt.requests = atoi(v.c_str());
+        } else if (a == "--concurrency") {
+            opt.concurrency = atoi(v.c_str());
+        } else if (a == "--threads") {
+            opt.threads = atoi(v.c_str());
+        } else if (a == "--batch") {
+            opt.batch = atoi(v.c_str());
+        } else if (a == "--json") {
+            opt.json = v;
+        } else {
+            return false;
+        }
+    }
+    return !opt.source.empty() && opt.size > 0 && opt.size % 32 == 0 && opt.requests > 0 && opt.concurrency > 0 &&
+           opt.threads > 0 && opt.batch > 0;
+}
+
+// Shared by the clients: which request is next and how long each took
+struct Clients
+{
+    std::atomic<int> next{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    int running{0};
+    std::vector<double> latencies;
+    long long boxes{0};
+};
+
+static Task<void> client(Executor& executor, DetectSession<cv::Mat>& session, const std::vector<cv::Mat>& images,
+                         int requests, Clients& clients) {
+    // off the spawning thread before the first request
+    co_await executor.schedule();
+    for (int k = clients.next++; k < requests; k = clients.next++) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Yolo::Detection> res = co_await session.detect(images[k % images.size()]);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(clients.mutex);
+        clients.latencies.push_back(ms);
+        clients.boxes += res.size();
+    }
+    std::lock_guard<std::mutex> lock(clients.mutex);
+    if (--clients.running == 0) clients.finished.notify_all();
+}
+
+static double percentileOf(std::vector<double>& v, double p) {
+    if (v.empty()) return 0.0;
+    size_t i = std::min(v.size() - 1, (size_t)(p / 100.0 * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+int main(int argc, char** argv) {
+    AsyncOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return -1;
+    }
+    std::vector<std::string> files;
+    std::vector<cv::Mat> images;
+    if (read_files_in_dir(opt.source.c_str(), files) == 0) {
+        std::sort(files.begin(), files.end());
+        for (const std::string& f : files) {
+            cv::Mat img = cv::imread(opt.source + "/" + f);
+            if (!img.empty()) images.push_back(img);
+        }
+    }
+    if (images.empty()) {
+        std::cerr << "no images in " << opt.source << std::endl;
+        return -1;
+    }
+
+    Cpu::ModelSpec spec;
+    Cpu::getModelSpec(opt.model, spec);
+    Cpu::NetworkOptions options;
+    options.precision = opt.precision;
+    options.cacheDir = ".";
+    options.inputH = opt.size;
+    options.inputW = opt.size;
+    Cpu::Network net(spec, opt.wtsDir + "/" + spec.name + ".wts", options);
+
+    // letterboxes the batch into one buffer, runs it and decodes the boxes, all on
+    // the poller thread; the network is its own thread pool
+    const int size = opt.size;
+    std::vector<uint8_t> input;
+    std::vector<float> prob;
+    auto launch = [&](std::vector<DetectRequest<cv::Mat>*>& batch, std::function<void()> done) {
+        const size_t volume = 3 * size * size;
+        input.resize(batch.size() * volume);
+        prob.resize(batch.size() * Yolo::OUTPUT_SIZE);
+        for (size_t b = 0; b < batch.size(); ++b) {
+            cv::Mat img = *batch[b]->frame;  // a header, the pixels are shared
+            cv::Mat pr_img = preprocess_img(img, size, size);
+            for (int row = 0; row < size; ++row) {
+                memcpy(&input[b * volume + row * size * 3], pr_img.ptr(row), size * 3);
+            }
+        }
+        net.infer(input.data(), Cpu::PixelLayout::kINTERLEAVED, size, size, prob.data(), batch.size());
+        for (size_t b = 0; b < batch.size(); ++b) {
+            std::vector<Yolo::Detection> res;
+            nms(res, &prob[b * Yolo::OUTPUT_SIZE], CONF_THRESH, NMS_THRESH);
+            cv::Mat img = *batch[b]->frame;
+            for (Yolo::Detection& det : res) {
+                cv::Rect r = get_rect(img, det.bbox, size, size);
+                det.bbox[0] = r.x + r.width / 2.0f;
+                det.bbox[1] = r.y + r.height / 2.0f;
+                det.bbox[2] = r.width;
+                det.bbox[3] = r.height;
+            }
+            batch[b]->result = std::move(res);
+        }
+        done();
+    };
+
+    Clients clients;
+    clients.running = opt.concurrency;
+    const auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    uint64_t batches = 0;
+    {
+        Executor executor(opt.threads);
+        DetectSession<cv::Mat> session(executor, launch, opt.batch);
+        for (int c = 0; c < opt.concurrency; ++c) spawn(client(executor, session, images, opt.requests, clients));
+        std::unique_lock<std::mutex> lock(clients.mutex);
+        clients.finished.wait(lock, [&] { return clients.running == 0; });
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        batches = session.batches();
+    }
+
+    const int served = clients.latencies.size();
+    const double p50 = percentileOf(clients.latencies, 50.0);
+    const double p99 = percentileOf(clients.latencies, 99.0);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << served << " requests from " << opt.concurrency << " clients on " << opt.threads
+              << " executor threads + 1 poller + " << net.threads() << " network threads" << std::endl;
+    std::cout << served / seconds << " requests/s, " << (double)served / std::max<uint64_t>(batches, 1)
+              << " per batch, latency p50 " << p50 << " ms, p99 " << p99 << " ms, " << clients.boxes << " boxes"
+              << std::endl;
+
+    if (!opt.json.empty()) {
+        std::ofstream out(opt.json);
+        out << std::setprecision(6);
+        out << "{\"model\": \"yolov5" << opt.model << "\", \"size\": " << opt.size << ", \"precision\": \""
+            << Cpu::precisionName(opt.precision) << "\", \"concurrency\": " << opt.concurrency
+            << ", \"executor_threads\": " << opt.threads << ", \"network_threads\": " << net.threads()
+            << ", \"requests\": " << served << ", \"batches\": " << batches << ", \"seconds\": " << seconds
+            << ", \"requests_per_s\": " << served / seconds << ", \"p50_ms\": " << p50 << ", \"p99_ms\": " << p99
+            << "}\n";
+    }
+    return 0;
+}
@@ -0,0 +1,540 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "cpu_kernels.h"
+#include "nvdsinfer_custom_impl.h"
+
+// Microbenchmarks of the host side hot paths: NMS and IoU, letterboxing, box
+// mapping, .wts loading, the CPU decode and the DeepStream bbox parsers. Every
+// benchmark runs for each combination of the --boxes, --classes, --sizes and
+// --threads values that applies to it; with n threads, n copies run concurrently
+// on private inputs, as n DeepStream sources parse at once. Results go to stdout
+// and, with --json, to a file bench_compare.py checks against a baseline.
+
+struct BenchOptions
+{
+    std::vector<int> boxes{100, 1000};
+    std::vector<int> classes{80};
+    std::vector<std::pair<int, int>> sizes{{480, 640}, {1080, 1920}};  // HxW
+    std::vector<int> threads{1};
+    double minTime{0.2};  // seconds per repetition
+    int repetitions{5};
+    std::string filter;
+    std::string json;
+    std::string prob;   // captured "prob" blobs instead of synthetic boxes
+    std::string image;  // captured frame instead of noise for preprocess_img
+    std::string wts;    // captured .wts instead of a synthetic one for loadWeights
+    std::string dsLib;  // libnvdsinfer_custom_impl_Yolo.so for the ds_* benchmarks
+};
+
+// One benchmark at one parameter point. setup(thread) builds that thread's inputs
+// outside the timed region and returns the operation to time.
+struct Benchmark
+{
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> params;
+    std::function<std::function<void()>(int)> setup;
+
+    std::string key(int threads) const {
+        std::string k = name;
+        for (const auto& p : params) k += "/" + p.first + ":" + p.second;
+        return k + "/threads:" + std::to_string(threads);
+    }
+};
+
+struct BenchResult
+{
+    std::string key;
+    const Benchmark* bench;
+    int threads;
+    long iterations;
+    double medianNs;
+    double minNs;
+    double meanNs;
+};
+
+// Wall time of iterations calls of every thread's operation, all threads started together.
+static double timeRun(const std::vector<std::function<void()>>& ops, long iterations) {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < ops.size(); ++t) {
+        workers.emplace_back([&, t]() {
+            ready++;
+            while (!go.load(std::memory_order_acquire)) {}
+            for (long i = 0; i < iterations; ++i) ops[t]();
+        });
+    }
+    while (ready.load() + 1 < (int)ops.size()) {}
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (long i = 0; i < iterations; ++i) ops[0]();
+    for (auto& w : workers) w.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static BenchResult runBenchmark(const Benchmark& b, int threads, const BenchOptions& opt) {
+    std::vector<std::function<void()>> ops;
+    for (int t = 0; t < threads; ++t) ops.push_back(b.setup(t));
+    // grow the iteration count until a run is long enough to time, then size the
+    // repetitions for minTime
+    long iterations = 1;
+    double elapsed = timeRun(ops, iterations);
+    while (elapsed < 0.01 && iterations < (1L << 30)) {
+        iterations *= 10;
+        elapsed = timeRun(ops, iterations);
+    }
+    iterations = std::max(1L, (long)(iterations * opt.minTime / elapsed));
+    std::vector<double> ns;
+    for (int r = 0; r < opt.repetitions; ++r) ns.push_back(timeRun(ops, iterations) * 1e9 / iterations);
+    std::sort(ns.begin(), ns.end());
+    double sum = 0.0;
+    for (double v : ns) sum += v;
+    return BenchResult{b.key(threads), &b, threads, iterations, ns[ns.size() / 2], ns[0], sum / ns.size()};
+}
+
+// Synthetic "prob" blob: boxes detections in clusters of 4 overlapping boxes, as a
+// real object draws several anchors, so NMS has work to do.
+static std::vector<float> makeProb(int boxes, int classes, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(0.0f, (float)Yolo::INPUT_W), size(16.0f, 200.0f), jitter(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> conf(0.3f, 1.0f);
+    std::vector<float> prob(Yolo::OUTPUT_SIZE, 0.0f);
+    boxes = std::min(boxes, Yolo::MAX_OUTPUT_BBOX_COUNT);
+    Yolo::PackedDetection* dets = reinterpret_cast<Yolo::PackedDetection*>(&prob[1]);
+    Yolo::Detection d;
+    for (int i = 0; i < boxes; ++i) {
+        if (i % 4 == 0) {
+            d.bbox[0] = pos(rng);
+            d.bbox[1] = pos(rng);
+            d.bbox[2] = size(rng);
+            d.bbox[3] = size(rng);
+            d.class_id = (float)(rng() % classes);
+        }
+        Yolo::Detection j = d;
+        for (int k = 0; k < Yolo::LOCATIONS; ++k) j.bbox[k] += jitter(rng);
+        j.conf = conf(rng);
+        dets[i] = Yolo::packDetection(j);
+    }
+    prob[0] = (float)boxes;
+    return prob;
+}
+
+// Captured blobs: packed (Yolo::OUTPUT_SIZE floats per image) or legacy float records.
+static std::vector<std::vector<float>> loadProb(const std::string& file) {
+    std::ifstream in(file, std::ios::binary);
+    std::vector<float> all;
+    float v;
+    while (in.read(reinterpret_cast<char*>(&v), sizeof(v))) all.push_back(v);
+    std::vector<std::vector<float>> blobs;
+    if (!all.empty() && all.size() % Yolo::OUTPUT_SIZE == 0) {
+        for (size_t o = 0; o < all.size(); o += Yolo::OUTPUT_SIZE) {
+            blobs.emplace_back(all.begin() + o, all.begin() + o + Yolo::OUTPUT_SIZE);
+        }
+    } else if (!all.empty() && all.size() % Yolo::LEGACY_OUTPUT_SIZE == 0) {
+        for (size_t o = 0; o < all.size(); o += Yolo::LEGACY_OUTPUT_SIZE) {
+            blobs.emplace_back(Yolo::OUTPUT_SIZE);
+            Yolo::packLegacyOutput(&all[o], blobs.back().data());
+        }
+    }
+    return blobs;
+}
+
+// Raw detection heads at the three yolov5 strides with boxes cells over the
+// objectness threshold, spread over the heads by area.
+struct RawHeads
+{
+    std::vector<int> grids;
+    std::vector<std::vector<float>> data;  // CHECK_COUNT * (5 + classes) x grid x grid
+};
+
+static RawHeads makeHeads(int boxes, int classes, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> logit(0.0f, 1.0f);
+    RawHeads h;
+    h.grids = {Yolo::INPUT_W / 32, Yolo::INPUT_W / 16, Yolo::INPUT_W / 8};
+    int totalCells = 0;
+    for (int g : h.grids) totalCells += Yolo::CHECK_COUNT * g * g;
+    for (int g : h.grids) {
+        const int area = g * g, infoLen = 5 + classes;
+        std::vector<float> head((size_t)Yolo::CHECK_COUNT * infoLen * area);
+        for (auto& v : head) v = logit(rng);
+        int hits = (int)((long)boxes * Yolo::CHECK_COUNT * area / totalCells);
+        for (int k = 0; k < Yolo::CHECK_COUNT; ++k) {
+            float* obj = &head[((size_t)k * infoLen + 4) * area];
+            for (int i = 0; i < area; ++i) obj[i] = -8.0f;
+        }
+        for (int n = 0; n < hits; ++n) {
+            int k = rng() % Yolo::CHECK_COUNT, i = rng() % area;
+            head[((size_t)k * infoLen + 4) * area + i] = 2.0f;
+        }
+        h.data.push_back(head);
+    }
+    return h;
+}
+
+static std::string writeSyntheticWts(size_t floats) {
+    char path[] = "/tmp/yolo_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return std::string();
+    close(fd);
+    std::ofstream out(path);
+    std::mt19937 rng(0);
+    const int blobs = 64;
+    out << blobs << "\n";
+    for (int b = 0; b < blobs; ++b) {
+        size_t n = floats / blobs;
+        out << "blob" << b << " " << n;
+        for (size_t i = 0; i < n; ++i) {
+            float v = (float)(rng() % 2001) / 1000.0f - 1.0f;
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            out << " " << std::hex << bits << std::dec;
+        }
+        out << "\n";
+    }
+    return path;
+}
+
+static NvDsInferLayerInfo layerInfo(const char* name, float* buffer, unsigned c, unsigned h, unsigned w) {
+    NvDsInferLayerInfo l;
+    memset(&l, 0, sizeof(l));
+    l.dataType = FLOAT;
+    l.inferDims.numDims = 3;
+    l.inferDims.d[0] = c;
+    l.inferDims.d[1] = h;
+    l.inferDims.d[2] = w;
+    l.inferDims.numElements = c * h * w;
+    l.layerName = name;
+    l.buffer = buffer;
+    return l;
+}
+
+// wts: the .wts file loadWeights reads, captured or synthetic. main() fills it in
+// once every input has been checked, so a bad argument leaves no temporary behind.
+static std::vector<Benchmark> makeBenchmarks(const BenchOptions& opt, std::shared_ptr<const std::string> wts) {
+    std::vector<Benchmark> benches;
+    auto P = [](const std::string& k, int v) { return std::make_pair(k, std::to_string(v)); };
+    std::shared_ptr<std::vector<std::vector<float>>> captured;
+    if (!opt.prob.empty()) {
+        captured = std::make_shared<std::vector<std::vector<float>>>(loadProb(opt.prob));
+        if (captured->empty()) {
+            std::cerr << "no " << Yolo::OUTPUT_SIZE << " or " << Yolo::LEGACY_OUTPUT_SIZE
+                      << " float blobs in " << opt.prob << std::endl;
+            exit(-1);
+        }
+        benches.push_back({"nms", {{"input", "captured"}}, [captured](int) {
+            auto res = std::make_shared<std::vector<Yolo::Detection>>();
+            auto blobs = std::make_shared<std::vector<std::vector<float>>>(*captured);
+            auto next = std::make_shared<size_t>(0);
+            return [res, blobs, next]() {
+                res->clear();
+                nms(*res, (*blobs)[(*next)++ % blobs->size()].data(), 0.5f, 0.4f);
+            };
+        }});
+    }
+
+    for (int boxes : opt.boxes) {
+        for (int classes : opt.classes) {
+            benches.push_back({"nms", {P("boxes", boxes), P("classes", classes)}, [=](int t) {
+                auto prob = std::make_shared<std::vector<float>>(makeProb(boxes, classes, 100 + t));
+                auto res = std::make_shared<std::vector<Yolo::Detection>>();
+                return [prob, res]() {
+                    res->clear();
+                    nms(*res, prob->data(), 0.5f, 0.4f);
+                };
+            }});
+        }
+        // boxes pairs per op, so the call overhead is amortized as in nms
+        benches.push_back({"iou", {P("boxes", boxes)}, [=](int t) {
+            auto prob = std::make_shared<std::vector<float>>(makeProb(boxes, 1, 200 + t));
+            auto sink = std::make_shared<float>(0.0f);
+            return [prob, sink, boxes]() {
+                const Yolo::PackedDetection* d = reinterpret_cast<const Yolo::PackedDetection*>(prob->data() + 1);
+                float s = 0.0f;
+                for (int i = 1; i < boxes; ++i) s += iou(d[i - 1], d[i]);
+                *sink += s;
+            };
+        }});
+        for (int classes : opt.classes) {
+            benches.push_back({"cpu_decode", {P("boxes", boxes), P("classes", classes)}, [=](int t) {
+                auto heads = std::make_shared<RawHeads>(makeHeads(boxes, classes, 300 + t));
+                auto out = std::make_shared<std::vector<float>>(Yolo::OUTPUT_SIZE);
+                static const float anchors[3][Yolo::CHECK_COUNT * 2] = {
+                    {116, 90, 156, 198, 373, 326}, {30, 61, 62, 45, 59, 119}, {10, 13, 16, 30, 33, 23}};
+                return [heads, out, classes]() {
+                    (*out)[0] = 0;
+                    for (size_t i = 0; i < heads->grids.size(); ++i) {
+                        int g = heads->grids[i];
+                        Cpu::decodeYolo(heads->data[i].data(), g, g, anchors[i], classes,
+                                        Yolo::INPUT_W, Yolo::INPUT_H, out->data());
+                    }
+                };
+            }});
+        }
+    }
+
+    benches.push_back({"get_rect", {P("boxes", Yolo::MAX_OUTPUT_BBOX_COUNT)}, [](int t) {
+        auto prob = std::make_shared<std::vector<float>>(makeProb(Yolo::MAX_OUTPUT_BBOX_COUNT, 80, 400 + t));
+        auto dets = std::make_shared<std::vector<Yolo::Detection>>();
+        const Yolo::PackedDetection* d = reinterpret_cast<const Yolo::PackedDetection*>(prob->data() + 1);
+        for (int i = 0; i < Yolo::MAX_OUTPUT_BBOX_COUNT; ++i) dets->push_back(Yolo::unpackDetection(d[i]));
+        auto img = std::make_shared<cv::Mat>(1080, 1920, CV_8UC3);
+        auto sink = std::make_shared<int>(0);
+        return [dets, img, sink]() {
+            for (auto& det : *dets) *sink += get_rect(*img, det.bbox).width;
+        };
+    }});
+
+    std::vector<std::pair<int, int>> sizes = opt.sizes;
+    cv::Mat capturedImage;
+    if (!opt.image.empty()) {
+        capturedImage = cv::imread(opt.image);
+        if (capturedImage.empty()) {
+            std::cerr << "cannot read " << opt.image << std::endl;
+            exit(-1);
+        }
+        sizes = {{capturedImage.rows, capturedImage.cols}};
+    }
+    for (const auto& hw : sizes) {
+        std::string size = std::to_string(hw.first) + "x" + std::to_string(hw.second);
+        benches.push_back({"preprocess_img", {{"size", size}}, [=](int t) {
+            auto img = std::make_shared<cv::Mat>();
+            if (!capturedImage.empty()) {
+                *img = capturedImage.clone();
+            } else {
+                *img = cv::Mat(hw.first, hw.second, CV_8UC3);
+                cv::randu(*img, cv::Scalar::all(0), cv::Scalar::all(255));
+            }
+            return [img]() { preprocess_img(*img); };
+        }});
+    }
+
+    benches.push_back({"loadWeights", {{"input", opt.wts.empty() ? "synthetic_1M" : "captured"}}, [wts](int) {
+        return [wts]() {
+            auto weightMap = loadWeights(*wts);
+            for (auto& w : weightMap) free((void*)(w.second.values));
+        };
+    }});
+
+    if (opt.dsLib.empty()) return benches;
+    // resolved from the library nvinfer loads, so the parsers run as they do in DeepStream
+    void* lib = dlopen(opt.dsLib.c_str(), RTLD_NOW);
+    if (!lib) {
+        std::cerr << "cannot load " << opt.dsLib << ": " << dlerror() << std::endl;
+        exit(-1);
+    }
+    auto parser = [lib](const char* name) {
+        NvDsInferParseCustomFunc f = reinterpret_cast<NvDsInferParseCustomFunc>(dlsym(lib, name));
+        if (!f) {
+            std::cerr << "no " << name << " in the DeepStream library" << std::endl;
+            exit(-1);
+        }
+        return f;
+    };
+    NvDsInferParseCustomFunc yoloV5 = parser("NvDsInferParseCustomYoloV5");
+    NvDsInferParseCustomFunc yoloV5Dbscan = parser("NvDsInferParseCustomYoloV5Dbscan");
+    NvDsInferParseCustomFunc yoloV4 = parser("NvDsInferParseCustomYoloV4");
+    NvDsInferParseCustomFunc yoloV3 = parser("NvDsInferParseCustomYoloV3");
+
+    // inputs and outputs of one parse call, owned per thread
+    struct ParseCall
+    {
+        std::vector<std::vector<float>> buffers;
+        std::vector<NvDsInferLayerInfo> layers;
+        NvDsInferNetworkInfo network{(unsigned)Yolo::INPUT_W, (unsigned)Yolo::INPUT_H, 3};
+        NvDsInferParseDetectionParams params;
+        std::vector<NvDsInferObjectDetectionInfo> objects;
+    };
+    auto bind = [](NvDsInferParseCustomFunc f, std::shared_ptr<ParseCall> call) {
+        return std::function<void()>([f, call]() {
+            call->objects.clear();
+            f(call->layers, call->network, call->params, call->objects);
+        });
+    };
+    for (int boxes : opt.boxes) {
+        benches.push_back({"ds_yolov5", {P("boxes", boxes)}, [=](int t) {
+            auto call = std::make_shared<ParseCall>();
+            call->buffers.push_back(makeProb(boxes, 80, 500 + t));
+            call->layers.push_back(layerInfo("prob", call->buffers[0].data(), Yolo::OUTPUT_SIZE, 1, 1));
+            call->params.numClassesConfigured = 80;
+            return bind(yoloV5, call);
+        }});
+        benches.push_back({"ds_yolov5_dbscan", {P("boxes", boxes)}, [=](int t) {
+            auto call = std::make_shared<ParseCall>();
+            call->buffers.push_back(makeProb(boxes, 80, 500 + t));
+            call->layers.push_back(layerInfo("prob", call->buffers[0].data(), Yolo::OUTPUT_SIZE, 1, 1));
+            call->params.numClassesConfigured = 80;
+            return bind(yoloV5Dbscan, call);
+        }});
+        // raw heads, compacted on the host by the parser's copy of the YoloLayerV3 reference
+        benches.push_back({"ds_yolov3_raw", {P("boxes", boxes)}, [=](int t) {
+            auto call = std::make_shared<ParseCall>();
+            RawHeads h = makeHeads(boxes, 80, 600 + t);
+            call->buffers = h.data;
+            for (size_t i = 0; i < h.grids.size(); ++i) {
+                call->layers.push_back(layerInfo("yolo", call->buffers[i].data(),
+                                                 Yolo::CHECK_COUNT * 85, h.grids[i], h.grids[i]));
+            }
+            call->params.numClassesConfigured = 80;
+            call->params.perClassPreclusterThreshold.assign(80, 0.5f);
+            return bind(yoloV3, call);
+        }});
+        for (int classes : opt.classes) {
+            benches.push_back({"ds_yolov4", {P("boxes", boxes), P("classes", classes)}, [=](int t) {
+                auto call = std::make_shared<ParseCall>();
+                RawHeads h = makeHeads(boxes, classes, 700 + t);
+                call->buffers = h.data;
+                for (size_t i = 0; i < h.grids.size(); ++i) {
+                    call->layers.push_back(layerInfo("yolo", call->buffers[i].data(),
+                                                     Yolo::CHECK_COUNT * (5 + classes), h.grids[i], h.grids[i]));
+                }
+                call->params.numClassesConfigured = classes;
+                call->params.perClassPreclusterThreshold.assign(classes, 0.5f);
+                return bind(yoloV4, call);
+            }});
+        }
+    }
+    return benches;
+}
+
+static bool parseList(const std::string& s, std::vector<int>& out) {
+    out.clear();
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int v = atoi(item.c_str());
+        if (v <= 0) return false;
+        out.push_back(v);
+    }
+    return !out.empty();
+}
+
+static void usage() {
+    std::cerr << "./yolo_bench [options]" << std::endl;
+    std::cerr << "  --boxes n,n,...       detections per image (100,1000)" << std::endl;
+    std::cerr << "  --classes n,n,...     classes of the synthetic heads and boxes (80)" << std::endl;
+    std::cerr << "  --sizes HxW,...       frame sizes for preprocess_img (480x640,1080x1920)" << std::endl;
+    std::cerr << "  --threads n,n,...     concurrent copies of each benchmark (1)" << std::endl;
+    std::cerr << "  --min-time s          seconds per repetition (0.2)" << std::endl;
+    std::cerr << "  --repetitions n       repetitions, the median is reported (5)" << std::endl;
+    std::cerr << "  --filter text         only benchmarks whose name contains text" << std::endl;
+    std::cerr << "  --json file           write the results for bench_compare.py" << std::endl;
+    std::cerr << "  --prob file           captured prob blobs, float32, for an extra nms run" << std::endl;
+    std::cerr << "  --image file          captured frame for preprocess_img" << std::endl;
+    std::cerr << "  --wts file            captured .wts for loadWeights" << std::endl;
+    std::cerr << "  --ds-lib file         libnvdsinfer_custom_impl_Yolo.so, enables the ds_* parsers" << std::endl;
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!hasValue) return false;
+        std::string v = argv[++i];
+        if (a == "--boxes") {
+            if (!parseList(v, opt.boxes)) return false;
+        } else if (a == "--classes") {
+            if (!parseList(v, opt.classes)) return false;
+        } else if (a == "--threads") {
+            if (!parseList(v, opt.threads)) return false;
+        } else if (a == "--sizes") {
+            opt.sizes.clear();
+            std::stringstream ss(v);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                int h, w;
+                if (sscanf(item.c_str(), "%dx%d", &h, &w) != 2 || h <= 0 || w <= 0) return false;
+                opt.sizes.push_back({h, w});
+            }
+            if (opt.sizes.empty()) return false;
+        } else if (a == "--min-time") {
+            opt.minTime = atof(v.c_str());
+        } else if (a == "--repetitions") {
+            opt.repetitions = std::max(1, atoi(v.c_str()));
+        } else if (a == "--filter") {
+            opt.filter = v;
+        } else if (a == "--json") {
+            opt.json = v;
+        } else if (a == "--prob") {
+            opt.prob = v;
+        } else if (a == "--image") {
+            opt.image = v;
+        } else if (a == "--wts") {
+            opt.wts = v;
+        } else if (a == "--ds-lib") {
+            opt.dsLib = v;
+        } else {
+            return false;
+        }
+    }
+    return opt.minTime > 0.0;
+}
+
+static void writeJson(const std::string& file, const BenchOptions& opt, const std::vector<BenchResult>& results) {
+    std::ofstream out(file);
+    out << std::setprecision(6);
+    out << "{\n  \"context\": {\"isa\": \"" << Cpu::isaName() << "\", \"hardware_threads\": "
+        << std::thread::hardware_concurrency() << ", \"min_time\": " << opt.minTime
+        << ", \"repetitions\": " << opt.repetitions << "},\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"key\": \"" << r.key << "\", \"name\": \"" << r.bench->name << "\", \"params\": {";
+        for (size_t p = 0; p < r.bench->params.size(); ++p) {
+            out << (p ? ", " : "") << "\"" << r.bench->params[p].first << "\": \"" << r.bench->params[p].second << "\"";
+        }
+        out << "}, \"threads\": " << r.threads << ", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.medianNs << ", \"ns_per_op_min\": " << r.minNs
+            << ", \"ns_per_op_mean\": " << r.meanNs << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return -1;
+    }
+    auto wts = std::make_shared<std::string>(opt.wts);
+    std::vector<Benchmark> benches = makeBenchmarks(opt, wts);
+    if (wts->empty()) {
+        *wts = writeSyntheticWts(1 << 20);
+        if (wts->empty()) {
+            std::cerr << "cannot write a synthetic .wts to /tmp" << std::endl;
+            return -1;
+        }
+    }
+    std::vector<BenchResult> results;
+    std::cout << std::left << std::setw(56) << "benchmark" << std::right << std::setw(14) << "ns/op"
+              << std::setw(14) << "min" << std::setw(12) << "iters" << std::endl;
+    for (const Benchmark& b : benches) {
+        if (!opt.filter.empty() && b.name.find(opt.filter) == std::string::npos) continue;
+        for (int threads : opt.threads) {
+            results.push_back(runBenchmark(b, threads, opt));
+            const BenchResult& r = results.back();
+            std::cout << std::left << std::setw(56) << r.key << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(14) << r.medianNs << std::setw(14) << r.minNs << std::setw(12) << r.iterations
+                      << std::endl;
+        }
+    }
+    if (opt.wts.empty()) unlink(wts->c_str());
+    if (!opt.json.empty()) writeJson(opt.json, opt, results);
+    return 0;
+}
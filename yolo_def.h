@@ -0,0 +1,136 @@
+#ifndef _YOLO_DEF_H
+#define _YOLO_DEF_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace Yolo
+{
+    static constexpr int CHECK_COUNT = 3;
+    static constexpr float IGNORE_THRESH = 0.1f;
+    static constexpr int MAX_OUTPUT_BBOX_COUNT = 1000;
+    static constexpr int CLASS_NUM = 80;
+    static constexpr int INPUT_H = 608;
+    static constexpr int INPUT_W = 608;
+
+    struct YoloKernel
+    {
+        int width;
+        int height;
+        float anchors[CHECK_COUNT*2];
+    };
+
+    static constexpr YoloKernel yolo1 = {
+        INPUT_W / 32,
+        INPUT_H / 32,
+        {116,90,  156,198,  373,326}
+    };
+    static constexpr YoloKernel yolo2 = {
+        INPUT_W / 16,
+        INPUT_H / 16,
+        {30,61,  62,45,  59,119}
+    };
+    static constexpr YoloKernel yolo3 = {
+        INPUT_W / 8,
+        INPUT_H / 8,
+        {10,13,  16,30,  33,23}
+    };
+
+    static constexpr int LOCATIONS = 4;
+    struct alignas(float) Detection{
+        //center_x center_y w h
+        float bbox[LOCATIONS];
+        float conf;  // bbox_conf * cls_conf
+        float class_id;
+    };
+
+    // What YoloLayerPlugin and the CPU decode write after the count: the box and conf
+    // as IEEE half, 12 bytes instead of the 24 of Detection. Half keeps the box to half
+    // a pixel below 1024 and the conf to 1/2048 near 1, well within what NMS and
+    // drawing need. For non-negative halves the bit patterns order like the values,
+    // so conf compares without unpacking.
+    struct alignas(float) PackedDetection{
+        uint16_t bbox[LOCATIONS];
+        uint16_t conf;
+        uint16_t class_id;
+    };
+
+    // floats per record in the "prob" blob, [count, PackedDetection x MAX_OUTPUT_BBOX_COUNT]
+    static constexpr int DETECTION_SIZE = sizeof(PackedDetection) / sizeof(float);
+    static constexpr int OUTPUT_SIZE = 1 + MAX_OUTPUT_BBOX_COUNT * DETECTION_SIZE;
+    // the same for engines serialized before the packed records, 6 floats per box
+    static constexpr int LEGACY_DETECTION_SIZE = sizeof(Detection) / sizeof(float);
+    static constexpr int LEGACY_OUTPUT_SIZE = 1 + MAX_OUTPUT_BBOX_COUNT * LEGACY_DETECTION_SIZE;
+
+    // Round to nearest even, overflow to inf; the host side of __float2half_rn.
+    inline uint16_t floatToHalf(float f) {
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t absx = x & 0x7fffffff;
+        if (absx > 0x7f800000) return sign | 0x7e00;  // nan
+        if (absx >= 0x47800000) return sign | 0x7c00;  // inf or overflow
+        if (absx < 0x38800000) {
+            // half subnormal (or zero), unit is 2^-24
+            if (absx < 0x33000000) return sign;
+            uint32_t mant = (absx & 0x7fffff) | 0x800000;
+            uint32_t shift = 126 - (absx >> 23);
+            uint32_t r = mant >> shift;
+            uint32_t rem = mant & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rem > halfway || (rem == halfway && (r & 1))) r++;
+            return sign | r;
+        }
+        // rebias the exponent from 127 to 15 and round the mantissa to nearest even
+        uint32_t r = (absx - 0x38000000) >> 13;
+        uint32_t rem = absx & 0x1fff;
+        if (rem > 0x1000 || (rem == 0x1000 && (r & 1))) r++;
+        return sign | r;
+    }
+
+    inline float halfToFloat(uint16_t h) {
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t exp = (h >> 10) & 0x1f;
+        uint32_t mant = h & 0x3ff;
+        uint32_t bits;
+        if (exp == 0) {
+            float v = mant * (1.0f / 16777216.0f);
+            return sign ? -v : v;
+        } else if (exp == 31) {
+            bits = sign | 0x7f800000 | (mant << 13);
+        } else {
+            bits = sign | ((exp + 112) << 23) | (mant << 13);
+        }
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    inline PackedDetection packDetection(const Detection& d) {
+        PackedDetection p;
+        for (int i = 0; i < LOCATIONS; ++i) p.bbox[i] = floatToHalf(d.bbox[i]);
+        p.conf = floatToHalf(d.conf);
+        p.class_id = (uint16_t)d.class_id;
+        return p;
+    }
+
+    inline Detection unpackDetection(const PackedDetection& p) {
+        Detection d;
+        for (int i = 0; i < LOCATIONS; ++i) d.bbox[i] = halfToFloat(p.bbox[i]);
+        d.conf = halfToFloat(p.conf);
+        d.class_id = p.class_id;
+        return d;
+    }
+
+    // Shim for legacy [count, Detection x MAX_OUTPUT_BBOX_COUNT] blobs: rewrites one
+    // image of them into OUTPUT_SIZE floats of packed records at packed.
+    inline void packLegacyOutput(const float* legacy, float* packed) {
+        int count = legacy[0] < MAX_OUTPUT_BBOX_COUNT ? (int)legacy[0] : MAX_OUTPUT_BBOX_COUNT;
+        const Detection* src = reinterpret_cast<const Detection*>(legacy + 1);
+        PackedDetection* dst = reinterpret_cast<PackedDetection*>(packed + 1);
+        for (int i = 0; i < count; ++i) dst[i] = packDetection(src[i]);
+        packed[0] = legacy[0];
+    }
+}
+
+#endif
@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+#include "cpu_backend.h"
+#include "pipeline.h"
+
+#define NMS_THRESH 0.4
+#define CONF_THRESH 0.5
+
+// Capacity planner: replays an image directory or a video as N virtual cameras,
+// each at --fps, through a decode, preprocess, infer and NMS pipeline on the CPU
+// backend, and raises N until the latency or drop target breaks. A camera keeps
+// at most --queue frames in flight and drops the ones that arrive while it is full,
+// like a live source. N doubles until a step fails, then a bisection finds the
+// largest N that holds; every step runs --duration seconds after --warmup. The
+// search repeats for every model, input size and precision given.
+
+struct LoadOptions
+{
+    std::string source;                 // directory of images or a video file
+    std::string wtsDir{".."};           // where yolov5<model>.wts live
+    std::vector<char> models{'s'};
+    std::vector<int> sizes{640};        // letterbox long side
+    std::vector<Cpu::Precision> precisions{Cpu::Precision::kFP32};
+    int frameW{1920}, frameH{1080};     // replayed frames are resized to this
+    double fps{25.0};                   // per camera
+    double duration{10.0};              // measured seconds per step
+    double warmup{2.0};                 // seconds per step before measuring
+    double sloMs{200.0};                // frame due to boxes out, at the percentile
+    double percentile{99.0};
+    double maxDrop{0.01};               // fraction of frames a camera may drop
+    int queue{2};                       // frames in flight per camera
+    int instances{1};                   // networks sharing the weights, each on its share of the cores
+    int maxStreams{64};
+    int maxFrames{250};                 // frames of the source kept in memory
+    bool predecoded{false};             // skip the JPEG decode, as with hardware decode
+    bool verbose{false};                // print the pipeline's worker changes
+    std::string json;
+};
+
+// One replayed frame, JPEG encoded as a camera would send it
+struct SourceFrame
+{
+    std::vector<uchar> jpeg;
+    cv::Mat image;
+};
+
+struct LoadJob
+{
+    int camera{0};
+    int frame{0};
+    std::chrono::steady_clock::time_point due;
+    cv::Mat img;
+    cv::Mat input;  // letterboxed BGR
+    std::vector<float> prob;
+    std::vector<Yolo::Detection> res;
+};
+
+struct StepResult
+{
+    int streams{0};
+    double offeredFps{0.0};
+    double doneFps{0.0};
+    double p50Ms{0.0};
+    double tailMs{0.0};  // at LoadOptions::percentile
+    double dropped{0.0};  // fraction
+    bool ok{false};
+};
+
+struct CapacityResult
+{
+    char model{'s'};
+    int size{0};
+    Cpu::Precision precision{Cpu::Precision::kFP32};
+    int streams{0};  // most that met the targets
+    std::vector<StepResult> steps;
+};
+
+static bool loadSource(const LoadOptions& opt, std::vector<SourceFrame>& frames) {
+    std::vector<cv::Mat> images;
+    std::vector<std::string> files;
+    if (read_files_in_dir(opt.source.c_str(), files) == 0) {
+        std::sort(files.begin(), files.end());
+        for (const std::string& f : files) {
+            if ((int)images.size() == opt.maxFrames) break;
+            cv::Mat img = cv::imread(opt.source + "/" + f);
+            if (!img.empty()) images.push_back(img);
+        }
+    } else {
+        cv::VideoCapture video(opt.source);
+        cv::Mat img;
+        while ((int)images.size() < opt.maxFrames && video.read(img)) images.push_back(img.clone());
+    }
+    for (cv::Mat& img : images) {
+        SourceFrame f;
+        cv::resize(img, f.image, cv::Size(opt.frameW, opt.frameH));
+        cv::imencode(".jpg", f.image, f.jpeg);
+        frames.push_back(f);
+    }
+    return !frames.empty();
+}
+
+static double percentileOf(std::vector<double>& v, double p) {
+    if (v.empty()) return 0.0;
+    size_t i = std::min(v.size() - 1, (size_t)(p / 100.0 * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+// Runs streams cameras for warmup + duration seconds and waits for every admitted frame.
+static StepResult runStep(std::vector<std::unique_ptr<Cpu::Network>>& nets, int size,
+                          const std::vector<SourceFrame>& frames, int streams, const LoadOptions& opt) {
+    typedef std::chrono::steady_clock Clock;
+    const double period = 1.0 / (opt.fps * streams);  // between frames of all cameras
+    std::unique_ptr<std::atomic<int>[]> inFlight(new std::atomic<int>[streams]);
+    for (int c = 0; c < streams; ++c) inFlight[c] = 0;
+    std::mutex resultMutex;
+    std::vector<double> latencies;
+    long measured = 0, dropped = 0;
+    Clock::time_point start, measureFrom;
+
+    std::mutex jobMutex;
+    std::vector<std::unique_ptr<LoadJob>> freeJobs;
+
+    PipelineOptions pipelineOptions;
+    pipelineOptions.log = opt.verbose;
+    pipelineOptions.maxInFlight = streams * opt.queue;  // cameras drop before push() would block
+    Pipeline<LoadJob> pipeline(pipelineOptions);
+    StageOptions parallel;
+    parallel.maxWorkers = std::max(1, (int)std::thread::hardware_concurrency());
+    // one worker per network, each takes whichever is free
+    StageOptions pooled;
+    pooled.maxWorkers = nets.size();
+    std::mutex netMutex;
+    std::vector<Cpu::Network*> freeNets;
+    for (auto& net : nets) freeNets.push_back(net.get());
+
+    pipeline.addStage("decode", [&](std::vector<LoadJob*>& jobs) {
+        LoadJob& job = *jobs[0];
+        const SourceFrame& f = frames[job.frame];
+        job.img = opt.predecoded ? f.image : cv::imdecode(f.jpeg, cv::IMREAD_COLOR);
+    }, parallel);
+    pipeline.addStage("preprocess", [&](std::vector<LoadJob*>& jobs) {
+        LoadJob& job = *jobs[0];
+        int w, h;
+        letterbox_size(job.img, size, w, h);
+        job.input = preprocess_img(job.img, w, h);
+    }, parallel);
+    pipeline.addStage("infer", [&](std::vector<LoadJob*>& jobs) {
+        LoadJob& job = *jobs[0];
+        job.prob.resize(Yolo::OUTPUT_SIZE);
+        Cpu::Network* net;
+        {
+            std::lock_guard<std::mutex> lock(netMutex);
+            net = freeNets.back();
+            freeNets.pop_back();
+        }
+        net->infer(job.input.data, Cpu::PixelLayout::kINTERLEAVED, job.input.rows, job.input.cols, job.prob.data(), 1);
+        std::lock_guard<std::mutex> lock(netMutex);
+        freeNets.push_back(net);
+    }, pooled);
+    pipeline.addStage("nms", [&](std::vector<LoadJob*>& jobs) {
+        LoadJob& job = *jobs[0];
+        job.res.clear();
+        nms(job.res, job.prob.data(), CONF_THRESH, NMS_THRESH);
+    }, parallel);
+    pipeline.setSink([&](std::unique_ptr<LoadJob> job) {
+        const Clock::time_point done = Clock::now();
+        --inFlight[job->camera];
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (job->due >= measureFrom) latencies.push_back(std::chrono::duration<double, std::milli>(done - job->due).count());
+        }
+        job->img.release();
+        std::lock_guard<std::mutex> lock(jobMutex);
+        freeJobs.push_back(std::move(job));
+    });
+
+    // camera c sends frame k at start + (k * streams + c) * period, starting at a
+    // different source frame so they do not all decode the same picture
+    start = Clock::now();
+    measureFrom = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.warmup));
+    const long total = (long)((opt.warmup + opt.duration) / period);
+    for (long i = 0; i < total; ++i) {
+        const Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i * period));
+        std::this_thread::sleep_until(due);
+        const int camera = (int)(i % streams);
+        const bool counted = due >= measureFrom;
+        measured += counted;
+        if (inFlight[camera] >= opt.queue) {
+            dropped += counted;
+            continue;
+        }
+        std::unique_ptr<LoadJob> job;
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (!freeJobs.empty()) {
+                job = std::move(freeJobs.back());
+                freeJobs.pop_back();
+            }
+        }
+        if (!job) job.reset(new LoadJob());
+        job->camera = camera;
+        job->frame = (int)((i / streams + camera * 7) % frames.size());
+        job->due = due;
+        ++inFlight[camera];
+        pipeline.push(std::move(job));
+    }
+    pipeline.finish();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - measureFrom).count();
+
+    StepResult r;
+    r.streams = streams;
+    r.offeredFps = opt.fps * streams;
+    r.doneFps = latencies.size() / std::max(elapsed, opt.duration);
+    r.dropped = measured ? (double)dropped / measured : 0.0;
+    r.tailMs = percentileOf(latencies, opt.percentile);
+    r.p50Ms = percentileOf(latencies, 50.0);
+    r.ok = !latencies.empty() && r.tailMs <= opt.sloMs && r.dropped <= opt.maxDrop;
+    if (opt.verbose) {
+        for (const StageStats& s : pipeline.stats()) {
+            std::cout << "  " << s.name << ": " << s.workers << " workers, " << s.serviceMs << " ms per frame" << std::endl;
+        }
+    }
+    return r;
+}
+
+static void printStep(const StepResult& r) {
+    std::ostringstream line;
+    line << std::setw(8) << r.streams << std::fixed << std::setprecision(1) << std::setw(10) << r.offeredFps
+              << std::setw(10) << r.doneFps << std::setw(10) << r.p50Ms << std::setw(10) << r.tailMs << std::setw(9)
+              << r.dropped * 100 << "%" << (r.ok ? "  ok" : "  over");
+    std::cout << line.str() << std::endl;
+}
+
+// Doubles the cameras until a step fails, then bisects between the last good and the first bad count.
+static CapacityResult findCapacity(char model, int size, Cpu::Precision precision,
+                                   const std::vector<SourceFrame>& frames, const LoadOptions& opt) {
+    CapacityResult result;
+    result.model = model;
+    result.size = size;
+    result.precision = precision;
+    Cpu::ModelSpec spec;
+    Cpu::getModelSpec(model, spec);
+    Cpu::NetworkOptions options;
+    options.cacheDir = ".";
+    options.precision = precision;
+    options.threads = std::max(1, (int)std::thread::hardware_concurrency() / opt.instances);
+    // the weights are packed or mapped once, the other instances only add their arenas
+    std::vector<std::unique_ptr<Cpu::Network>> nets;
+    for (int i = 0; i < opt.instances; ++i) {
+        nets.emplace_back(new Cpu::Network(spec, opt.wtsDir + "/" + spec.name + ".wts", options));
+    }
+    if (opt.instances > 1) {
+        std::cout << opt.instances << " instances of " << options.threads << " threads share "
+                  << nets[0]->packStats().packedBytes / (1 << 20) << "MB of packed weights" << std::endl;
+    }
+
+    std::cout << spec.name << " " << size << " " << Cpu::precisionName(precision) << ", " << opt.frameW << "x"
+              << opt.frameH << " at " << opt.fps << " fps per camera, p" << opt.percentile << " <= " << opt.sloMs
+              << " ms" << std::endl;
+    std::cout << std::setw(8) << "streams" << std::setw(10) << "offered" << std::setw(10) << "done" << std::setw(10)
+              << "p50 ms" << std::setw(10) << "tail ms" << std::setw(10) << "dropped" << std::endl;
+    auto step = [&](int n) {
+        result.steps.push_back(runStep(nets, size, frames, n, opt));
+        printStep(result.steps.back());
+        return result.steps.back().ok;
+    };
+
+    int good = 0, bad = 0;  // bad 0: no step failed
+    for (int n = 1; ; n = std::min(n * 2, opt.maxStreams)) {
+        if (!step(n)) {
+            bad = n;
+            break;
+        }
+        good = n;
+        if (n == opt.maxStreams) break;
+    }
+    while (bad - good > 1) {
+        const int n = (good + bad) / 2;
+        if (step(n)) good = n;
+        else bad = n;
+    }
+    result.streams = good;
+    return result;
+}
+
+static bool parseList(const std::string& s, std::vector<std::string>& out) {
+    out.clear();
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) return false;
+        out.push_back(item);
+    }
+    return !out.empty();
+}
+
+static void usage() {
+    std::cerr << "./yolo_load [options] source" << std::endl;
+    std::cerr << "  source                directory of images or a video file, replayed by every camera" << std::endl;
+    std::cerr << "  --models s,m,...      yolov5 variants (s)" << std::endl;
+    std::cerr << "  --wts-dir dir         where yolov5<model>.wts are (..)" << std::endl;
+    std::cerr << "  --sizes n,n,...       letterbox long side, multiples of 32 (640)" << std::endl;
+    std::cerr << "  --precision p,p,...   fp32, fp16, bf16 (fp32)" << std::endl;
+    std::cerr << "  --resolution WxH      camera frame size (1920x1080)" << std::endl;
+    std::cerr << "  --fps f               frames per second per camera (25)" << std::endl;
+    std::cerr << "  --slo ms              latency target from frame due to boxes out (200)" << std::endl;
+    std::cerr << "  --percentile p        latency percentile held to the target (99)" << std::endl;
+    std::cerr << "  --max-drop f          fraction of frames cameras may drop (0.01)" << std::endl;
+    std::cerr << "  --queue n             frames in flight per camera before it drops (2)" << std::endl;
+    std::cerr << "  --instances n         networks run in parallel, sharing the weights (1)" << std::endl;
+    std::cerr << "  --duration s          measured seconds per step (10)" << std::endl;
+    std::cerr << "  --warmup s            unmeasured seconds before each step (2)" << std::endl;
+    std::cerr << "  --max-streams n       upper end of the search (64)" << std::endl;
+    std::cerr << "  --max-frames n        source frames kept in memory (250)" << std::endl;
+    std::cerr << "  --predecoded          hand out decoded frames, as with hardware decode" << std::endl;
+    std::cerr << "  --verbose             print worker changes and stage times" << std::endl;
+    std::cerr << "  --json file           write the steps and the capacities" << std::endl;
+}
+
+static bool parseArgs(int argc, char** argv, LoadOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--predecoded") {
+            opt.predecoded = true;
+            continue;
+        } else if (a == "--verbose") {
+            opt.verbose = true;
+            continue;
+        } else if (a.compare(0, 2, "--") != 0) {
+            if (!opt.source.empty()) return false;
+            opt.source = a;
+            continue;
+        }
+        if (i + 1 == argc) return false;
+        std::string v = argv[++i];
+        std::vector<std::string> items;
+        if (a == "--models") {
+            if (!parseList(v, items)) return false;
+            opt.models.clear();
+            for (const std::string& m : items) {
+                Cpu::ModelSpec spec;
+                if (m.size() != 1 || !Cpu::getModelSpec(m[0], spec)) return false;
+                opt.models.push_back(m[0]);
+            }
+        } else if (a == "--wts-dir") {
+            opt.wtsDir = v;
+        } else if (a == "--sizes") {
+            if (!parseList(v, items)) return false;
+            opt.sizes.clear();
+            for (const std::string& s : items) {
+                int n = atoi(s.c_str());
+                if (n <= 0 || n % 32) return false;
+                opt.sizes.push_back(n);
+            }
+        } else if (a == "--precision") {
+            if (!parseList(v, items)) return false;
+            opt.precisions.clear();
+            for (const std::string& s : items) {
+                Cpu::Precision p;
+                if (!Cpu::parsePrecision(s, p)) return false;
+                opt.precisions.push_back(p);
+            }
+        } else if (a == "--resolution") {
+            if (sscanf(v.c_str(), "%dx%d", &opt.frameW, &opt.frameH) != 2 || opt.frameW <= 0 || opt.frameH <= 0) return false;
+        } else if (a == "--fps") {
+            opt.fps = atof(v.c_str());
+        } else if (a == "--slo") {
+            opt.sloMs = atof(v.c_str());
+        } else if (a == "--percentile") {
+            opt.percentile = atof(v.c_str());
+        } else if (a == "--max-drop") {
+            opt.maxDrop = atof(v.c_str());
+        } else if (a == "--queue") {
+            opt.queue = atoi(v.c_str());
+        } else if (a == "--instances") {
+            opt.instances = atoi(v.c_str());
+        } else if (a == "--duration") {
+            opt.duration = atof(v.c_str());
+        } else if (a == "--warmup") {
+            opt.warmup = atof(v.c_str());
+        } else if (a == "--max-streams") {
+            opt.maxStreams = atoi(v.c_str());
+        } else if (a == "--max-frames") {
+            opt.maxFrames = atoi(v.c_str());
+        } else if (a == "--json") {
+            opt.json = v;
+        } else {
+            return false;
+        }
+    }
+    return !opt.source.empty() && opt.fps > 0.0 && opt.duration > 0.0 && opt.warmup >= 0.0 && opt.sloMs > 0.0 &&
+           opt.percentile > 0.0 && opt.percentile <= 100.0 && opt.maxDrop >= 0.0 && opt.queue > 0 && opt.instances > 0 &&
+           opt.maxStreams > 0 && opt.maxFrames > 0;
+}
+
+static void writeJson(const std::string& file, const LoadOptions& opt, const std::vector<CapacityResult>& results) {
+    std::ofstream out(file);
+    out << std::setprecision(6);
+    out << "{\n  \"context\": {\"isa\": \"" << Cpu::isaName() << "\", \"hardware_threads\": "
+        << std::thread::hardware_concurrency() << ", \"resolution\": \"" << opt.frameW << "x" << opt.frameH
+        << "\", \"fps\": " << opt.fps << ", \"slo_ms\": " << opt.sloMs << ", \"percentile\": " << opt.percentile
+        << ", \"max_drop\": " << opt.maxDrop << ", \"instances\": " << opt.instances << ", \"predecoded\": " << (opt.predecoded ? "true" : "false")
+        << "},\n  \"capacity\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const CapacityResult& c = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"model\": \"yolov5" << c.model << "\", \"size\": " << c.size
+            << ", \"precision\": \"" << Cpu::precisionName(c.precision) << "\", \"streams\": " << c.streams
+            << ", \"steps\": [";
+        for (size_t s = 0; s < c.steps.size(); ++s) {
+            const StepResult& r = c.steps[s];
+            out << (s ? ", " : "") << "{\"streams\": " << r.streams << ", \"done_fps\": " << r.doneFps
+                << ", \"p50_ms\": " << r.p50Ms << ", \"tail_ms\": " << r.tailMs << ", \"dropped\": " << r.dropped
+                << ", \"ok\": " << (r.ok ? "true" : "false") << "}";
+        }
+        out << "]}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    LoadOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return -1;
+    }
+    std::vector<SourceFrame> frames;
+    if (!loadSource(opt, frames)) {
+        std::cerr << "no frames in " << opt.source << std::endl;
+        return -1;
+    }
+
+    std::vector<CapacityResult> results;
+    for (char model : opt.models) {
+        for (int size : opt.sizes) {
+            for (Cpu::Precision precision : opt.precisions) {
+                results.push_back(findCapacity(model, size, precision, frames, opt));
+                std::cout << std::endl;
+            }
+        }
+    }
+
+    std::cout << "streams of " << opt.frameW << "x" << opt.frameH << " at " << opt.fps << " fps with p"
+              << opt.percentile << " <= " << opt.sloMs << " ms and <= " << opt.maxDrop * 100 << "% dropped:" << std::endl;
+    for (const CapacityResult& c : results) {
+        std::cout << "  yolov5" << c.model << " " << c.size << " " << Cpu::precisionName(c.precision) << ": "
+                  << c.streams << (c.streams == opt.maxStreams ? "+" : "") << std::endl;
+    }
+    if (!opt.json.empty()) writeJson(opt.json, opt, results);
+    return 0;
+}
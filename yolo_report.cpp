@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cpu_backend.h"
+#include "cpu_darknet.h"
+
+// Per layer output shape, MACs, parameter and activation bytes of yolov5 s/m/l/x or
+// a darknet cfg at one or more input sizes, with the totals. Built from the graph
+// alone, so it needs neither the weights nor a GPU.
+
+struct ReportOptions
+{
+    std::vector<std::string> models;             // s m l x or darknet .cfg files
+    std::vector<std::pair<int, int>> sizes;      // HxW, empty: the model's own
+    Cpu::Precision precision{Cpu::Precision::kFP32};
+    bool summary{false};                         // totals only
+    std::string csv;
+};
+
+static bool buildGraph(const std::string& model, std::string& name, Cpu::Graph& graph) {
+    Cpu::ModelSpec spec;
+    if (model.size() == 1 && Cpu::getModelSpec(model[0], spec)) {
+        name = spec.name;
+        graph = Cpu::buildYolov5(spec);
+        return true;
+    }
+    std::ifstream cfg(model);
+    if (!cfg.good()) return false;
+    name = model.substr(model.find_last_of('/') + 1);
+    graph = Cpu::buildDarknet(Darknet::parseConfigFile(model));
+    return true;
+}
+
+static void usage() {
+    std::cerr << "./yolo_report [options] model..." << std::endl;
+    std::cerr << "  model                 s, m, l, x or a darknet .cfg" << std::endl;
+    std::cerr << "  --sizes HxW,...       input sizes, multiples of 32 (the model's own)" << std::endl;
+    std::cerr << "  --precision p         weight storage: fp32, fp16 or bf16 (fp32)" << std::endl;
+    std::cerr << "  --summary             totals only" << std::endl;
+    std::cerr << "  --csv file            write every layer of every model and size" << std::endl;
+}
+
+static bool parseArgs(int argc, char** argv, ReportOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--summary") {
+            opt.summary = true;
+            continue;
+        } else if (a.compare(0, 2, "--") != 0) {
+            opt.models.push_back(a);
+            continue;
+        }
+        if (i + 1 == argc) return false;
+        std::string v = argv[++i];
+        if (a == "--sizes") {
+            std::stringstream ss(v);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                int h, w;
+                if (sscanf(item.c_str(), "%dx%d", &h, &w) != 2 || h <= 0 || w <= 0 || h % 32 || w % 32) return false;
+                opt.sizes.push_back({h, w});
+            }
+            if (opt.sizes.empty()) return false;
+        } else if (a == "--precision") {
+            if (!Cpu::parsePrecision(v, opt.precision)) return false;
+        } else if (a == "--csv") {
+            opt.csv = v;
+        } else {
+            return false;
+        }
+    }
+    return !opt.models.empty();
+}
+
+int main(int argc, char** argv) {
+    ReportOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return -1;
+    }
+    std::ofstream csv;
+    if (!opt.csv.empty()) {
+        csv.open(opt.csv);
+        csv << "model,input,id,layer,op,c,h,w,macs,params,param_bytes,activation_bytes\n";
+    }
+    for (const std::string& model : opt.models) {
+        std::string name;
+        Cpu::Graph graph;
+        if (!buildGraph(model, name, graph)) {
+            std::cerr << "unknown model " << model << ", expected s, m, l, x or a .cfg file" << std::endl;
+            return -1;
+        }
+        std::vector<std::pair<int, int>> sizes = opt.sizes;
+        if (sizes.empty()) sizes.push_back({graph.inputH, graph.inputW});
+        for (const auto& size : sizes) {
+            Cpu::CostReport report = Cpu::costReport(graph, size.first, size.second, opt.precision);
+            if (opt.summary) {
+                std::cout << name << " " << Cpu::formatCostTotals(report) << std::endl;
+            } else {
+                std::cout << name << std::endl << Cpu::formatCostReport(graph, report) << std::endl;
+            }
+            if (!csv.is_open()) continue;
+            for (size_t i = 0; i < graph.nodes.size(); ++i) {
+                const Cpu::LayerCost& l = report.layers[i];
+                csv << name << "," << size.first << "x" << size.second << "," << i << "," << graph.nodes[i].name << ","
+                    << Cpu::opTypeName(graph.nodes[i].type) << "," << l.shape.c << "," << l.shape.h << "," << l.shape.w
+                    << "," << (long long)l.macs << "," << l.params << "," << l.paramBytes << "," << l.activationBytes
+                    << "\n";
+            }
+        }
+    }
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <cuda_fp16.h>
 #include "yololayer.h"
 #include "utils.h"
 
@@ -82,9 +83,7 @@ namespace nvinfer1
     Dims YoloLayerPlugin::getOutputDimensions(int index, const Dims* inputs, int nbInputDims)
     {
         //output the result to channel
-        int totalsize = MAX_OUTPUT_BBOX_COUNT * sizeof(Detection) / sizeof(float);
-
-        return Dims3(totalsize + 1, 1, 1);
+        return Dims3(OUTPUT_SIZE, 1, 1);
     }
 
     // Set plugin namespace
@@ -130,12 +129,12 @@ namespace nvinfer1
 
     const char* YoloLayerPlugin::getPluginType() const
     {
-        return "YoloLayer_TRT";
+        return YOLOLAYER_PLUGIN_NAME;
     }
 
     const char* YoloLayerPlugin::getPluginVersion() const
     {
-        return "1";
+        return YOLOLAYER_PLUGIN_VERSION;
     }
 
     void YoloLayerPlugin::destroy()
@@ -180,27 +179,26 @@ namespace nvinfer1
             float *res_count = output + bnIdx*outputElem;
             int count = (int)atomicAdd(res_count, 1);
             if (count >= MAX_OUTPUT_BBOX_COUNT) return;
-            char* data = (char *)res_count + sizeof(float) + count * sizeof(Detection);
-            Detection* det =  (Detection*)(data);
+            PackedDetection* det = (PackedDetection*)(res_count + 1) + count;
 
             int row = idx / yoloWidth;
             int col = idx % yoloWidth;
 
             //Location
-            det->bbox[0] = (col - 0.5f + 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 0 * total_grid])) * INPUT_W / yoloWidth;
-            det->bbox[1] = (row - 0.5f + 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 1 * total_grid])) * INPUT_H / yoloHeight;
-            det->bbox[2] = 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 2 * total_grid]);
-            det->bbox[2] = det->bbox[2] * det->bbox[2] * anchors[2*k];
-            det->bbox[3] = 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 3 * total_grid]);
-            det->bbox[3] = det->bbox[3] * det->bbox[3] * anchors[2*k + 1];
-            det->conf = box_prob * max_cls_prob;
+            float bw = 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 2 * total_grid]);
+            float bh = 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 3 * total_grid]);
+            det->bbox[0] = __half_as_ushort(__float2half_rn((col - 0.5f + 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 0 * total_grid])) * INPUT_W / yoloWidth));
+            det->bbox[1] = __half_as_ushort(__float2half_rn((row - 0.5f + 2.0f * Logist(curInput[idx + k * info_len_i * total_grid + 1 * total_grid])) * INPUT_H / yoloHeight));
+            det->bbox[2] = __half_as_ushort(__float2half_rn(bw * bw * anchors[2*k]));
+            det->bbox[3] = __half_as_ushort(__float2half_rn(bh * bh * anchors[2*k + 1]));
+            det->conf = __half_as_ushort(__float2half_rn(box_prob * max_cls_prob));
             det->class_id = class_id;
         }
     }
 
     void YoloLayerPlugin::forwardGpu(const float *const * inputs, float* output, cudaStream_t stream, int batchSize) {
 
-        int outputElem = 1 + MAX_OUTPUT_BBOX_COUNT * sizeof(Detection) / sizeof(float);
+        int outputElem = OUTPUT_SIZE;
 
         for(int idx = 0 ; idx < batchSize; ++idx) {
             CUDA_CHECK(cudaMemset(output + idx*outputElem, 0, sizeof(float)));
@@ -238,12 +236,12 @@ namespace nvinfer1
 
     const char* YoloPluginCreator::getPluginName() const
     {
-            return "YoloLayer_TRT";
+            return YOLOLAYER_PLUGIN_NAME;
     }
 
     const char* YoloPluginCreator::getPluginVersion() const
     {
-            return "1";
+            return YOLOLAYER_PLUGIN_VERSION;
     }
 
     const PluginFieldCollection* YoloPluginCreator::getFieldNames()
@@ -4,47 +4,12 @@
 #include <vector>
 #include <string>
 #include "NvInfer.h"
+#include "yolo_def.h"
 
-namespace Yolo
-{
-    static constexpr int CHECK_COUNT = 3;
-    static constexpr float IGNORE_THRESH = 0.1f;
-    static constexpr int MAX_OUTPUT_BBOX_COUNT = 1000;
-    static constexpr int CLASS_NUM = 80;
-    static constexpr int INPUT_H = 608;
-    static constexpr int INPUT_W = 608;
-
-    struct YoloKernel
-    {
-        int width;
-        int height;
-        float anchors[CHECK_COUNT*2];
-    };
-
-    static constexpr YoloKernel yolo1 = {
-        INPUT_W / 32,
-        INPUT_H / 32,
-        {116,90,  156,198,  373,326}
-    };
-    static constexpr YoloKernel yolo2 = {
-        INPUT_W / 16,
-        INPUT_H / 16,
-        {30,61,  62,45,  59,119}
-    };
-    static constexpr YoloKernel yolo3 = {
-        INPUT_W / 8,
-        INPUT_H / 8,
-        {10,13,  16,30,  33,23}
-    };
-
-    static constexpr int LOCATIONS = 4;
-    struct alignas(float) Detection{
-        //center_x center_y w h
-        float bbox[LOCATIONS];
-        float conf;  // bbox_conf * cls_conf
-        float class_id;
-    };
-}
+// What YoloLayerPlugin registers as and the builders in yolov5.cpp look up. Version 2
+// writes packed detection records, engines serialized with version 1 must be rebuilt.
+static const char* const YOLOLAYER_PLUGIN_NAME = "YoloLayer_TRT";
+static const char* const YOLOLAYER_PLUGIN_VERSION = "2";
 
 namespace nvinfer1
 {
@@ -1,14 +1,35 @@
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "cuda_runtime_api.h"
 #include "logging.h"
 #include "common.hpp"
+#include "cpu_backend.h"
+#include "cpu_flow.h"
+#include "detection_delta.h"
+#include "mat_pool.h"
+#include "pipeline.h"
+#include "preprocess.h"
 
 #define USE_FP16  // comment out this if want to use FP32
+//#define USE_U8_INPUT  // feed raw uint8 BGR frames, 1/255 and BGR->RGB are folded into the Focus conv
 #define DEVICE 0  // GPU id
 #define NMS_THRESH 0.4
 #define CONF_THRESH 0.5
 #define BATCH_SIZE 1
+#define KEYFRAME_INTERVAL 1  // detect on every Nth frame, boxes move with optical flow in between
+//#define CPU_TUNE  // time gemm blockings per conv shape on this machine, kept in ./tuning-<cpu>.txt
+#define HUGE_PAGES Cpu::HugePages::kNONE  // kTHP or kHUGETLB: 2 MB pages for the cpu weights, arena and input staging
+//#define DELTA_FILE "detections.delta"  // write change-only detection messages, see detection_delta.h
+#define PIPELINE_WORKERS 4  // most decode, preprocess and annotate threads each, the pipeline picks how many run
+#define BATCH_WAIT_MS 50  // BATCH_SIZE > 1: longest a batch short of frames waits for more, per shape with -c and a size
+
+#if KEYFRAME_INTERVAL > 1 && BATCH_SIZE != 1
+#error "optical flow propagation runs frame by frame, it needs BATCH_SIZE 1"
+#endif
 
 #define NET s  // s m l x
 #define NETSTRUCT(str) createEngine_##str
@@ -19,7 +40,12 @@
 // stuff we know about the network and the input/output blobs
 static const int INPUT_H = Yolo::INPUT_H;
 static const int INPUT_W = Yolo::INPUT_W;
-static const int OUTPUT_SIZE = Yolo::MAX_OUTPUT_BBOX_COUNT * sizeof(Yolo::Detection) / sizeof(float) + 1;  // we assume the yololayer outputs no more than 1000 boxes that conf >= 0.1
+static const int OUTPUT_SIZE = Yolo::OUTPUT_SIZE;  // we assume the yololayer outputs no more than 1000 boxes that conf >= 0.1
+#ifdef USE_U8_INPUT
+typedef uint8_t InputType;  // letterboxed BGR bytes as cv::Mat stores them (HWC)
+#else
+typedef float InputType;    // planar RGB in [0, 1]
+#endif
 const char* INPUT_BLOB_NAME = "data";
 const char* OUTPUT_BLOB_NAME = "prob";
 static Logger gLogger;
@@ -33,6 +59,9 @@ ICudaEngine* createEngine_s(unsigned int maxBatchSize, IBuilder* builder, IBuild
     assert(data);
 
     std::map<std::string, Weights> weightMap = loadWeights("../yolov5s.wts");
+#ifdef USE_U8_INPUT
+    foldInputNormalization(weightMap, "model.0.conv", 3, 3);
+#endif
     Weights emptywts{DataType::kFLOAT, nullptr, 0};
 
     // yolov5 backbone
@@ -88,7 +117,7 @@ ICudaEngine* createEngine_s(unsigned int maxBatchSize, IBuilder* builder, IBuild
     auto bottleneck_csp23 = bottleneckCSP(network, weightMap, *cat22->getOutput(0), 512, 512, 1, false, 1, 0.5, "model.23");
     IConvolutionLayer* det2 = network->addConvolutionNd(*bottleneck_csp23->getOutput(0), 3 * (Yolo::CLASS_NUM + 5), DimsHW{1, 1}, weightMap["model.24.m.2.weight"], weightMap["model.24.m.2.bias"]);
 
-    auto creator = getPluginRegistry()->getPluginCreator("YoloLayer_TRT", "1");
+    auto creator = getPluginRegistry()->getPluginCreator(YOLOLAYER_PLUGIN_NAME, YOLOLAYER_PLUGIN_VERSION);
     const PluginFieldCollection* pluginData = creator->getFieldNames();
     IPluginV2 *pluginObj = creator->createPlugin("yololayer", pluginData);
     ITensor* inputTensors_yolo[] = {det2->getOutput(0), det1->getOutput(0), det0->getOutput(0)};
@@ -127,6 +156,9 @@ ICudaEngine* createEngine_m(unsigned int maxBatchSize, IBuilder* builder, IBuild
     assert(data);
 
     std::map<std::string, Weights> weightMap = loadWeights("../yolov5m.wts");
+#ifdef USE_U8_INPUT
+    foldInputNormalization(weightMap, "model.0.conv", 3, 3);
+#endif
     Weights emptywts{ DataType::kFLOAT, nullptr, 0 };
 
     /* ------ yolov5 backbone------ */
@@ -192,7 +224,7 @@ ICudaEngine* createEngine_m(unsigned int maxBatchSize, IBuilder* builder, IBuild
     // yolo layer 2
     IConvolutionLayer* det2 = network->addConvolutionNd(*bottleneck_csp23->getOutput(0), 3 * (Yolo::CLASS_NUM + 5), DimsHW{ 1, 1 }, weightMap["model.24.m.2.weight"], weightMap["model.24.m.2.bias"]);
 
-    auto creator = getPluginRegistry()->getPluginCreator("YoloLayer_TRT", "1");
+    auto creator = getPluginRegistry()->getPluginCreator(YOLOLAYER_PLUGIN_NAME, YOLOLAYER_PLUGIN_VERSION);
     const PluginFieldCollection* pluginData = creator->getFieldNames();
     IPluginV2 *pluginObj = creator->createPlugin("yololayer", pluginData);
     ITensor* inputTensors_yolo[] = {det2->getOutput(0), det1->getOutput(0), det0->getOutput(0)};
@@ -231,6 +263,9 @@ ICudaEngine* createEngine_l(unsigned int maxBatchSize, IBuilder* builder, IBuild
     assert(data);
 
     std::map<std::string, Weights> weightMap = loadWeights("../yolov5l.wts");
+#ifdef USE_U8_INPUT
+    foldInputNormalization(weightMap, "model.0.conv", 3, 3);
+#endif
     Weights emptywts{ DataType::kFLOAT, nullptr, 0 };
 
     /* ------ yolov5 backbone------ */
@@ -294,7 +329,7 @@ ICudaEngine* createEngine_l(unsigned int maxBatchSize, IBuilder* builder, IBuild
 
     IConvolutionLayer* det2 = network->addConvolutionNd(*bottleneck_csp23->getOutput(0), 3 * (Yolo::CLASS_NUM + 5), DimsHW{ 1, 1 }, weightMap["model.24.m.2.weight"], weightMap["model.24.m.2.bias"]);
 
-    auto creator = getPluginRegistry()->getPluginCreator("YoloLayer_TRT", "1");
+    auto creator = getPluginRegistry()->getPluginCreator(YOLOLAYER_PLUGIN_NAME, YOLOLAYER_PLUGIN_VERSION);
     const PluginFieldCollection* pluginData = creator->getFieldNames();
     IPluginV2 *pluginObj = creator->createPlugin("yololayer", pluginData);
     ITensor* inputTensors_yolo[] = {det2->getOutput(0), det1->getOutput(0), det0->getOutput(0)};
@@ -333,6 +368,9 @@ ICudaEngine* createEngine_x(unsigned int maxBatchSize, IBuilder* builder, IBuild
     assert(data);
 
     std::map<std::string, Weights> weightMap = loadWeights("../yolov5x.wts");
+#ifdef USE_U8_INPUT
+    foldInputNormalization(weightMap, "model.0.conv", 3, 3);
+#endif
     Weights emptywts{ DataType::kFLOAT, nullptr, 0 };
 
     /* ------ yolov5 backbone------ */
@@ -398,7 +436,7 @@ ICudaEngine* createEngine_x(unsigned int maxBatchSize, IBuilder* builder, IBuild
     // yolo layer 2
     IConvolutionLayer* det2 = network->addConvolutionNd(*bottleneck_csp23->getOutput(0), 3 * (Yolo::CLASS_NUM + 5), DimsHW{ 1, 1 }, weightMap["model.24.m.2.weight"], weightMap["model.24.m.2.bias"]);
 
-    auto creator = getPluginRegistry()->getPluginCreator("YoloLayer_TRT", "1");
+    auto creator = getPluginRegistry()->getPluginCreator(YOLOLAYER_PLUGIN_NAME, YOLOLAYER_PLUGIN_VERSION);
     const PluginFieldCollection* pluginData = creator->getFieldNames();
     IPluginV2 *pluginObj = creator->createPlugin("yololayer", pluginData);
     ITensor* inputTensors_yolo[] = { det2->getOutput(0), det1->getOutput(0), det0->getOutput(0) };
@@ -447,7 +485,7 @@ void APIToModel(unsigned int maxBatchSize, IHostMemory** modelStream) {
     builder->destroy();
 }
 
-void doInference(IExecutionContext& context, float* input, float* output, int batchSize) {
+void doInference(IExecutionContext& context, InputType* input, float* output, int batchSize) {
     const ICudaEngine& engine = context.getEngine();
 
     // Pointers to input and output device buffers to pass to engine.
@@ -469,22 +507,96 @@ void doInference(IExecutionContext& context, float* input, float* output, int ba
     CHECK(cudaStreamCreate(&stream));
 
     // DMA input batch data to device, infer on the batch asynchronously, and DMA output back to host
+#ifdef USE_U8_INPUT
+    uint8_t* frames;
+    CHECK(cudaMalloc(&frames, batchSize * 3 * INPUT_H * INPUT_W));
+    CHECK(cudaMemcpyAsync(frames, input, batchSize * 3 * INPUT_H * INPUT_W, cudaMemcpyHostToDevice, stream));
+    u8HwcToFloatChw(frames, (float*)buffers[inputIndex], batchSize, INPUT_H, INPUT_W, stream);
+#else
     CHECK(cudaMemcpyAsync(buffers[inputIndex], input, batchSize * 3 * INPUT_H * INPUT_W * sizeof(float), cudaMemcpyHostToDevice, stream));
+#endif
     context.enqueue(batchSize, buffers, stream, nullptr);
     CHECK(cudaMemcpyAsync(output, buffers[outputIndex], batchSize * OUTPUT_SIZE * sizeof(float), cudaMemcpyDeviceToHost, stream));
     cudaStreamSynchronize(stream);
 
     // Release stream and buffers
     cudaStreamDestroy(stream);
+#ifdef USE_U8_INPUT
+    CHECK(cudaFree(frames));
+#endif
     CHECK(cudaFree(buffers[inputIndex]));
     CHECK(cudaFree(buffers[outputIndex]));
 }
 
+// One file on its way through the pipeline in main()
+struct FrameJob
+{
+    std::string name;
+    long long index{0};                  // in file order
+    const Roi* roi{nullptr};
+    cv::Mat img;                         // decoded, annotated in place
+    cv::Mat gray;                        // for the optical flow
+    cv::Rect crop;                       // the part of img that is letterboxed
+    int input_w{0}, input_h{0};
+    long long content_pixels{0};         // of the input, the rest is padding
+    std::vector<cv::Point2f> input_roi;
+    Cpu::HugeArray<InputType> input{HUGE_PAGES};
+    std::vector<Yolo::Detection> res;    // in frame coordinates
+};
+
+// Crops the region of interest of job's frame and letterboxes it into job.input, of
+// the shape of buckets that fits it best if there are any
+void prepare(FrameJob& job, int net_w, int net_h, int cpu_size, int input_stride, const std::vector<cv::Size>& buckets) {
+    job.input_w = net_w;
+    job.input_h = net_h;
+    // only the bounding rectangle of the region is letterboxed
+    job.crop = roi_rect(job.img, job.roi);
+    cv::Mat img = job.img(job.crop);
+    if (!buckets.empty()) {
+        cv::Size shape = bucket_shape(img, buckets);
+        job.input_w = shape.width;
+        job.input_h = shape.height;
+    } else if (cpu_size) {
+        letterbox_size(img, cpu_size, job.input_w, job.input_h);
+    }
+    job.content_pixels = letterbox_content(img, job.input_w, job.input_h);
+    job.input_roi = roi_to_input(job.roi, job.crop, job.input_w, job.input_h);
+    cv::Mat pr_img = preprocess_img(img, job.input_w, job.input_h); // letterbox BGR to RGB
+    job.input.resize(input_stride);
+    InputType* in = job.input.data();
+#ifdef USE_U8_INPUT
+    for (int row = 0; row < job.input_h; ++row) {
+        memcpy(in + row * job.input_w * 3, pr_img.ptr(row), job.input_w * 3);
+    }
+#else
+    const int area = job.input_h * job.input_w;
+    int i = 0;
+    for (int row = 0; row < job.input_h; ++row) {
+        uchar* uc_pixel = pr_img.data + row * pr_img.step;
+        for (int col = 0; col < job.input_w; ++col) {
+            in[i] = (float)uc_pixel[2] / 255.0;
+            in[i + area] = (float)uc_pixel[1] / 255.0;
+            in[i + 2 * area] = (float)uc_pixel[0] / 255.0;
+            uc_pixel += 3;
+            ++i;
+        }
+    }
+#endif
+}
+
+void draw_box(cv::Mat& img, const cv::Rect& r, int class_id) {
+    cv::rectangle(img, r, cv::Scalar(0x27, 0xC1, 0x36), 2);
+    cv::putText(img, std::to_string(class_id), cv::Point(r.x, r.y - 1), cv::FONT_HERSHEY_PLAIN, 1.2, cv::Scalar(0xFF, 0xFF, 0xFF), 2);
+}
+
 int main(int argc, char** argv) {
     cudaSetDevice(DEVICE);
     // create a model using the API directly and serialize it to a stream
     char *trtModelStream{nullptr};
     size_t size{0};
+    std::unique_ptr<Cpu::Network> cpuNet;
+    int cpu_size = 0;  // letterbox long side for the cpu backend, 0: INPUT_W x INPUT_H
+    int net_h = INPUT_H, net_w = INPUT_W;  // unless a darknet cfg says otherwise
     std::string engine_name = STR2(NET);
     engine_name = "yolov5" + engine_name + ".engine";
     if (argc == 2 && std::string(argv[1]) == "-s") {
@@ -510,10 +622,51 @@ int main(int argc, char** argv) {
             file.read(trtModelStream, size);
             file.close();
         }
+    } else if (argc >= 3 && argc <= 5 && std::string(argv[1]) == "-c") {
+        Cpu::ModelSpec spec;
+        Cpu::getModelSpec(STR2(NET)[0], spec);
+        Cpu::NetworkOptions options;
+        options.cacheDir = ".";
+        options.hugePages = HUGE_PAGES;
+#ifdef CPU_TUNE
+        options.tune = true;
+#endif
+        if (argc == 4 && !Cpu::parsePrecision(argv[3], options.precision)) {
+            std::cerr << "unknown precision " << argv[3] << ", expected fp32, fp16 or bf16" << std::endl;
+            return -1;
+        }
+        if (argc == 5) {
+            cpu_size = atoi(argv[4]);
+            if (cpu_size <= 0 || cpu_size % 32) {
+                std::cerr << "input size " << argv[4] << " must be a positive multiple of 32" << std::endl;
+                return -1;
+            }
+        }
+        cpuNet.reset(new Cpu::Network(spec, "../" + spec.name + ".wts", options));
+    } else if ((argc == 5 || argc == 6) && std::string(argv[1]) == "-k") {
+#ifdef USE_U8_INPUT
+        std::cerr << "darknet models have no Focus stem to fold uint8 input into, build without USE_U8_INPUT" << std::endl;
+        return -1;
+#endif
+        Cpu::NetworkOptions options;
+        options.cacheDir = ".";
+        options.hugePages = HUGE_PAGES;
+#ifdef CPU_TUNE
+        options.tune = true;
+#endif
+        if (argc == 6 && !Cpu::parsePrecision(argv[5], options.precision)) {
+            std::cerr << "unknown precision " << argv[5] << ", expected fp32, fp16 or bf16" << std::endl;
+            return -1;
+        }
+        cpuNet.reset(new Cpu::Network(argv[3], argv[4], options));
+        net_h = cpuNet->inputH();
+        net_w = cpuNet->inputW();
     } else {
         std::cerr << "arguments not right!" << std::endl;
         std::cerr << "./yolov5 -s  // serialize model to plan file" << std::endl;
         std::cerr << "./yolov5 -d ../samples  // deserialize plan file and run inference" << std::endl;
+        std::cerr << "./yolov5 -c ../samples [fp32|fp16|bf16] [size]  // run inference on the cpu backend, optionally letterboxed to size" << std::endl;
+        std::cerr << "./yolov5 -k ../samples yolov3-tiny.cfg yolov3-tiny.weights [fp32|fp16|bf16]  // run a darknet model on the cpu backend" << std::endl;
         return -1;
     }
 
@@ -523,68 +676,285 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    // optional per camera regions of interest, see load_rois()
+    std::vector<Roi> rois;
+    const std::string roi_file = std::string(argv[2]) + "/roi.txt";
+    if (!load_rois(roi_file, rois)) {
+        std::cerr << "could not parse " << roi_file << std::endl;
+        return -1;
+    }
+    file_names.erase(std::remove(file_names.begin(), file_names.end(), "roi.txt"), file_names.end());
+
     // prepare input data ---------------------------
-    static float data[BATCH_SIZE * 3 * INPUT_H * INPUT_W];
+    // every frame has its own input, strided by the largest so each can have its own letterbox
+    const int input_stride = 3 * std::max(net_h * net_w, cpu_size * cpu_size);
+    // the engine takes a batch in one buffer
+    static Cpu::HugeArray<InputType> data(BATCH_SIZE > 1 ? BATCH_SIZE * input_stride : 0, HUGE_PAGES);
     //for (int i = 0; i < 3 * INPUT_H * INPUT_W; i++)
     //    data[i] = 1.0;
     static float prob[BATCH_SIZE * OUTPUT_SIZE];
-    IRuntime* runtime = createInferRuntime(gLogger);
-    assert(runtime != nullptr);
-    ICudaEngine* engine = runtime->deserializeCudaEngine(trtModelStream, size);
-    assert(engine != nullptr);
-    IExecutionContext* context = engine->createExecutionContext();
-    assert(context != nullptr);
-    delete[] trtModelStream;
-
-    int fcount = 0;
-    for (int f = 0; f < (int)file_names.size(); f++) {
-        fcount++;
-        if (fcount < BATCH_SIZE && f + 1 != (int)file_names.size()) continue;
-        for (int b = 0; b < fcount; b++) {
-            cv::Mat img = cv::imread(std::string(argv[2]) + "/" + file_names[f - fcount + 1 + b]);
-            if (img.empty()) continue;
-            cv::Mat pr_img = preprocess_img(img); // letterbox BGR to RGB
-            int i = 0;
-            for (int row = 0; row < INPUT_H; ++row) {
-                uchar* uc_pixel = pr_img.data + row * pr_img.step;
-                for (int col = 0; col < INPUT_W; ++col) {
-                    data[b * 3 * INPUT_H * INPUT_W + i] = (float)uc_pixel[2] / 255.0;
-                    data[b * 3 * INPUT_H * INPUT_W + i + INPUT_H * INPUT_W] = (float)uc_pixel[1] / 255.0;
-                    data[b * 3 * INPUT_H * INPUT_W + i + 2 * INPUT_H * INPUT_W] = (float)uc_pixel[0] / 255.0;
-                    uc_pixel += 3;
-                    ++i;
+    IRuntime* runtime = nullptr;
+    ICudaEngine* engine = nullptr;
+    IExecutionContext* context = nullptr;
+    if (!cpuNet) {
+        runtime = createInferRuntime(gLogger);
+        assert(runtime != nullptr);
+        engine = runtime->deserializeCudaEngine(trtModelStream, size);
+        assert(engine != nullptr);
+        context = engine->createExecutionContext();
+        assert(context != nullptr);
+        delete[] trtModelStream;
+    }
+
+    // Between keyframes the boxes are moved by optical flow instead of running the
+    // network; a lost box brings the next keyframe forward to the current frame.
+    std::unique_ptr<Cpu::BoxFlow> flow;
+    if (KEYFRAME_INTERVAL > 1) {
+        Cpu::BoxFlowOptions flow_options;
+        // the flow and the cpu backend take turns on the network stage's thread
+        if (cpuNet) flow_options.pool = &cpuNet->pool();
+        flow.reset(new Cpu::BoxFlow(flow_options));
+        std::sort(file_names.begin(), file_names.end());  // frames of one sequence, in name order
+    }
+
+#ifdef DELTA_FILE
+    // the samples are one source; a multi stream app keys the encoder by stream id
+    Yolo::DeltaEncoder deltas;
+    std::ofstream delta_file(DELTA_FILE, std::ios::binary);
+    size_t delta_bytes = 0, full_bytes = 0;
+    std::vector<uint8_t> message;
+    // The encoder diffs each frame against the one before, so it takes them in file
+    // order. Bucketed batches finish out of order; a frame's detections wait here
+    // until every frame before it is done. Unreadable frames only move the order on.
+    std::map<long long, std::pair<bool, std::vector<Yolo::Detection>>> finished;
+    long long next_frame = 0;
+    auto emit = [&](const FrameJob& job) {
+        finished[job.index] = std::make_pair(!job.img.empty(), job.res);
+        for (auto it = finished.begin(); it != finished.end() && it->first == next_frame; it = finished.erase(it)) {
+            ++next_frame;
+            if (!it->second.first) continue;
+            const std::vector<Yolo::Detection>& dets = it->second.second;
+            message.clear();
+            delta_bytes += deltas.encode(0, dets, message);
+            full_bytes += sizeof(Yolo::DeltaHeader) + dets.size() * (sizeof(Yolo::DeltaRecord) + sizeof(Yolo::PackedDetection));
+            delta_file.write(reinterpret_cast<const char*>(message.data()), message.size());
+        }
+    };
+#else
+    auto emit = [](const FrameJob&) {};
+#endif
+
+    // Decoded frames, letterbox canvases and annotation buffers come from free lists
+    // once the first batch has run. Never destroyed, Mats may still point into it.
+    MatPool* mat_pool = new MatPool();
+    cv::Mat::setDefaultAllocator(mat_pool);
+
+    // Files are decoded, letterboxed, run through the network and annotated by
+    // stages with their own threads, see pipeline.h. The network stage is one thread
+    // that sees the frames in order, as the flow needs; the others get between 1 and
+    // PIPELINE_WORKERS threads, whatever keeps up with it. A batch short of BATCH_SIZE
+    // frames waits up to BATCH_WAIT_MS for more.
+    // Batches on the cpu backend at a size hold frames of one shape instead: each
+    // frame gets the bucket_shapes() shape that pads it least, and the network stage
+    // takes whichever shape has a full batch, or waited BATCH_WAIT_MS, so frames leave
+    // it out of order. That rules out the flow, and emit() puts them back in order.
+    std::vector<cv::Size> buckets;
+    if (cpuNet && cpu_size && BATCH_SIZE > 1) buckets = bucket_shapes(cpu_size);
+    std::mutex job_mutex;
+    std::vector<std::unique_ptr<FrameJob>> free_jobs;  // with their input buffers
+    PipelineOptions pipeline_options;
+    // enough frames for every bucket to fill a batch
+    if (!buckets.empty()) pipeline_options.maxInFlight = (buckets.size() + 1) * BATCH_SIZE + 3 * PIPELINE_WORKERS;
+    Pipeline<FrameJob> pipeline(pipeline_options);
+    StageOptions parallel;
+    parallel.maxWorkers = PIPELINE_WORKERS;
+    StageOptions serial;
+    serial.ordered = buckets.empty();
+    serial.batch = BATCH_SIZE;
+    serial.maxWaitMs = BATCH_WAIT_MS;
+    Pipeline<FrameJob>::BucketFn input_shape;
+    if (!buckets.empty()) {
+        input_shape = [](const FrameJob& job) {
+            return job.img.empty() ? (int64_t)-1 : (int64_t)job.input_h << 32 | job.input_w;
+        };
+    }
+    long long inferred = 0, content_pixels = 0, input_pixels = 0;  // frames through the network
+
+    pipeline.addStage("decode", [&](std::vector<FrameJob*>& jobs) {
+        FrameJob& job = *jobs[0];
+        job.img = cv::imread(std::string(argv[2]) + "/" + job.name);
+        if (flow && !job.img.empty()) cv::cvtColor(job.img, job.gray, cv::COLOR_BGR2GRAY);
+    }, parallel);
+
+    pipeline.addStage("preprocess", [&](std::vector<FrameJob*>& jobs) {
+        // with the flow most frames are tracked, the network stage letterboxes the others
+        if (!flow && !jobs[0]->img.empty()) prepare(*jobs[0], net_w, net_h, cpu_size, input_stride, buckets);
+    }, parallel);
+
+    pipeline.addStage("infer", [&](std::vector<FrameJob*>& jobs) {
+        std::vector<FrameJob*> batch;
+        for (FrameJob* job : jobs) {
+            if (job->img.empty()) {
+                emit(*job);
+                continue;
+            }
+            if (flow) {
+                std::vector<Yolo::Detection> tracked;
+                auto start = std::chrono::system_clock::now();
+                if (flow->age() + 1 < KEYFRAME_INTERVAL &&
+                        flow->propagate(job->gray.data, job->gray.cols, job->gray.rows, job->gray.step, tracked)) {
+                    auto end = std::chrono::system_clock::now();
+                    std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms (flow)" << std::endl;
+                    for (const Yolo::Detection& det : tracked) {
+                        // drifted out of the region of interest
+                        if (job->roi && cv::pointPolygonTest(job->roi->polygon, cv::Point2f(det.bbox[0], det.bbox[1]), false) < 0) continue;
+                        job->res.push_back(det);
+                    }
+                    emit(*job);
+                    continue;
                 }
+                prepare(*job, net_w, net_h, cpu_size, input_stride, buckets);
             }
+            batch.push_back(job);
         }
+        if (batch.empty()) return;
 
         // Run inference
         auto start = std::chrono::system_clock::now();
-        doInference(*context, data, prob, BATCH_SIZE);
+        if (cpuNet && !buckets.empty()) {
+            // one shape, one batch
+            const int input_h = batch[0]->input_h, input_w = batch[0]->input_w;
+            const size_t volume = 3 * input_h * input_w;
+            for (size_t b = 0; b < batch.size(); b++) {
+                memcpy(&data[b * volume], batch[b]->input.data(), volume * sizeof(InputType));
+            }
+#ifdef USE_U8_INPUT
+            cpuNet->infer(data.data(), Cpu::PixelLayout::kINTERLEAVED, input_h, input_w, prob, batch.size());
+#else
+            cpuNet->infer(data.data(), input_h, input_w, prob, batch.size());
+#endif
+        } else if (cpuNet) {
+            for (size_t b = 0; b < batch.size(); b++) {
+                FrameJob& job = *batch[b];
+#ifdef USE_U8_INPUT
+                cpuNet->infer(job.input.data(), Cpu::PixelLayout::kINTERLEAVED, job.input_h, job.input_w, &prob[b * OUTPUT_SIZE], 1);
+#else
+                cpuNet->infer(job.input.data(), job.input_h, job.input_w, &prob[b * OUTPUT_SIZE], 1);
+#endif
+            }
+        } else if (BATCH_SIZE == 1) {
+            doInference(*context, batch[0]->input.data(), prob, 1);
+        } else {
+            for (size_t b = 0; b < batch.size(); b++) {
+                memcpy(&data[b * input_stride], batch[b]->input.data(), input_stride * sizeof(InputType));
+            }
+            // a short batch only copies and runs the frames it has
+            doInference(*context, data.data(), prob, (int)batch.size());
+        }
         auto end = std::chrono::system_clock::now();
         std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
-        std::vector<std::vector<Yolo::Detection>> batch_res(fcount);
-        for (int b = 0; b < fcount; b++) {
-            auto& res = batch_res[b];
-            nms(res, &prob[b * OUTPUT_SIZE], CONF_THRESH, NMS_THRESH);
-        }
-        for (int b = 0; b < fcount; b++) {
-            auto& res = batch_res[b];
-            //std::cout << res.size() << std::endl;
-            cv::Mat img = cv::imread(std::string(argv[2]) + "/" + file_names[f - fcount + 1 + b]);
+        for (size_t b = 0; b < batch.size(); b++) {
+            FrameJob& job = *batch[b];
+            ++inferred;
+            content_pixels += job.content_pixels;
+            input_pixels += (long long)job.input_h * job.input_w;
+            std::vector<Yolo::Detection> res;
+            nms(res, &prob[b * OUTPUT_SIZE], CONF_THRESH, NMS_THRESH, &job.input_roi);
+            cv::Mat cropped = job.img(job.crop);
+            job.res.resize(res.size());
             for (size_t j = 0; j < res.size(); j++) {
-                cv::Rect r = get_rect(img, res[j].bbox);
-                cv::rectangle(img, r, cv::Scalar(0x27, 0xC1, 0x36), 2);
-                cv::putText(img, std::to_string((int)res[j].class_id), cv::Point(r.x, r.y - 1), cv::FONT_HERSHEY_PLAIN, 1.2, cv::Scalar(0xFF, 0xFF, 0xFF), 2);
+                // boxes are relative to the crop, shift them back into the frame
+                cv::Rect r = get_rect(cropped, res[j].bbox, job.input_w, job.input_h) + job.crop.tl();
+                job.res[j] = res[j];
+                job.res[j].bbox[0] = r.x + r.width / 2.0f;
+                job.res[j].bbox[1] = r.y + r.height / 2.0f;
+                job.res[j].bbox[2] = r.width;
+                job.res[j].bbox[3] = r.height;
             }
-            cv::imwrite("_" + file_names[f - fcount + 1 + b], img);
+            emit(job);
+            if (flow) flow->keyframe(job.gray.data, job.gray.cols, job.gray.rows, job.gray.step, job.res);
         }
-        fcount = 0;
+    }, serial, input_shape);
+
+    pipeline.addStage("annotate", [&](std::vector<FrameJob*>& jobs) {
+        FrameJob& job = *jobs[0];
+        if (job.img.empty()) return;
+        if (job.roi) {
+            std::vector<cv::Point> outline(job.roi->polygon.begin(), job.roi->polygon.end());
+            cv::polylines(job.img, outline, true, cv::Scalar(0xFF, 0x90, 0x1E), 2);
+        }
+        for (const Yolo::Detection& det : job.res) {
+            draw_box(job.img, cv::Rect(det.bbox[0] - det.bbox[2] / 2, det.bbox[1] - det.bbox[3] / 2, det.bbox[2], det.bbox[3]), (int)det.class_id);
+        }
+        cv::imwrite("_" + job.name, job.img);
+    }, parallel);
+
+    pipeline.setSink([&](std::unique_ptr<FrameJob> job) {
+        // the frames go back to the Mat pool, the job keeps its input buffer
+        job->img.release();
+        job->gray.release();
+        job->res.clear();
+        std::lock_guard<std::mutex> lock(job_mutex);
+        free_jobs.push_back(std::move(job));
+    });
+
+    long long index = 0;
+    for (const std::string& name : file_names) {
+        std::unique_ptr<FrameJob> job;
+        {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            if (!free_jobs.empty()) {
+                job = std::move(free_jobs.back());
+                free_jobs.pop_back();
+            }
+        }
+        if (!job) job.reset(new FrameJob());
+        job->name = name;
+        job->index = index++;
+        job->roi = find_roi(rois, name);
+        pipeline.push(std::move(job));
+    }
+    pipeline.finish();
+    for (const StageStats& stage : pipeline.stats()) {
+        std::cout << stage.name << ": " << stage.workers << " workers, " << stage.serviceMs << " ms per frame, "
+                  << stage.queued << " queued";
+        if (stage.batches < stage.items) std::cout << ", " << stage.batches << " batches (" << stage.fullBatches << " full)";
+        std::cout << std::endl;
+    }
+    if (input_pixels) {
+        std::cout << "padding: " << (int)((input_pixels - content_pixels) * 1000 / input_pixels) / 10.0 << "% of the input pixels";
+        if (!buckets.empty()) {
+            // what one batch shape for every frame would have cost
+            const long long square = (long long)cpu_size * cpu_size * inferred;
+            std::cout << ", " << (int)((square - content_pixels) * 1000 / square) / 10.0 << "% padded to " << cpu_size << "x" << cpu_size;
+        }
+        std::cout << std::endl;
     }
 
+    if (cpuNet) {
+        for (const auto& region : cpuNet->pageStats()) {
+            std::cout << region.first << ": " << Cpu::formatPageStats(region.second) << std::endl;
+        }
+        if (!free_jobs.empty()) {
+            const Cpu::HugeArray<InputType>& input = free_jobs[0]->input;
+            std::cout << "input: " << Cpu::formatPageStats(Cpu::pageStats(input.data(), input.size() * sizeof(InputType))) << std::endl;
+        }
+    }
+    MatPoolStats pool_stats = mat_pool->stats();
+    std::cout << "Mat pool: " << pool_stats.hits << " hits, " << pool_stats.misses << " misses ("
+              << (int)(pool_stats.hitRate() * 100) << "%), " << pool_stats.pooledBytes / (1 << 20) << "MB pooled" << std::endl;
+    cv::Mat::setDefaultAllocator(nullptr);
+
+#ifdef DELTA_FILE
+    std::cout << DELTA_FILE << ": " << delta_bytes << " bytes, " << full_bytes << " as full lists" << std::endl;
+#endif
+
     // Destroy the engine
-    context->destroy();
-    engine->destroy();
-    runtime->destroy();
+    if (context) {
+        context->destroy();
+        engine->destroy();
+        runtime->destroy();
+    }
 
     // Print histogram of the output distribution
     //std::cout << "\nOutput:\n\n";
@@ -21,6 +21,7 @@ INPUT_W = 608
 INPUT_H = 608
 CONF_THRESH = 0.5
 IOU_THRESHOLD = 0.4
+MAX_OUTPUT_BBOX_COUNT = 1000  # Yolo::MAX_OUTPUT_BBOX_COUNT in yolo_def.h
 
 
 def plot_one_box(x, img, color=None, label=None, line_thickness=None):
@@ -225,7 +226,9 @@ class YoLov5TRT(object):
         '''
         description: postprocess the prediction
         param:
-            output:     A tensor likes [num_boxes,cx,cy,w,h,conf,cls_id, cx,cy,w,h,conf,cls_id, ...] 
+            output:     A tensor likes [num_boxes, record, record, ...], each record 6 uint16
+                        [cx,cy,w,h,conf (float16), cls_id]; engines built before the packed
+                        records have 6 float32 per box instead
             origin_h:   height of original image
             origin_w:   width of original image
         return:
@@ -234,9 +237,15 @@ class YoLov5TRT(object):
             result_classid: finally classid, a tensor, each element is the classid correspoing to box
         '''
         # Get the num of boxes detected
-        num = int(output[0])
-        # Reshape to a two dimentional ndarray
-        pred = np.reshape(output[1:], (-1, 6))[:num, :]
+        num = min(int(output[0]), MAX_OUTPUT_BBOX_COUNT)
+        if output.size == 1 + MAX_OUTPUT_BBOX_COUNT * 6:
+            # legacy float32 records
+            pred = np.reshape(output[1:], (-1, 6))[:num, :]
+        else:
+            records = np.reshape(output[1:].view(np.uint16), (-1, 6))[:num, :]
+            pred = np.empty((num, 6), dtype=np.float32)
+            pred[:, :5] = records[:, :5].view(np.float16)
+            pred[:, 5] = records[:, 5]
         # to a torch Tensor
         pred = torch.Tensor(pred).cuda()
         # Get the boxes
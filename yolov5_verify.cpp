@@ -0,0 +1,262 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "cpu_backend.h"
+
+// Runs one input through a reference and a candidate execution mode of the CPU
+// backend and compares every named intermediate tensor, in graph order. The
+// reference is the FP32 float-input path, or tensors dumped from PyTorch with
+// gen_golden.py. Exits with 1 if any tensor is out of tolerance.
+
+struct VerifyOptions
+{
+    char net{'s'};
+    std::string wts;
+    std::string golden;
+    Cpu::NetworkOptions candidate;
+    bool u8{false};
+    int inputH{Yolo::INPUT_H};
+    int inputW{Yolo::INPUT_W};
+    double atol{1e-4};
+    double rtol{-1.0};  // < 0: picked from the candidate precision
+    bool all{false};
+};
+
+struct TensorStats
+{
+    double maxAbs{0.0};
+    double meanAbs{0.0};
+    double relL2{0.0};
+    double refMax{0.0};
+};
+
+static TensorStats compare(const float* ref, const float* out, size_t n) {
+    TensorStats st;
+    double err2 = 0.0, ref2 = 0.0, sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double d = std::fabs((double)out[i] - ref[i]);
+        st.maxAbs = std::max(st.maxAbs, d);
+        st.refMax = std::max(st.refMax, (double)std::fabs(ref[i]));
+        sum += d;
+        err2 += d * d;
+        ref2 += (double)ref[i] * ref[i];
+    }
+    st.meanAbs = n ? sum / n : 0.0;
+    st.relL2 = ref2 > 0.0 ? std::sqrt(err2 / ref2) : std::sqrt(err2);
+    return st;
+}
+
+// Maps PyTorch module names, as in the .wts keys and the golden dumps, to the node
+// holding that module's output. A node named after a module gets that name; a
+// container (model.4, model.4.m) resolves to the last node built inside it, which
+// is how the builders in buildYolov5() lay them out. Nodes that only exist in the
+// CPU graph have no counterpart: the Focus slice, the CSP concat, and cv2/cv3 of
+// bottleneckCSP, which carry the BN + leaky that follows the concat in PyTorch.
+static std::map<std::string, int> moduleOutputs(const Cpu::Graph& g) {
+    auto hasCounterpart = [&](const Cpu::Node& node) {
+        if (node.type == Cpu::OpType::kFOCUS) return false;
+        if (node.type == Cpu::OpType::kCONCAT && node.name.size() > 4 &&
+            node.name.compare(node.name.size() - 4, 4, ".cat") == 0) {
+            return false;
+        }
+        if (node.type == Cpu::OpType::kCONV) {
+            const Cpu::ConvDesc& d = g.convs[node.conv];
+            if (!d.bn.empty() && d.bn != d.name + ".bn") return false;
+        }
+        return true;
+    };
+    std::vector<bool> isOutput(g.nodes.size(), false);
+    for (int id : g.outputs) isOutput[id] = true;
+
+    std::map<std::string, int> names;
+    for (size_t i = 0; i < g.nodes.size(); ++i) {
+        const std::string& name = g.nodes[i].name;
+        if (isOutput[i] || !hasCounterpart(g.nodes[i])) continue;
+        // every dotted prefix below the top level "model"
+        size_t dot = name.find('.');
+        while ((dot = name.find('.', dot + 1)) != std::string::npos) {
+            names[name.substr(0, dot)] = (int)i;
+        }
+    }
+    for (size_t i = 0; i < g.nodes.size(); ++i) {
+        if (hasCounterpart(g.nodes[i])) names[g.nodes[i].name] = (int)i;
+    }
+    return names;
+}
+
+static void usage() {
+    std::cerr << "./yolov5_verify [options] <s|m|l|x> <weights.wts>" << std::endl;
+    std::cerr << "  --precision fp32|fp16|bf16  candidate weight precision (fp32)" << std::endl;
+    std::cerr << "  --u8                        candidate reads uint8 BGR frames" << std::endl;
+    std::cerr << "  --threads n                 candidate threads, 0: hardware (0)" << std::endl;
+    std::cerr << "  --size HxW                  input size, multiples of 32 (608x608)" << std::endl;
+    std::cerr << "  --golden file.wts           reference tensors from gen_golden.py instead of the fp32 path" << std::endl;
+    std::cerr << "  --atol a --rtol r           pass if max|out - ref| <= a + r * max|ref|" << std::endl;
+    std::cerr << "  --all                       list every tensor, not only failures" << std::endl;
+}
+
+static bool parseArgs(int argc, char** argv, VerifyOptions& opt) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (a == "--precision" && hasValue) {
+            if (!Cpu::parsePrecision(argv[++i], opt.candidate.precision)) return false;
+        } else if (a == "--u8") {
+            opt.u8 = true;
+        } else if (a == "--threads" && hasValue) {
+            opt.candidate.threads = atoi(argv[++i]);
+        } else if (a == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &opt.inputH, &opt.inputW) != 2) return false;
+        } else if (a == "--golden" && hasValue) {
+            opt.golden = argv[++i];
+        } else if (a == "--atol" && hasValue) {
+            opt.atol = atof(argv[++i]);
+        } else if (a == "--rtol" && hasValue) {
+            opt.rtol = atof(argv[++i]);
+        } else if (a == "--all") {
+            opt.all = true;
+        } else if (!a.empty() && a[0] == '-') {
+            return false;
+        } else {
+            positional.push_back(a);
+        }
+    }
+    if (positional.size() != 2 || positional[0].size() != 1) return false;
+    opt.net = positional[0][0];
+    opt.wts = positional[1];
+    if (opt.rtol < 0.0) {
+        // weight rounding compounds over ~60 convs; fp32 only differs in summation order
+        switch (opt.candidate.precision) {
+            case Cpu::Precision::kFP16: opt.rtol = 1e-2; break;
+            case Cpu::Precision::kBF16: opt.rtol = 5e-2; break;
+            default: opt.rtol = 1e-3; break;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    VerifyOptions opt;
+    Cpu::ModelSpec spec;
+    if (!parseArgs(argc, argv, opt) || !Cpu::getModelSpec(opt.net, spec)) {
+        usage();
+        return -1;
+    }
+    if (opt.u8 && !opt.golden.empty()) {
+        std::cerr << "--u8 needs the generated input, golden inputs are float" << std::endl;
+        return -1;
+    }
+
+    Cpu::WeightMap golden;
+    const size_t area = (size_t)opt.inputH * opt.inputW;
+    std::vector<float> input(3 * area);
+    std::vector<uint8_t> frame(3 * area);
+    if (!opt.golden.empty()) {
+        golden = Cpu::loadWeightMap(opt.golden);
+        auto it = golden.find("data");
+        if (it == golden.end() || it->second.size() != input.size()) {
+            std::cerr << "golden file has no " << opt.inputH << "x" << opt.inputW << " \"data\" tensor" << std::endl;
+            return -1;
+        }
+        input = it->second;
+    } else {
+        // an interleaved BGR frame and the same pixels as planar RGB in [0, 1], so the
+        // float and the uint8 paths see identical images
+        std::mt19937 rng(0);
+        for (auto& v : frame) v = (uint8_t)(rng() & 0xff);
+        for (size_t i = 0; i < area; ++i) {
+            for (int c = 0; c < 3; ++c) input[(2 - c) * area + i] = frame[i * 3 + c] / 255.0f;
+        }
+    }
+
+    Cpu::Network candidate(spec, opt.wts, opt.candidate);
+    std::unique_ptr<Cpu::Network> reference;
+    if (golden.empty()) {
+        Cpu::NetworkOptions refOptions;
+        refOptions.threads = opt.candidate.threads;
+        refOptions.cacheDir = opt.candidate.cacheDir;
+        reference.reset(new Cpu::Network(spec, opt.wts, refOptions));
+    }
+
+    std::vector<float> prob(Yolo::OUTPUT_SIZE);
+    if (reference) reference->infer(input.data(), opt.inputH, opt.inputW, prob.data(), 1);
+    if (opt.u8) {
+        candidate.infer(frame.data(), Cpu::PixelLayout::kINTERLEAVED, opt.inputH, opt.inputW, prob.data(), 1);
+    } else {
+        candidate.infer(input.data(), opt.inputH, opt.inputW, prob.data(), 1);
+    }
+
+    // reference tensor per node: same node of the fp32 network, or the golden module output
+    const Cpu::Graph& graph = candidate.graph();
+    std::vector<const float*> refs(graph.nodes.size(), nullptr);
+    std::vector<std::string> refNames(graph.nodes.size());
+    if (reference) {
+        for (size_t i = 0; i < graph.nodes.size(); ++i) {
+            const Cpu::OpType type = graph.nodes[i].type;
+            // with uint8 input the input node is never filled and the slice holds raw BGR bytes
+            if (opt.u8 && (type == Cpu::OpType::kINPUT || type == Cpu::OpType::kFOCUS)) continue;
+            refs[i] = reference->tensor((int)i);
+            refNames[i] = graph.nodes[i].name;
+        }
+    } else {
+        for (const auto& m : moduleOutputs(graph)) {
+            auto it = golden.find(m.first);
+            if (it == golden.end()) continue;
+            const Cpu::Shape& s = candidate.plan().shapes[m.second];
+            if (it->second.size() != s.volume()) {
+                std::cerr << "golden " << m.first << " has " << it->second.size() << " values, node "
+                          << graph.nodes[m.second].name << " has " << s.volume() << std::endl;
+                continue;
+            }
+            // several module names can land on one node (model.2 and model.2.cv4): keep the shortest
+            if (refs[m.second] && refNames[m.second].size() <= m.first.size()) continue;
+            refs[m.second] = it->second.data();
+            refNames[m.second] = m.first;
+        }
+    }
+
+    std::cout << "candidate " << Cpu::precisionName(opt.candidate.precision) << (opt.u8 ? " u8" : "")
+              << " vs " << (reference ? "fp32" : opt.golden) << ", " << opt.inputW << "x" << opt.inputH
+              << ", tolerance " << opt.atol << " + " << opt.rtol << " * max|ref|" << std::endl;
+    std::cout << std::left << std::setw(24) << "tensor" << std::setw(16) << "shape" << std::right
+              << std::setw(12) << "max abs" << std::setw(12) << "mean abs" << std::setw(12) << "rel l2"
+              << std::setw(12) << "max|ref|" << std::endl;
+
+    int compared = 0, failed = 0, firstFailure = -1;
+    TensorStats worst;
+    for (size_t i = 0; i < graph.nodes.size(); ++i) {
+        if (!refs[i]) continue;
+        const Cpu::Shape& s = candidate.plan().shapes[i];
+        TensorStats st = compare(refs[i], candidate.tensor((int)i), s.volume());
+        bool ok = st.maxAbs <= opt.atol + opt.rtol * st.refMax;
+        compared++;
+        if (!ok) {
+            failed++;
+            if (firstFailure < 0) firstFailure = (int)i;
+        }
+        if (st.relL2 > worst.relL2) worst = st;
+        if (!ok || opt.all) {
+            std::string shape = std::to_string(s.c) + "x" + std::to_string(s.h) + "x" + std::to_string(s.w);
+            std::cout << std::left << std::setw(24) << refNames[i] << std::setw(16) << shape << std::right
+                      << std::scientific << std::setprecision(3) << std::setw(12) << st.maxAbs
+                      << std::setw(12) << st.meanAbs << std::setw(12) << st.relL2 << std::setw(12) << st.refMax
+                      << std::defaultfloat << (ok ? "" : "  FAIL") << std::endl;
+        }
+    }
+
+    std::cout << compared << " tensors compared, " << failed << " out of tolerance, worst rel l2 " << worst.relL2 << std::endl;
+    if (firstFailure >= 0) {
+        std::cout << "first diverging tensor: " << refNames[firstFailure] << std::endl;
+        return 1;
+    }
+    return 0;
+}